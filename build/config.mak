@@ -19,6 +19,13 @@ ASFLAGS = -Os -Wall -Wextra -Werror
 
 LDFLAGS = -static -nostdlib
 
+# link user programs against the shared musl loaded by /lib/ld-musl-arm.so.1
+ifdef SHARED_LIBC
+	export SHARED_LIBC
+endif
+
+DYNAMIC_LINKER = /lib/ld-musl-arm.so.1
+
 # for gdb
 ifdef DEBUG
 	CFLAGS += -g
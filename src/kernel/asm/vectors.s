@@ -72,8 +72,13 @@ __current_process: .long current_process
 __svc_stack: .long svc_stack
 __irq_stack: .long irq_stack
 __data_abort_stack: .long data_abort_stack
+__boot_params: .long boot_params
 
 reset_handler:
+        @ keep the ATAG / device tree pointer from the boot loader
+        LDR   r4, __boot_params
+        STR   r2, [r4]
+
         LDR   sp, __svc_stack
         BL    kernel_main
         B     .
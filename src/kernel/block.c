@@ -20,6 +20,7 @@ limitations under the License.
 #include "buddy.h"
 #include "page.h"
 #include "slab.h"
+#include "cache.h"
 #include "system.h"
 #include "logger.h"
 #include "mmc.h"
@@ -38,24 +39,52 @@ static struct slab_cache* block_cache;
 static struct list used_blocks;
 static struct list free_blocks;
 
-static void prepare_blocks(void) {
+static void release_block(struct block *block) {
+  list_remove(&block->next);
+
+  /* every block of a page shares it, the first one owns it */
+  if (block->data == page_address(block->page)) {
+    buddy_free(block->page);
+  }
+
+  slab_cache_free(block_cache, block);
+}
+
+/* reclaim may run during either allocation, so nothing is listed until both succeed */
+static bool prepare_blocks(void) {
   int i;
   char *address;
   struct page *page;
-  struct block *block;
+  struct block *blocks[BLOCKS_PER_PAGE];
+
+  for (i = 0; i < BLOCKS_PER_PAGE; ++i) {
+    if (!(blocks[i] = slab_cache_alloc(block_cache))) {
+      goto fail;
+    }
+  }
+
+  if (!(page = buddy_alloc(PAGE_SIZE))) {
+    goto fail;
+  }
 
-  page = buddy_alloc(PAGE_SIZE);
   address = page_address(page);
 
   for (i = 0; i < BLOCKS_PER_PAGE; ++i) {
-    block = slab_cache_alloc(block_cache);
-    memset(block, 0, sizeof(struct block));
+    memset(blocks[i], 0, sizeof(struct block));
+
+    blocks[i]->page = page;
+    blocks[i]->data = address + (i * BLOCK_SIZE);
+
+    list_add(&free_blocks, &blocks[i]->next);
+  }
 
-    block->page = page;
-    block->data = address + (i * BLOCK_SIZE);
+  return true;
 
-    list_add(&free_blocks, &block->next);
+fail:
+  while (i-- > 0) {
+    slab_cache_free(block_cache, blocks[i]);
   }
+  return false;
 }
 
 static struct block *get_block(block_index index) {
@@ -67,8 +96,9 @@ static struct block *get_block(block_index index) {
     }
   }
 
-  if (list_empty(&free_blocks)) {
-    prepare_blocks();
+  /* without memory for the cache, callers go to the device directly */
+  if (list_empty(&free_blocks) && !prepare_blocks()) {
+    return NULL;
   }
 
   block = NULL;
@@ -92,7 +122,7 @@ static struct block *get_block(block_index index) {
 void block_init(void) {
   mmc_init();
 
-  block_cache = slab_cache_create("block", sizeof(struct block));
+  block_cache = slab_cache_create_with("block", sizeof(struct block), CACHE_LINE_SIZE, NULL);
 
   list_init(&used_blocks);
   list_init(&free_blocks);
@@ -100,11 +130,43 @@ void block_init(void) {
 
 void block_read(block_index index, void *data) {
   struct block *block = get_block(index);
-  memcpy(data, block->data, BLOCK_SIZE);
+
+  if (block) {
+    memcpy(data, block->data, BLOCK_SIZE);
+  } else {
+    mmc_read(index * BLOCK_SIZE, BLOCK_SIZE, data);
+  }
 }
 
 void block_write(block_index index, const void *data) {
   struct block *block = get_block(index);
-  memcpy(block->data, data, BLOCK_SIZE);
-  mmc_write(index * BLOCK_SIZE, BLOCK_SIZE, block->data);
+
+  if (block) {
+    memcpy(block->data, data, BLOCK_SIZE);
+    mmc_write(index * BLOCK_SIZE, BLOCK_SIZE, block->data);
+  } else {
+    mmc_write(index * BLOCK_SIZE, BLOCK_SIZE, data);
+  }
+}
+
+/* the cache is write-through, so every block can be dropped at any time */
+size_t block_shrink(void) {
+  size_t freed = 0;
+  struct block *block, *temp;
+
+  if (!block_cache) {
+    return 0;
+  }
+
+  list_foreach_safe(block, temp, &used_blocks, next) {
+    freed += (block->data == page_address(block->page));
+    release_block(block);
+  }
+
+  list_foreach_safe(block, temp, &free_blocks, next) {
+    freed += (block->data == page_address(block->page));
+    release_block(block);
+  }
+
+  return freed;
 }
@@ -26,5 +26,6 @@ typedef uint16_t block_index;
 void block_init(void);
 void block_read(block_index index, void *data);
 void block_write(block_index index, const void *data);
+size_t block_shrink(void);
 
 #endif
@@ -0,0 +1,185 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "boot.h"
+#include "lib/string.h"
+
+#define ATAG_NONE 0x00000000
+#define ATAG_CORE 0x54410001
+#define ATAG_MEM  0x54410002
+
+#define FDT_MAGIC      0xd00dfeed
+#define FDT_BEGIN_NODE 0x1
+#define FDT_END_NODE   0x2
+#define FDT_PROP       0x3
+#define FDT_NOP        0x4
+#define FDT_END        0x9
+
+#define FDT_ALIGN(n) (((n) + 3) & ~3)
+
+struct atag_header {
+  uint32_t size;
+  uint32_t tag;
+};
+
+struct atag_mem {
+  uint32_t size;
+  uint32_t start;
+};
+
+struct fdt_header {
+  uint32_t magic;
+  uint32_t total_size;
+  uint32_t struct_offset;
+  uint32_t strings_offset;
+  uint32_t reserve_map_offset;
+  uint32_t version;
+  uint32_t last_compatible_version;
+  uint32_t boot_cpuid;
+  uint32_t strings_size;
+  uint32_t struct_size;
+};
+
+/* written by reset_handler before anything else runs */
+uint32_t boot_params;
+
+static uint32_t fdt32(const void *p) {
+  const uint8_t *b = p;
+  return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+}
+
+static uint64_t fdt_cells(const uint8_t *p, uint32_t cells) {
+  uint64_t value = 0;
+
+  while (cells--) {
+    value = (value << 32) | fdt32(p);
+    p += 4;
+  }
+
+  return value;
+}
+
+static bool is_memory_node(const char *name) {
+  return (!strncmp(name, "memory", 6) && (name[6] == '\0' || name[6] == '@'));
+}
+
+static bool in_bank(uint32_t addr, uint64_t start, uint64_t size, uint64_t *end) {
+  if (addr < start || addr >= start + size) {
+    return false;
+  }
+
+  *end = start + size;
+  return true;
+}
+
+static bool atag_find_memory(const struct atag_header *header, uint32_t addr, uint64_t *end) {
+  const struct atag_mem *mem;
+
+  if (header->tag != ATAG_CORE) {
+    return false;
+  }
+
+  for (; header->size && header->tag != ATAG_NONE; header = (const struct atag_header*)((const uint32_t*)header + header->size)) {
+    if (header->tag == ATAG_MEM) {
+      mem = (const struct atag_mem*)(header + 1);
+
+      if (in_bank(addr, mem->start, mem->size, end)) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+/*
+ * Walks the structure block looking for "reg" of the top level memory
+ * nodes. Only the root #address-cells / #size-cells apply to those.
+ */
+static bool fdt_find_memory(const struct fdt_header *header, uint32_t addr, uint64_t *end) {
+  const uint8_t *fdt = (const uint8_t*)header;
+  const uint8_t *p = fdt + fdt32(&header->struct_offset);
+  const uint8_t *limit = p + fdt32(&header->struct_size);
+  const char *strings = (const char*)fdt + fdt32(&header->strings_offset);
+  const char *name;
+  uint32_t token, len, address_cells = 2, size_cells = 1, entry;
+  int depth = 0;
+  bool memory = false;
+
+  while (p < limit) {
+    token = fdt32(p);
+    p += 4;
+
+    switch (token) {
+      case FDT_BEGIN_NODE:
+        name = (const char*)p;
+        memory = (++depth == 2 && is_memory_node(name));
+
+        while (*p++);
+        p = fdt + FDT_ALIGN(p - fdt);
+        break;
+
+      case FDT_END_NODE:
+        memory = false;
+        depth--;
+        break;
+
+      case FDT_PROP:
+        len  = fdt32(p);
+        name = strings + fdt32(p + 4);
+        p += 8;
+
+        if (depth == 1 && !strcmp(name, "#address-cells")) {
+          address_cells = fdt32(p);
+        } else if (depth == 1 && !strcmp(name, "#size-cells")) {
+          size_cells = fdt32(p);
+        } else if (memory && !strcmp(name, "reg") && address_cells <= 2 && size_cells <= 2) {
+          entry = (address_cells + size_cells) * 4;
+
+          for (; len >= entry; len -= entry, p += entry) {
+            if (in_bank(addr, fdt_cells(p, address_cells), fdt_cells(p + address_cells * 4, size_cells), end)) {
+              return true;
+            }
+          }
+        }
+
+        p = fdt + FDT_ALIGN(p + len - fdt);
+        break;
+
+      case FDT_NOP:
+        break;
+
+      default:
+        return false;
+    }
+  }
+
+  return false;
+}
+
+bool boot_find_memory(uint32_t addr, uint64_t *end) {
+  const void *params = (const void*)boot_params;
+
+  if (!boot_params || (boot_params & 0x3)) {
+    return false;
+  }
+
+  if (fdt32(params) == FDT_MAGIC) {
+    return fdt_find_memory(params, addr, end);
+  }
+
+  return atag_find_memory(params, addr, end);
+}
@@ -0,0 +1,27 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _CYANURUS_BOOT_H_
+#define _CYANURUS_BOOT_H_
+
+#include "lib/type.h"
+
+/* r2 as handed over by the boot loader: an ATAG list or a flattened device tree */
+extern uint32_t boot_params;
+
+bool boot_find_memory(uint32_t addr, uint64_t *end);
+
+#endif
@@ -17,191 +17,460 @@ limitations under the License.
 #include "buddy.h"
 #include "system.h"
 #include "logger.h"
+#include "mmu.h"
+#include "reclaim.h"
 #include "lib/string.h"
 
+/* pages zeroed while idle, 1 MiB at most */
+#define ZEROED_POOL_MAX 256
+
+extern char kernel_end;
+
 struct free_list {
-  struct page *head;
+  struct list head;
+  size_t count;
+  size_t failures;
 };
 
 static struct free_list free_lists[PAGE_MAX_DEPTH];
 
+static size_t compactions;
+static size_t compact_failures;
+static size_t migrated_pages;
+
+/* order-0 pages held out of the free lists, already filled with zeros */
+static struct list zeroed_pages;
+static size_t zeroed_count;
+static size_t zero_hits;
+static size_t zero_misses;
+
+/* allocations made while memory is being reclaimed do not recurse */
+static bool reclaiming;
+
 static page_index buddy_find_buddy_index(struct page *page) {
-  if ((page->index >> page->order) & 0x1) {
-    return (page->index - (1 << page->order));
+  page_index index = PAGE_INDEX(page);
+
+  if ((index >> page->order) & 0x1) {
+    return (index - (1 << page->order));
   } else {
-    return (page->index + (1 << page->order));
+    return (index + (1 << page->order));
   }
 }
 
-static struct page *buddy_list_pop(struct free_list *list) {
-  struct page *page = list->head;
+static void buddy_list_push(unsigned int order, struct page *page) {
+  struct free_list *list = &free_lists[order];
 
-  if (page) {
-    list->head = page->next;
-    page->next = NULL;
-    page->flags &= ~PF_FREE_LIST;
+  page->order = order;
+  page->flags |= PF_FREE_LIST;
+
+  list_add(&list->head, &page->list);
+  list->count++;
+}
+
+static void buddy_list_remove(struct page *page) {
+  list_remove(&page->list);
+  page->flags &= ~PF_FREE_LIST;
+
+  free_lists[page->order].count--;
+}
+
+static struct page *buddy_list_pop(unsigned int order) {
+  struct free_list *list = &free_lists[order];
+  struct page *page;
+
+  if (list_empty(&list->head)) {
+    return NULL;
   }
 
+  page = container_of(list->head.next, struct page, list);
+  buddy_list_remove(page);
+
   return page;
 }
 
-static void buddy_list_push(struct free_list *list, struct page *page) {
-  if (list->head) {
-    page->next = list->head;
-  } else {
-    page->next = NULL;
+static int buddy_is_free_buddy(const struct page *page, page_index index) {
+  return (index < page_num && (pages[index].flags & PF_FREE_LIST) && pages[index].order == page->order);
+}
+
+void buddy_init(void) {
+  page_index i;
+  unsigned int order;
+
+  for (i = 0; i < PAGE_MAX_DEPTH; ++i) {
+    list_init(&free_lists[i].head);
+    free_lists[i].count = 0;
+    free_lists[i].failures = 0;
   }
 
-  list->head = page;
-  page->flags |= PF_FREE_LIST;
-}
+  compactions = compact_failures = migrated_pages = 0;
+
+  list_init(&zeroed_pages);
+  zeroed_count = zero_hits = zero_misses = 0;
+
+  /* the page array sits right below the pool and grows with it */
+  pages = (struct page*)(PAGE_START - (sizeof(struct page) * page_num));
+
+  if ((char*)pages < &kernel_end) {
+    logger_fatal("no room for %u pages", page_num);
+    system_halt();
+  }
 
-static struct page *buddy_list_remove(struct free_list *list, page_index index) {
-  struct page **pp = &list->head, *page = list->head;
+  memset(pages, 0, sizeof(struct page) * page_num);
 
-  while (page) {
-    if (page->index == index) {
-      *pp = page->next;
+  /*
+   * carve the pool into the largest aligned blocks, pushed from the top
+   * so that the lowest block is handed out first
+   */
+  for (i = page_num; i > 0; i -= (1U << order)) {
+    for (order = 0; order < PAGE_MAX_ORDER && !(i & (1U << order)); ++order);
+    buddy_list_push(order, &pages[i - (1U << order)]);
+  }
+}
 
-      page->next = NULL;
-      page->flags &= ~PF_FREE_LIST;
+static unsigned int buddy_order(size_t size) {
+  unsigned int order;
 
-      return page;
+  for (order = 0; order < PAGE_MAX_DEPTH; ++order) {
+    if (((1U << order) * PAGE_SIZE) >= size) {
+      return order;
     }
+  }
+
+  logger_fatal("requested page is too large: size=0x%x", size);
+  system_halt();
+
+  return PAGE_MAX_ORDER;
+}
+
+struct page *buddy_try_alloc(size_t size) {
+  unsigned int order = buddy_order(size), i;
+  struct page *page = NULL;
+
+  for (i = order; i < PAGE_MAX_DEPTH && !page; ++i) {
+    page = buddy_list_pop(i);
+  }
+
+  if (!page) {
+    return NULL;
+  }
 
-    pp = &page->next;
-    page = page->next;
+  /* split the block, returning the upper halves to the free lists */
+  for (--i; i > order; --i) {
+    buddy_list_push(i - 1, page + (1 << (i - 1)));
   }
 
-  return NULL;
+  page->order = order;
+  page->flags |= PF_FIRST_PAGE;
+  page->count = 1;
+
+  /* every page of the block finds its head in one step */
+  for (i = 0; i < (1U << order); ++i) {
+    page[i].head = i;
+  }
+
+  return page;
 }
 
-static int buddy_is_free_buddy(const struct page *page, const struct page *buddy) {
-  return ((buddy->flags & PF_FREE_LIST) && buddy->order == page->order);
+/*
+ * Turns an allocated block into independent single pages. Each keeps the
+ * reference count of the block, so they can be released one by one.
+ */
+void buddy_split(struct page *page) {
+  page_index i, n = 1U << page->order;
+
+  for (i = 0; i < n; ++i) {
+    page[i].order = 0;
+    page[i].head = 0;
+    page[i].flags |= PF_FIRST_PAGE;
+    page[i].count = page->count;
+  }
 }
 
-void buddy_init(void) {
-  struct page *page;
-  int i, len, max_page_block = (1 << PAGE_MAX_ORDER);
+static bool buddy_drain_zeroed(void) {
+  struct page *page, *temp;
+  bool drained = !list_empty(&zeroed_pages);
 
-  memset(free_lists, 0, sizeof(struct free_list) * PAGE_MAX_DEPTH);
+  list_foreach_safe(page, temp, &zeroed_pages, list) {
+    list_remove(&page->list);
+    page->flags &= ~PF_ZEROED;
+    buddy_free(page);
+  }
+  zeroed_count = 0;
 
-  pages = (struct page*)(PAGE_START - (sizeof(struct page) * PAGE_NUM));
-  memset(pages, 0, sizeof(struct page) * PAGE_NUM);
+  return drained;
+}
+
+/*
+ * Falls back to compaction, then to shrinking caches and killing a process,
+ * and returns NULL only when none of them makes room.
+ */
+struct page *buddy_alloc(size_t size) {
+  unsigned int order = buddy_order(size);
+  struct page *page = buddy_try_alloc(size);
 
-  for (i = 0; i < PAGE_NUM; ++i) {
-    pages[i].index = i;
+  if (page) {
+    return page;
+  }
+
+  if (reclaiming) {
+    free_lists[order].failures++;
+    return NULL;
   }
 
-  for (i = 0, len = PAGE_NUM / max_page_block; i < len; ++i) {
-    page = &pages[i * max_page_block];
+  reclaiming = true;
+
+  /* the zeroed pool is the cheapest memory to give back */
+  if (buddy_drain_zeroed()) {
+    page = buddy_try_alloc(size);
+  }
 
-    if (i < (len - 1)) {
-      page->next = &pages[(i + 1) * max_page_block];
+  while (!page) {
+    /* single pages can not be helped by moving others around */
+    if (order && buddy_compact(order) && (page = buddy_try_alloc(size))) {
+      break;
+    }
+
+    if (!reclaim_memory()) {
+      break;
     }
 
-    page->order = PAGE_MAX_ORDER;
-    page->flags |= PF_FREE_LIST;
+    page = buddy_try_alloc(size);
   }
 
-  free_lists[PAGE_MAX_ORDER].head = &pages[0];
+  reclaiming = false;
+
+  if (!page) {
+    free_lists[order].failures++;
+    logger_warn("out of memory: size=0x%x", size);
+  }
+
+  return page;
 }
 
-static struct page* buddy_pull_block(int from) {
-  int i, to = 0;
-  struct free_list *list;
+/* single pages come from the zeroed pool when it has any */
+struct page *buddy_alloc_zeroed(size_t size) {
   struct page *page;
 
-  for (i = from + 1; i < PAGE_MAX_DEPTH; ++i) {
-    list = &free_lists[i];
-    page = buddy_list_pop(list);
+  if (size <= PAGE_SIZE && !list_empty(&zeroed_pages)) {
+    page = container_of(zeroed_pages.next, struct page, list);
 
-    if (page) {
-      to = i - 1;
-      break;
-    }
+    list_remove(&page->list);
+    page->flags &= ~PF_ZEROED;
+
+    zeroed_count--;
+    zero_hits++;
+
+    return page;
   }
 
-  if (i == PAGE_MAX_DEPTH) {
-    logger_fatal("out of memory");
-    system_halt();
+  zero_misses++;
+
+  if ((page = buddy_alloc(size))) {
+    memset(page_address(page), 0, PAGE_SIZE << page->order);
   }
 
-  for (i = to; i >= from; --i) {
-    list = &free_lists[i];
+  return page;
+}
 
-    page->order = i;
-    list->head = page;
-    page->flags |= PF_FREE_LIST;
+/*
+ * Zeroes one free page into the pool. Called from the idle loop, it returns
+ * false once the pool is full or no page is left to take.
+ */
+bool buddy_zero_idle(void) {
+  struct page *page;
 
-    page += (1 << i);
+  if (zeroed_count >= ZEROED_POOL_MAX || !(page = buddy_try_alloc(PAGE_SIZE))) {
+    return false;
   }
 
-  page->order = from;
-  return page;
+  memset(page_address(page), 0, PAGE_SIZE);
+
+  page->flags |= PF_ZEROED;
+  list_add(&zeroed_pages, &page->list);
+  zeroed_count++;
+
+  return true;
 }
 
-struct page *buddy_alloc(size_t size) {
-  int i;
-  struct free_list *list;
-  struct page *page = NULL;
+void buddy_free(struct page *page) {
+  struct page *buddy;
+  page_index bi;
 
-  for (i = 0; i < PAGE_MAX_DEPTH; ++i) {
-    list = &free_lists[i];
+  SYSTEM_BUG_ON(page->flags & PF_FREE_LIST);
 
-    if (((1U << i) * PAGE_SIZE) >= size) {
-      page = buddy_list_pop(list);
+  page->flags &= ~PF_FIRST_PAGE;
 
-      if (!page) {
-        page = buddy_pull_block(i);
-      }
+  while (page->order < PAGE_MAX_ORDER) {
+    bi = buddy_find_buddy_index(page);
 
+    if (!buddy_is_free_buddy(page, bi)) {
       break;
     }
+
+    buddy = &pages[bi];
+
+    buddy_list_remove(buddy);
+
+    /* the merged block is headed by the lower half */
+    if (buddy < page) {
+      page->order = 0;
+      page = buddy;
+    } else {
+      buddy->order = 0;
+    }
+
+    page->order++;
   }
 
-  if (i == PAGE_MAX_DEPTH) {
-    logger_fatal("requested page is too large: size=0x%x", size);
-    system_halt();
+  buddy_list_push(page->order, page);
+}
+
+size_t buddy_count_free(unsigned int order) {
+  if (order >= PAGE_MAX_DEPTH) {
+    return 0;
   }
 
-  page->flags |= PF_FIRST_PAGE;
+  return free_lists[order].count;
+}
 
-  return page;
+static size_t buddy_free_pages(void) {
+  unsigned int order;
+  size_t count = 0;
+
+  for (order = 0; order < PAGE_MAX_DEPTH; ++order) {
+    count += free_lists[order].count << order;
+  }
+
+  return count;
 }
 
-void buddy_free(struct page *page) {
-  struct free_list *list;
-  struct page *p, *bp;
-  page_index bi;
+/*
+ * Counts the user pages that have to leave [start, start + 2^order), or
+ * returns false if the block holds anything that can not be moved.
+ */
+static bool buddy_count_moves(page_index start, unsigned int order, size_t *moves) {
+  page_index i = start, end = start + (1U << order);
+
+  *moves = 0;
+
+  while (i < end) {
+    if (pages[i].flags & PF_FREE_LIST) {
+      i += (1U << pages[i].order);
+    } else if (pages[i].flags & PF_MOVABLE) {
+      (*moves)++;
+      i++;
+    } else {
+      return false;
+    }
+  }
 
-  list = &free_lists[page->order];
+  return true;
+}
 
-  bi = buddy_find_buddy_index(page);
-  bp = &pages[bi];
+static void buddy_take_block(page_index start, unsigned int order) {
+  page_index i = start, end = start + (1U << order);
+  unsigned int block_order;
 
-  page->flags &= ~PF_FIRST_PAGE;
+  /* free pieces stay out of the lists so that migration can not land in them */
+  while (i < end) {
+    if (pages[i].flags & PF_FREE_LIST) {
+      block_order = pages[i].order;
+      buddy_list_remove(&pages[i]);
+      pages[i].order = 0;
 
-  if (page->order == PAGE_MAX_ORDER || !buddy_is_free_buddy(page, bp)) {
-    buddy_list_push(list, page);
-  } else {
-    page->flags &= ~PF_FREE_LIST;
-    page->next = NULL;
+      i += (1U << block_order);
+    } else {
+      i++;
+    }
+  }
+}
+
+/*
+ * Rebuilds a free block of the given order by migrating the user pages out
+ * of the candidate block that needs the fewest moves.
+ */
+bool buddy_compact(unsigned int order) {
+  page_index start, end, best = page_num, i;
+  size_t moves, best_moves = 0, free_pages = buddy_free_pages();
+
+  if (!order || order > PAGE_MAX_ORDER) {
+    return false;
+  }
+
+  mmu_mark_movable_pages();
 
-    p = buddy_list_remove(list, bi);
-    if (!p) {
-      logger_fatal("broken page");
-      system_halt();
+  for (start = 0; start + (1U << order) <= page_num; start += (1U << order)) {
+    if (buddy_count_moves(start, order, &moves) && (best == page_num || moves < best_moves)) {
+      best = start;
+      best_moves = moves;
     }
+  }
 
-    if ((bi >> page->order) & 0x1) {
-      p->order = 0;
-    } else {
-      page->order = 0;
-      page = p;
+  /* the moved pages need room outside of the block */
+  if (best < page_num && best_moves > free_pages - ((1U << order) - best_moves)) {
+    best = page_num;
+  }
+
+  if (best < page_num) {
+    end = best + (1U << order);
+
+    buddy_take_block(best, order);
+    SYSTEM_BUG_ON(mmu_migrate_pages(best, end) != best_moves);
+
+    for (i = best; i < end; ++i) {
+      pages[i].flags = 0;
+      pages[i].order = 0;
+      pages[i].count = 0;
     }
 
-    page->order++;
-    return buddy_free(page);
+    pages[best].order = order;
+    buddy_free(&pages[best]);
+
+    compactions++;
+    migrated_pages += best_moves;
+  } else {
+    compact_failures++;
+  }
+
+  for (i = 0; i < page_num; ++i) {
+    pages[i].flags &= ~PF_MOVABLE;
+  }
+
+  return (best < page_num);
+}
+
+void buddy_get_stat(struct buddy_stat *stat) {
+  unsigned int order;
+
+  for (order = 0; order < PAGE_MAX_DEPTH; ++order) {
+    stat->free_blocks[order] = free_lists[order].count;
+    stat->alloc_failures[order] = free_lists[order].failures;
   }
+
+  stat->free_pages = buddy_free_pages();
+  stat->compactions = compactions;
+  stat->compact_failures = compact_failures;
+  stat->migrated_pages = migrated_pages;
+  stat->zeroed_pages = zeroed_count;
+  stat->zero_hits = zero_hits;
+  stat->zero_misses = zero_misses;
+}
+
+/*
+ * Share of the free pages, in per mille, that sit in blocks too small to
+ * serve a request of the given order.
+ */
+unsigned int buddy_fragmentation(unsigned int order) {
+  unsigned int i;
+  size_t free_pages = buddy_free_pages(), usable = 0;
+
+  if (!free_pages || order > PAGE_MAX_ORDER) {
+    return 0;
+  }
+
+  for (i = order; i < PAGE_MAX_DEPTH; ++i) {
+    usable += free_lists[i].count << i;
+  }
+
+  return (unsigned int)(((free_pages - usable) * 1000) / free_pages);
 }
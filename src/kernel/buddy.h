@@ -20,8 +20,28 @@ limitations under the License.
 #include "page.h"
 #include "lib/type.h"
 
+struct buddy_stat {
+  size_t free_blocks[PAGE_MAX_DEPTH];
+  size_t alloc_failures[PAGE_MAX_DEPTH];
+  size_t free_pages;
+  size_t compactions;
+  size_t compact_failures;
+  size_t migrated_pages;
+  size_t zeroed_pages;
+  size_t zero_hits;
+  size_t zero_misses;
+};
+
 void buddy_init(void);
 struct page *buddy_alloc(size_t size);
+struct page *buddy_try_alloc(size_t size);
+struct page *buddy_alloc_zeroed(size_t size);
+bool buddy_zero_idle(void);
+void buddy_split(struct page *page);
 void buddy_free(struct page *page);
+size_t buddy_count_free(unsigned int order);
+bool buddy_compact(unsigned int order);
+void buddy_get_stat(struct buddy_stat *stat);
+unsigned int buddy_fragmentation(unsigned int order);
 
 #endif
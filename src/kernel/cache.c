@@ -0,0 +1,215 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "cache.h"
+
+#define SCTLR_C (1 << 2)
+#define SCTLR_Z (1 << 11)
+#define SCTLR_I (1 << 12)
+
+#define CLIDR_LOC(clidr)           (((clidr) >> 24) & 0x7)
+#define CLIDR_CTYPE(clidr, level)  (((clidr) >> ((level) * 3)) & 0x7)
+#define CLIDR_CTYPE_DATA           0x2
+
+#define CCSIDR_LINE_SHIFT(ccsidr)  (((ccsidr) & 0x7) + 4)
+#define CCSIDR_WAYS(ccsidr)        (((ccsidr) >> 3) & 0x3ff)
+#define CCSIDR_SETS(ccsidr)        (((ccsidr) >> 13) & 0x7fff)
+
+#define CTR_DMIN_LINE(ctr)         (4 << (((ctr) >> 16) & 0xf))
+
+enum cache_operation {
+  CACHE_CLEAN,
+  CACHE_INVALIDATE,
+  CACHE_CLEAN_INVALIDATE,
+};
+
+static uint32_t dcache_line_size(void) {
+  uint32_t ctr;
+
+  /* CTR */
+  __asm__(
+    "MRC p15, 0, %[ctr], c0, c0, 1 \n\t"
+    : [ctr] "=r"(ctr)
+  );
+
+  return CTR_DMIN_LINE(ctr);
+}
+
+static void dcache_operate_mva(enum cache_operation op, uint32_t mva) {
+  switch (op) {
+    case CACHE_CLEAN:
+      /* DCCMVAC */
+      __asm__ volatile ("MCR p15, 0, %[mva], c7, c10, 1 \n\t" : : [mva] "r"(mva) : "memory");
+      break;
+    case CACHE_INVALIDATE:
+      /* DCIMVAC */
+      __asm__ volatile ("MCR p15, 0, %[mva], c7, c6, 1 \n\t" : : [mva] "r"(mva) : "memory");
+      break;
+    case CACHE_CLEAN_INVALIDATE:
+      /* DCCIMVAC */
+      __asm__ volatile ("MCR p15, 0, %[mva], c7, c14, 1 \n\t" : : [mva] "r"(mva) : "memory");
+      break;
+  }
+}
+
+static void dcache_operate_set_way(enum cache_operation op, uint32_t set_way) {
+  switch (op) {
+    case CACHE_CLEAN:
+      /* DCCSW */
+      __asm__ volatile ("MCR p15, 0, %[sw], c7, c10, 2 \n\t" : : [sw] "r"(set_way) : "memory");
+      break;
+    case CACHE_INVALIDATE:
+      /* DCISW */
+      __asm__ volatile ("MCR p15, 0, %[sw], c7, c6, 2 \n\t" : : [sw] "r"(set_way) : "memory");
+      break;
+    case CACHE_CLEAN_INVALIDATE:
+      /* DCCISW */
+      __asm__ volatile ("MCR p15, 0, %[sw], c7, c14, 2 \n\t" : : [sw] "r"(set_way) : "memory");
+      break;
+  }
+}
+
+static void dcache_range(enum cache_operation op, const void *address, size_t size) {
+  uint32_t line = dcache_line_size();
+  uint32_t mva = (uint32_t)address & ~(line - 1);
+  uint32_t end = (uint32_t)address + size;
+
+  for (; mva < end; mva += line) {
+    dcache_operate_mva(op, mva);
+  }
+
+  __asm__ volatile ("DSB" : : : "memory");
+}
+
+static void dcache_all(enum cache_operation op) {
+  uint32_t clidr, ccsidr, level, line_shift, ways, sets, way_shift, way, set;
+
+  /* CLIDR */
+  __asm__(
+    "MRC p15, 1, %[clidr], c0, c0, 1 \n\t"
+    : [clidr] "=r"(clidr)
+  );
+
+  for (level = 0; level < CLIDR_LOC(clidr); ++level) {
+    if (CLIDR_CTYPE(clidr, level) < CLIDR_CTYPE_DATA) {
+      continue;
+    }
+
+    /* CSSELR, CCSIDR */
+    __asm__ volatile (
+      "MCR p15, 2, %[csselr], c0, c0, 0 \n\t"
+      "ISB                              \n\t"
+      "MRC p15, 1, %[ccsidr], c0, c0, 0 \n\t"
+      : [ccsidr] "=r"(ccsidr)
+      : [csselr] "r"(level << 1)
+    );
+
+    line_shift = CCSIDR_LINE_SHIFT(ccsidr);
+    ways = CCSIDR_WAYS(ccsidr);
+    sets = CCSIDR_SETS(ccsidr);
+    way_shift = ways ? __builtin_clz(ways) : 0;
+
+    for (way = 0; way <= ways; ++way) {
+      for (set = 0; set <= sets; ++set) {
+        dcache_operate_set_way(op, (way << way_shift) | (set << line_shift) | (level << 1));
+      }
+    }
+  }
+
+  __asm__ volatile (
+    "DSB \n\t"
+    "ISB \n\t"
+    : : : "memory"
+  );
+}
+
+void cache_enable(void) {
+  uint32_t sctlr;
+
+  cache_invalidate_dcache_all();
+
+  /* ICIALLU, BPIALL */
+  __asm__ volatile (
+    "MCR p15, 0, %[zero], c7, c5, 0 \n\t"
+    "MCR p15, 0, %[zero], c7, c5, 6 \n\t"
+    "DSB                            \n\t"
+    "ISB                            \n\t"
+    :
+    : [zero] "r"(0)
+    : "memory"
+  );
+
+  /* SCTLR */
+  __asm__ volatile (
+    "MRC p15, 0, %[sctlr], c1, c0, 0 \n\t"
+    : [sctlr] "=r"(sctlr)
+  );
+
+  __asm__ volatile (
+    "MCR p15, 0, %[sctlr], c1, c0, 0 \n\t"
+    "ISB                             \n\t"
+    :
+    : [sctlr] "r"(sctlr | SCTLR_C | SCTLR_I | SCTLR_Z)
+    : "memory"
+  );
+}
+
+void cache_clean_dcache(const void *address, size_t size) {
+  dcache_range(CACHE_CLEAN, address, size);
+}
+
+void cache_invalidate_dcache(const void *address, size_t size) {
+  dcache_range(CACHE_INVALIDATE, address, size);
+}
+
+void cache_clean_invalidate_dcache(const void *address, size_t size) {
+  dcache_range(CACHE_CLEAN_INVALIDATE, address, size);
+}
+
+void cache_clean_dcache_all(void) {
+  dcache_all(CACHE_CLEAN);
+}
+
+void cache_invalidate_dcache_all(void) {
+  dcache_all(CACHE_INVALIDATE);
+}
+
+void cache_clean_invalidate_dcache_all(void) {
+  dcache_all(CACHE_CLEAN_INVALIDATE);
+}
+
+void cache_sync_icache(const void *address, size_t size) {
+  uint32_t line = dcache_line_size();
+  uint32_t mva = (uint32_t)address & ~(line - 1);
+  uint32_t end = (uint32_t)address + size;
+
+  /* DCCMVAU */
+  for (; mva < end; mva += line) {
+    __asm__ volatile ("MCR p15, 0, %[mva], c7, c11, 1 \n\t" : : [mva] "r"(mva) : "memory");
+  }
+
+  /* ICIALLU, BPIALL */
+  __asm__ volatile (
+    "DSB                            \n\t"
+    "MCR p15, 0, %[zero], c7, c5, 0 \n\t"
+    "MCR p15, 0, %[zero], c7, c5, 6 \n\t"
+    "DSB                            \n\t"
+    "ISB                            \n\t"
+    :
+    : [zero] "r"(0)
+    : "memory"
+  );
+}
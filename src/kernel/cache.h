@@ -0,0 +1,37 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _CYANURUS_CACHE_H_
+#define _CYANURUS_CACHE_H_
+
+#include "lib/type.h"
+
+/* L1 line size of the Cortex-A9 */
+#define CACHE_LINE_SIZE 32
+
+void cache_enable(void);
+
+void cache_clean_dcache(const void *address, size_t size);
+void cache_invalidate_dcache(const void *address, size_t size);
+void cache_clean_invalidate_dcache(const void *address, size_t size);
+
+void cache_clean_dcache_all(void);
+void cache_invalidate_dcache_all(void);
+void cache_clean_invalidate_dcache_all(void);
+
+void cache_sync_icache(const void *address, size_t size);
+
+#endif
@@ -17,9 +17,9 @@ limitations under the License.
 #include "dentry.h"
 #include "lib/string.h"
 #include "slab.h"
+#include "cache.h"
 #include "logger.h"
 #include "uart.h"
-#include "buddy.h"
 
 #define DIRENT_SIZE sizeof(struct minix3_dirent)
 
@@ -28,6 +28,10 @@ static struct dentry *root_dentry;
 
 static struct dentry *alloc_dentry(struct dentry *parent, struct inode *inode, const char *name) {
   struct dentry *new = slab_cache_alloc(dentry_cache);
+
+  if (!new) {
+    return NULL;
+  }
   memset(new, 0, sizeof(struct dentry));
 
   if (parent) {
@@ -48,10 +52,10 @@ static int read_children(struct dentry *dentry) {
   size_t offset = 0;
   struct minix3_dirent *dirent;
   struct dentry *child_dentry, *temp_dentry;
+  struct inode *child_inode;
   struct list children;
 
-  _page_cleanup_ struct page *page = buddy_alloc(BLOCK_SIZE);
-  struct minix3_dirent *dirents = page_address(page);
+  _kmalloc_cleanup_ struct minix3_dirent *dirents = kmalloc(BLOCK_SIZE);
 
   list_init(&children);
 
@@ -64,6 +68,11 @@ static int read_children(struct dentry *dentry) {
     return 0;
   }
 
+  /* left unloaded, so the next lookup tries again */
+  if (!dirents) {
+    return -1;
+  }
+
   while (1) {
     if ((rs = inode_read(dentry->inode, BLOCK_SIZE, offset, dirents)) < 0) {
       goto fail;
@@ -81,7 +90,12 @@ static int read_children(struct dentry *dentry) {
       dirent = &dirents[i];
 
       if (dirent->d_ino) {
-        child_dentry = alloc_dentry(dentry, inode_get(dirent->d_ino), dirent->d_name);
+        if (!(child_inode = inode_get(dirent->d_ino))) {
+          goto fail;
+        }
+        if (!(child_dentry = alloc_dentry(dentry, child_inode, dirent->d_name))) {
+          goto fail;
+        }
         list_add(&children, &child_dentry->sibling);
       }
     }
@@ -122,8 +136,11 @@ static int remove_child(struct dentry *dentry, const char *name) {
   size_t offset = 0;
   struct minix3_dirent *dirent;
 
-  _page_cleanup_ struct page *page = buddy_alloc(BLOCK_SIZE);
-  struct minix3_dirent *dirents = page_address(page);
+  _kmalloc_cleanup_ struct minix3_dirent *dirents = kmalloc(BLOCK_SIZE);
+
+  if (!dirents) {
+    return -1;
+  }
 
   while (1) {
     if ((rs = inode_read(dentry->inode, BLOCK_SIZE, offset, dirents)) < 0) {
@@ -210,13 +227,19 @@ static int create_dentry(struct dentry *dentry, const char *name, struct inode *
     }
   }
 
-  new = alloc_dentry(dentry, inode, name);
+  if (!(new = alloc_dentry(dentry, inode, name))) {
+    return -1;
+  }
   list_add(&dentry->children, &new->sibling);
   write_child(new);
 
   dentry->nentries++;
   new->inode->nlinks++;
-  inode_set(new->inode);
+
+  /* the entry is already on disk, so undoing it could fail the same way */
+  if (inode_set(new->inode) < 0) {
+    logger_warn("link count not written: inode=%u", new->inode->index);
+  }
 
   return 0;
 }
@@ -230,7 +253,10 @@ static int destroy_dentry(struct dentry *dentry) {
 
   parent->nentries--;
   dentry->inode->nlinks--;
-  inode_set(dentry->inode);
+
+  if (inode_set(dentry->inode) < 0) {
+    logger_warn("link count not written: inode=%u", dentry->inode->index);
+  }
 
   list_remove(&dentry->sibling);
   slab_cache_free(dentry_cache, dentry);
@@ -239,7 +265,7 @@ static int destroy_dentry(struct dentry *dentry) {
 }
 
 void dentry_init(void) {
-  dentry_cache = slab_cache_create("dentry", sizeof(struct dentry));
+  dentry_cache = slab_cache_create_with("dentry", sizeof(struct dentry), CACHE_LINE_SIZE, NULL);
   root_dentry = alloc_dentry(NULL, inode_get(1), "");
 }
 
@@ -22,6 +22,7 @@ limitations under the License.
 #include "inode.h"
 #include "buddy.h"
 #include "page.h"
+#include "cache.h"
 #include "user.h"
 
 #define ELF_MAGIC           "\177ELF"
@@ -29,16 +30,15 @@ limitations under the License.
 #define ELF_DATA_2LE        1
 #define ELF_VERSION_CURRENT 1
 #define ELF_TYPE_EXEC       2
+#define ELF_TYPE_DYN        3
 #define ELF_ARCH_ARM        40
 
 #define ELF_FLAGS_EABI(flags) ((flags) & 0Xff000000)
 #define ELF_FLAGS_EABI_V5     0x05000000
 
 #define ELF_PH_TYPE_LOAD    1
-
-#define ELF_PH_FLAGS_X      (1 << 0)
-#define ELF_PH_FLAGS_W      (1 << 1)
-#define ELF_PH_FLAGS_R      (1 << 2)
+#define ELF_PH_TYPE_INTERP  3
+#define ELF_PH_TYPE_PHDR    6
 
 struct elf_header {
   struct {
@@ -76,71 +76,172 @@ struct elf_program_header {
   uint32_t align;
 };
 
-static bool validate_segment(const struct elf_segment *segment) {
+static bool validate_segment_address(const struct elf_segment *segment, bool dynamic) {
   uint8_t *addr = (void*)segment->addr;
   uint32_t size = segment->memory_size;
 
+  if (add_overflow_unsigned_long((unsigned long)addr, size)) {
+    return false;
+  }
+
+  /* relocated objects may also live in the mmap area */
+  if (dynamic) {
+    return IS_USER_ADDRESSS(addr) && IS_USER_ADDRESSS(addr + size);
+  }
+
+  return IS_EXECUTABLE_ADDRESS(addr) && IS_EXECUTABLE_ADDRESS(addr + size);
+}
+
+static bool validate_segment(const struct elf_segment *segment, const struct inode *inode, bool dynamic) {
   if (segment->file_size > segment->memory_size) {
     return false;
   }
 
-  if (add_overflow_unsigned_long((unsigned long)addr, size)) {
+  /* addresses of position independent objects are checked once they are relocated */
+  if (!dynamic && !validate_segment_address(segment, false)) {
     return false;
   }
 
-  if (!IS_EXECUTABLE_ADDRESS(addr) || !IS_EXECUTABLE_ADDRESS(addr + size)) {
+  /* the whole file image must exist so that copying cannot fail half way */
+  if (add_overflow_unsigned_long(segment->offset, segment->file_size) || segment->offset + segment->file_size > inode->size) {
     return false;
   }
 
   return true;
 }
 
-static void copy_segment(struct elf_segment *segment) {
-  void *data = page_address(segment->page);
+static uint32_t segment_page_start(const struct elf_segment *segment) {
+  return segment->addr & ~(PAGE_SIZE - 1);
+}
 
-  memcpy((char*)segment->addr, data, segment->file_size);
-  memset((char*)segment->addr + segment->file_size, 0, segment->memory_size - segment->file_size);
+static uint32_t segment_page_end(const struct elf_segment *segment) {
+  return (segment->addr + segment->memory_size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
 }
 
-static void release_segment(struct elf_segment *segment) {
-  if (segment->page) {
-    buddy_free(segment->page);
-    segment->page = NULL;
+/*
+ * Read-only segments whose file offset matches their address within a
+ * page are served from the inode page cache, unless another segment has
+ * to be copied into one of their pages.
+ */
+static bool is_mappable_segment(const struct elf_executable *executable, const struct elf_segment *segment) {
+  size_t i;
+  const struct elf_segment *other;
+
+  if (segment->flags & ELF_PH_FLAGS_W) {
+    return false;
+  }
+
+  if ((segment->offset & (PAGE_SIZE - 1)) != (segment->addr & (PAGE_SIZE - 1))) {
+    return false;
+  }
+
+  if (segment->file_size != segment->memory_size) {
+    return false;
+  }
+
+  for (i = 0; i < executable->segment_num; ++i) {
+    other = &executable->segments[i];
+
+    if (other != segment && segment_page_start(other) < segment_page_end(segment) && segment_page_start(segment) < segment_page_end(other)) {
+      return false;
+    }
   }
+
+  return true;
 }
 
-static int load_segment(struct elf_segment *segment, const struct elf_program_header *header, struct dentry *dentry) {
-  void *data;
-  ssize_t size;
+/* the file image is read page by page straight into the target pages, the page holding its end is zero filled */
+static int copy_segment(const struct elf_segment *segment, struct inode *inode) {
+  uint32_t file_end = segment->addr + segment->file_size;
+  uint32_t zero_end = (file_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+  if (zero_end > segment->addr + segment->memory_size) {
+    zero_end = segment->addr + segment->memory_size;
+  }
 
-  if (segment->page) {
+  if (inode_read(inode, segment->file_size, segment->offset, (void*)segment->addr) < 0) {
     return -1;
   }
+  memset((char*)file_end, 0, zero_end - file_end);
+
+  if (segment->flags & ELF_PH_FLAGS_X) {
+    cache_sync_icache((void*)segment->addr, segment->file_size);
+  }
+
+  return 0;
+}
+
+static int load_segment(struct elf_executable *executable, const struct elf_program_header *header) {
+  struct elf_segment *segment, *prev;
+
+  if (!header->memory_size) {
+    return 0;
+  }
+
+  if (executable->segment_num >= ELF_MAX_SEGMENTS) {
+    return -1;
+  }
+
+  segment = &executable->segments[executable->segment_num];
 
   segment->addr        = header->virtual_addr;
+  segment->offset      = header->offset;
   segment->file_size   = header->file_size;
   segment->memory_size = header->memory_size;
-  segment->page        = buddy_alloc(segment->file_size);
+  segment->flags       = header->flags;
+  segment->mapped      = false;
 
-  if (!validate_segment(segment)) {
-    goto fail;
+  if (!validate_segment(segment, executable->inode, executable->dynamic)) {
+    return -1;
   }
 
-  data = page_address(segment->page);
-  size = inode_read(dentry->inode, segment->file_size, header->offset, data);
+  /* loadable segments come sorted by address and must not overlap */
+  if (executable->segment_num > 0) {
+    prev = segment - 1;
 
-  if (size < 0 || (uint32_t)size != segment->file_size) {
-    goto fail;
+    if (prev->addr + prev->memory_size > segment->addr) {
+      return -1;
+    }
   }
 
+  executable->segment_num++;
   return 0;
-fail:
-  release_segment(segment);
-  return -1;
+}
+
+static int load_interpreter(struct elf_executable *executable, const struct elf_program_header *header) {
+  ssize_t size;
+
+  if (executable->interpreter || header->file_size < 2 || header->file_size > PATH_MAX) {
+    return -1;
+  }
+
+  executable->interpreter = (char*)page_address(executable->page) + (PAGE_SIZE - PATH_MAX);
+  size = inode_read(executable->inode, header->file_size, header->offset, executable->interpreter);
+
+  if (size < 0 || (uint32_t)size != header->file_size || executable->interpreter[size - 1] != '\0') {
+    return -1;
+  }
+
+  return 0;
+}
+
+/* without PT_PHDR the program headers are found through the segment loading them */
+static void find_program_headers(struct elf_executable *executable, uint32_t offset) {
+  size_t i;
+  const struct elf_segment *segment;
+
+  for (i = 0; i < executable->segment_num && !executable->phdr; ++i) {
+    segment = &executable->segments[i];
+
+    if (segment->offset <= offset && offset + executable->phent * executable->phnum <= segment->offset + segment->file_size) {
+      executable->phdr = segment->addr + (offset - segment->offset);
+    }
+  }
 }
 
 int elf_load(const char *path, struct elf_executable *executable) {
   int i, offset;
+  size_t j;
   struct dentry *dentry;
   ssize_t rs;
   struct elf_header header;
@@ -159,7 +260,6 @@ int elf_load(const char *path, struct elf_executable *executable) {
         (header.id.class   != ELF_CLASS_32BIT)     ||
         (header.id.data    != ELF_DATA_2LE)        ||
         (header.id.version != ELF_VERSION_CURRENT) ||
-        (header.type       != ELF_TYPE_EXEC)       ||
         (header.arch       != ELF_ARCH_ARM)        ||
         (header.version    != ELF_VERSION_CURRENT) ||
         (ELF_FLAGS_EABI(header.flags) != ELF_FLAGS_EABI_V5))
@@ -167,35 +267,58 @@ int elf_load(const char *path, struct elf_executable *executable) {
     return -1;
   }
 
+  if (header.type != ELF_TYPE_EXEC && header.type != ELF_TYPE_DYN) {
+    return -1;
+  }
+
   memset(executable, 0, sizeof(struct elf_executable));
 
+  executable->inode    = dentry->inode;
+  executable->dynamic  = header.type == ELF_TYPE_DYN;
+  executable->phent    = header.program_header_size;
+  executable->phnum    = header.program_header_num;
+  if (!(executable->page = buddy_alloc(PAGE_SIZE))) {
+    return -1;
+  }
+  executable->segments = page_address(executable->page);
+
   for (i = 0; i < header.program_header_num; ++i) {
     offset = header.program_header_offset + (header.program_header_size * i);
     rs = inode_read(dentry->inode, sizeof(struct elf_program_header), offset, &program_header);
 
     if (rs != sizeof(struct elf_program_header)) {
-      return -1;
-    }
-
-    if (program_header.type != ELF_PH_TYPE_LOAD) {
-      continue;
+      goto fail;
     }
 
-    switch(program_header.flags) {
-      case (ELF_PH_FLAGS_R | ELF_PH_FLAGS_X):
-        if (load_segment(&executable->text, &program_header, dentry) < 0) {
+    switch (program_header.type) {
+      case ELF_PH_TYPE_LOAD:
+        if (load_segment(executable, &program_header) < 0) {
           goto fail;
         }
         break;
 
-      case (ELF_PH_FLAGS_R | ELF_PH_FLAGS_W):
-        if (load_segment(&executable->data, &program_header, dentry) < 0) {
+      case ELF_PH_TYPE_INTERP:
+        if (load_interpreter(executable, &program_header) < 0) {
           goto fail;
         }
         break;
+
+      case ELF_PH_TYPE_PHDR:
+        executable->phdr = program_header.virtual_addr;
+        break;
     }
   }
 
+  if (!executable->segment_num) {
+    goto fail;
+  }
+
+  for (j = 0; j < executable->segment_num; ++j) {
+    executable->segments[j].mapped = is_mappable_segment(executable, &executable->segments[j]);
+  }
+
+  find_program_headers(executable, header.program_header_offset);
+
   executable->entry_point = header.entry_point;
   return 0;
 fail:
@@ -203,12 +326,64 @@ fail:
   return -1;
 }
 
-void elf_copy(struct elf_executable *executable) {
-  copy_segment(&executable->text);
-  copy_segment(&executable->data);
+int elf_relocate(struct elf_executable *executable, uint32_t base) {
+  size_t i;
+  struct elf_segment *segment;
+
+  if (!executable->dynamic || (base & (PAGE_SIZE - 1))) {
+    return -1;
+  }
+
+  for (i = 0; i < executable->segment_num; ++i) {
+    segment = &executable->segments[i];
+
+    if (add_overflow_unsigned_long(segment->addr, base)) {
+      return -1;
+    }
+    segment->addr += base;
+
+    if (!validate_segment_address(segment, true)) {
+      return -1;
+    }
+  }
+
+  executable->base = base;
+  executable->entry_point += base;
+
+  if (executable->phdr) {
+    executable->phdr += base;
+  }
+
+  return 0;
+}
+
+/* bytes spanned by the loadable segments, counted from the start of the first page */
+uint32_t elf_image_size(const struct elf_executable *executable) {
+  const struct elf_segment *first = &executable->segments[0];
+  const struct elf_segment *last  = &executable->segments[executable->segment_num - 1];
+
+  return segment_page_end(last) - segment_page_start(first);
+}
+
+int elf_copy(struct elf_executable *executable) {
+  size_t i;
+
+  for (i = 0; i < executable->segment_num; ++i) {
+    if (!executable->segments[i].mapped && copy_segment(&executable->segments[i], executable->inode) < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
 }
 
 void elf_release(struct elf_executable *executable) {
-  release_segment(&executable->text);
-  release_segment(&executable->data);
+  if (executable->page) {
+    buddy_free(executable->page);
+    executable->page = NULL;
+  }
+
+  executable->segments = NULL;
+  executable->segment_num = 0;
+  executable->interpreter = NULL;
 }
@@ -19,23 +19,61 @@ limitations under the License.
 
 #include "lib/type.h"
 #include "page.h"
+#include "inode.h"
+#include "dentry.h"
 
+/* one page holds the segment table followed by the interpreter path */
+#define ELF_MAX_SEGMENTS ((PAGE_SIZE - PATH_MAX) / sizeof(struct elf_segment))
+
+#define ELF_PH_FLAGS_X (1 << 0)
+#define ELF_PH_FLAGS_W (1 << 1)
+#define ELF_PH_FLAGS_R (1 << 2)
+
+#define AT_NULL   0
+#define AT_PHDR   3
+#define AT_PHENT  4
+#define AT_PHNUM  5
+#define AT_PAGESZ 6
+#define AT_BASE   7
+#define AT_ENTRY  9
+#define AT_HWCAP  16
+
+#define HWCAP_TLS (1 << 15)
+
+/* a mapped segment is faulted in from the inode instead of being copied */
 struct elf_segment {
-  struct page *page;
   uint32_t addr;
+  uint32_t offset;
   uint32_t file_size;
   uint32_t memory_size;
+  uint32_t flags;
+  bool mapped;
 };
 
+/*
+ * Position independent objects (ET_DYN) are linked at zero and have to be
+ * moved to their base with elf_relocate before they are mapped.
+ */
 struct elf_executable {
   uint32_t entry_point;
+  struct inode *inode;
+  bool dynamic;
+  uint32_t base;
 
-  struct elf_segment text;
-  struct elf_segment data;
+  uint32_t phdr;
+  uint32_t phent;
+  uint32_t phnum;
+  char *interpreter;
+
+  struct page *page;
+  struct elf_segment *segments;
+  size_t segment_num;
 };
 
 int elf_load(const char *path, struct elf_executable *executable);
-void elf_copy(struct elf_executable *executable);
+int elf_relocate(struct elf_executable *executable, uint32_t base);
+uint32_t elf_image_size(const struct elf_executable *executable);
+int elf_copy(struct elf_executable *executable);
 void elf_release(struct elf_executable *executable);
 
 #endif
@@ -22,7 +22,7 @@ limitations under the License.
 #include "superblock.h"
 #include "inode.h"
 #include "dentry.h"
-#include "buddy.h"
+#include "slab.h"
 
 static void remove_dentry_and_children(struct dentry *dentry) {
   struct dentry *child, *temp;
@@ -46,13 +46,16 @@ int fs_create(const char *path, int flags, mode_t mode) {
   struct inode *inode = NULL;
   int errno = -EINVAL;
 
-  _page_cleanup_ struct page *page = buddy_alloc(PATH_MAX);
-  char *buf = page_address(page);
+  _kmalloc_cleanup_ char *buf = kmalloc(PATH_MAX);
 
   if (strnlen(path, PATH_MAX) == PATH_MAX) {
     return -ENAMETOOLONG;
   }
 
+  if (!buf) {
+    return -ENOMEM;
+  }
+
   if ((dentry = dentry_lookup(path))) {
     return (flags & O_EXCL) ? -EEXIST : 0;
   }
@@ -115,13 +118,16 @@ int fs_mkdir(const char *path, mode_t mode) {
   struct inode *inode = NULL;
   int errno = -EINVAL;
 
-  _page_cleanup_ struct page *page = buddy_alloc(PATH_MAX);
-  char *buf = page_address(page);
+  _kmalloc_cleanup_ char *buf = kmalloc(PATH_MAX);
 
   if (strnlen(path, PATH_MAX) == PATH_MAX) {
     return -ENAMETOOLONG;
   }
 
+  if (!buf) {
+    return -ENOMEM;
+  }
+
   if (dentry_lookup(path)) {
     return -EEXIST;
   }
@@ -25,6 +25,9 @@ limitations under the License.
 #define GICC_PMR  0x0004
 #define GICC_IAR  0x000c
 #define GICC_EOIR 0x0010
+#define GICC_HPPIR 0x0018
+
+#define GIC_SPURIOUS_IRQ 1023
 
 #define GICD_CTLR 0x0000
 #define GICD_ISENABLER(n) (GIC_DIST_BASE + 0x100 + (n / 32) * 4)
@@ -62,3 +65,8 @@ void gic_end_of_interrupt(uint32_t irq) {
   // GICC_EOIR
   io_write32(GIC_CPU_BASE + GICC_EOIR, irq & 0x3ff);
 }
+
+bool gic_irq_pending(void) {
+  // GICC_HPPIR
+  return (io_read32(GIC_CPU_BASE + GICC_HPPIR) & 0x3ff) != GIC_SPURIOUS_IRQ;
+}
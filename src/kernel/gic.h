@@ -31,5 +31,6 @@ void gic_init(void);
 void gic_enable_irq(int id);
 uint32_t gic_interrupt_acknowledge(void);
 void gic_end_of_interrupt(uint32_t irq);
+bool gic_irq_pending(void);
 
 #endif
@@ -19,6 +19,7 @@ limitations under the License.
 #include "lib/string.h"
 #include "lib/errno.h"
 #include "slab.h"
+#include "cache.h"
 #include "logger.h"
 #include "system.h"
 #include "buddy.h"
@@ -35,9 +36,51 @@ limitations under the License.
 #define INODES_PER_BLOCK (BLOCK_SIZE / sizeof(struct minix2_inode))
 #define ZONES_PER_BLOCK  (BLOCK_SIZE / sizeof(uint32_t))
 
+/*
+ * Cached file pages are indexed by block: a block is exactly one page, so
+ * a page can be filled and written back with a single block transfer.
+ */
+struct inode_page {
+  struct list next;
+  size_t index;
+  struct page *page;
+  bool dirty;
+};
+
 static struct slab_cache *inode_cache;
+static struct slab_cache *inode_page_cache;
 static struct list inodes;
 
+/*
+ * Metadata updates fall back to this block when kmalloc fails, so they
+ * only fail when reclaim re-enters one while another holds the block.
+ */
+static uint8_t metadata_reserve[BLOCK_SIZE];
+static bool metadata_reserve_used;
+
+#define _metadata_cleanup_ _cleanup_(metadata_buffer_cleanup)
+
+static void *metadata_buffer(void) {
+  void *buf = kmalloc(BLOCK_SIZE);
+
+  if (!buf && !metadata_reserve_used) {
+    metadata_reserve_used = true;
+    buf = metadata_reserve;
+  }
+
+  return buf;
+}
+
+static void metadata_buffer_cleanup(void *ptr) {
+  void *buf = *(void**)ptr;
+
+  if (buf == metadata_reserve) {
+    metadata_reserve_used = false;
+  } else {
+    kfree(buf);
+  }
+}
+
 static struct inode *get_inode(inode_index index) {
   struct inode *inode;
 
@@ -47,16 +90,58 @@ static struct inode *get_inode(inode_index index) {
     }
   }
 
-  inode = slab_cache_alloc(inode_cache);
+  if (!(inode = slab_cache_alloc(inode_cache))) {
+    return NULL;
+  }
   memset(inode, 0, sizeof(struct inode));
 
   inode->index = index;
+  list_init(&inode->pages);
   list_add(&inodes, &inode->next);
 
   return inode;
 }
 
+static struct inode_page *find_inode_page(const struct inode *inode, size_t index) {
+  struct inode_page *ipage;
+
+  list_foreach(ipage, &inode->pages, next) {
+    if (ipage->index == index) {
+      return ipage;
+    }
+  }
+
+  return NULL;
+}
+
+static void release_inode_page(struct inode_page *ipage) {
+  list_remove(&ipage->next);
+  page_put(ipage->page);
+  slab_cache_free(inode_page_cache, ipage);
+}
+
+/* pages still mapped by processes stay alive until they are unmapped */
+static void release_inode_pages(struct inode *inode, size_t from) {
+  struct inode_page *ipage, *temp;
+
+  list_foreach_safe(ipage, temp, &inode->pages, next) {
+    if (ipage->index >= from) {
+      release_inode_page(ipage);
+    }
+  }
+}
+
+/* bytes past the end of file must read back as zeros if it grows again */
+static void zero_inode_page_tail(const struct inode *inode, size_t offset) {
+  struct inode_page *ipage = find_inode_page(inode, offset / PAGE_SIZE);
+
+  if (ipage) {
+    memset((char*)page_address(ipage->page) + (offset % PAGE_SIZE), 0, PAGE_SIZE - (offset % PAGE_SIZE));
+  }
+}
+
 static void release_inode(struct inode *inode) {
+  release_inode_pages(inode, 0);
   list_remove(&inode->next);
   slab_cache_free(inode_cache, inode);
 }
@@ -66,8 +151,11 @@ static uint32_t mark_map(block_index start, block_index end, uint32_t limit) {
   uint32_t index;
   block_index block;
 
-  _page_cleanup_ struct page *page = buddy_alloc(BLOCK_SIZE);
-  uint8_t *buf = page_address(page);
+  _kmalloc_cleanup_ uint8_t *buf = kmalloc(BLOCK_SIZE);
+
+  if (!buf) {
+    return 0;
+  }
 
   for (block = start, index = 0; block < end; ++block) {
     block_read(block, buf);
@@ -95,16 +183,20 @@ static uint32_t mark_map(block_index start, block_index end, uint32_t limit) {
   return 0;
 }
 
-static void unmark_map(uint32_t index, block_index start) {
+static int unmark_map(uint32_t index, block_index start) {
   block_index block = start + ((index / 8) / BLOCK_SIZE);
 
-  _page_cleanup_ struct page *page = buddy_alloc(BLOCK_SIZE);
-  uint8_t *buf = page_address(page);
+  _metadata_cleanup_ uint8_t *buf = metadata_buffer();
+
+  if (!buf) {
+    return -ENOMEM;
+  }
 
   block_read(block, buf);
 
   buf[(index / 8) % BLOCK_SIZE] &= ~(1 << (index % 8));
   block_write(block, buf);
+  return 0;
 }
 
 static inode_index mark_imap(void) {
@@ -114,7 +206,7 @@ static inode_index mark_imap(void) {
   return mark_map(start, end, IMAP_LIMITS);
 }
 
-static void unmark_imap(inode_index index) {
+static int unmark_imap(inode_index index) {
   block_index start = IMAP_ZONE_INDEX;
   return unmark_map(index, start);
 }
@@ -131,21 +223,20 @@ static block_index mark_zmap(void) {
   return index + FIRST_DATA_ZONE - 1;
 }
 
-static void unmark_zmap(block_index index) {
+static int unmark_zmap(block_index index) {
   block_index start = IMAP_ZONE_INDEX + IMAP_BLOCKS;
 
   if (index < FIRST_DATA_ZONE) {
-    return;
+    return 0;
   }
 
-  unmark_map(index - FIRST_DATA_ZONE + 1, start);
+  return unmark_map(index - FIRST_DATA_ZONE + 1, start);
 }
 
-static void read_inode(inode_index index, struct minix2_inode *inode) {
+/* buf is a BLOCK_SIZE scratch buffer */
+static void read_inode_with(inode_index index, struct minix2_inode *inode, void *buf) {
   block_index inode_block;
-
-  _page_cleanup_ struct page *page = buddy_alloc(BLOCK_SIZE);
-  struct minix2_inode *inodes = page_address(page);
+  struct minix2_inode *inodes = buf;
 
   index--;
   inode_block = index / INODES_PER_BLOCK;
@@ -154,11 +245,25 @@ static void read_inode(inode_index index, struct minix2_inode *inode) {
   memcpy(inode, inodes + (index % INODES_PER_BLOCK), sizeof(struct minix2_inode));
 }
 
-static void write_inode(inode_index index, const struct minix2_inode *inode) {
+static int read_inode(inode_index index, struct minix2_inode *inode) {
+  _metadata_cleanup_ void *buf = metadata_buffer();
+
+  if (!buf) {
+    return -ENOMEM;
+  }
+
+  read_inode_with(index, inode, buf);
+  return 0;
+}
+
+static int write_inode(inode_index index, const struct minix2_inode *inode) {
   block_index inode_block;
 
-  _page_cleanup_ struct page *page = buddy_alloc(BLOCK_SIZE);
-  struct minix2_inode *inodes = page_address(page);
+  _metadata_cleanup_ struct minix2_inode *inodes = metadata_buffer();
+
+  if (!inodes) {
+    return -ENOMEM;
+  }
 
   index--;
   inode_block = index / INODES_PER_BLOCK;
@@ -167,14 +272,18 @@ static void write_inode(inode_index index, const struct minix2_inode *inode) {
   memcpy(inodes + (index % INODES_PER_BLOCK), inode, sizeof(struct minix2_inode));
 
   block_write(INODE_ZONE_INDEX + inode_block, inodes);
+  return 0;
 }
 
 static int extend_zone(struct minix2_inode *inode, size_t size) {
   block_index block, start, end;
   block_index z0, z1, z2;
 
-  _page_cleanup_ struct page *page = buddy_alloc(BLOCK_SIZE);
-  uint32_t *zones = page_address(page);
+  _kmalloc_cleanup_ uint32_t *zones = kmalloc(BLOCK_SIZE);
+
+  if (!zones) {
+    return -ENOMEM;
+  }
 
   start = (inode->i_size / BLOCK_SIZE) + 1;
   end = (size / BLOCK_SIZE) + 1;
@@ -250,14 +359,16 @@ fail:
   return -ENOSPC;
 }
 
-static void shrink_zone(struct minix2_inode *inode, size_t size) {
+static int shrink_zone(struct minix2_inode *inode, size_t size) {
   block_index block, start, end;
   block_index z0, z1, z2, z3, z4;
 
-  _page_cleanup_ struct page *page0 = buddy_alloc(BLOCK_SIZE);
-  _page_cleanup_ struct page *page1 = buddy_alloc(BLOCK_SIZE);
+  _kmalloc_cleanup_ uint32_t *zones0 = kmalloc(BLOCK_SIZE);
+  _kmalloc_cleanup_ uint32_t *zones1 = kmalloc(BLOCK_SIZE);
 
-  uint32_t *zones0 = page_address(page0), *zones1 = page_address(page1);
+  if (!zones0 || !zones1) {
+    return -ENOMEM;
+  }
 
   start = inode->i_size / BLOCK_SIZE;
   end = size / BLOCK_SIZE;
@@ -337,16 +448,16 @@ static void shrink_zone(struct minix2_inode *inode, size_t size) {
   }
 
   inode->i_size = size;
+  return 0;
 }
 
-static block_index get_block(struct inode *inode, block_index block) {
+/* buf is a BLOCK_SIZE scratch buffer, so looking up a block never allocates */
+static block_index get_block(struct inode *inode, block_index block, void *buf) {
   block_index z0, z1, z2;
   struct minix2_inode minix_inode;
+  uint32_t *zones = buf;
 
-  _page_cleanup_ struct page *page = buddy_alloc(BLOCK_SIZE);
-  uint32_t *zones = page_address(page);
-
-  read_inode(inode->index, &minix_inode);
+  read_inode_with(inode->index, &minix_inode, buf);
 
   if (block <= 6) {
     z0 = block;
@@ -408,7 +519,8 @@ static size_t calculate_block_copy_size(size_t start, size_t size) {
 }
 
 void inode_init(void) {
-  inode_cache = slab_cache_create("inode", sizeof(struct inode));
+  inode_cache = slab_cache_create_with("inode", sizeof(struct inode), CACHE_LINE_SIZE, NULL);
+  inode_page_cache = slab_cache_create("inode_page", sizeof(struct inode_page));
   list_init(&inodes);
 }
 
@@ -430,24 +542,31 @@ struct inode *inode_create(uint32_t mode) {
     return NULL;
   }
 
-  write_inode(index, &minix_inode);
-
-  inode = get_inode(index);
+  if (write_inode(index, &minix_inode) < 0 || !(inode = get_inode(index))) {
+    unmark_zmap(minix_inode.i_zone[0]);
+    unmark_imap(index);
+    return NULL;
+  }
   inode->mode = mode;
 
   return inode;
 }
 
 int inode_destroy(struct inode *inode) {
+  int r;
   struct minix2_inode minix_inode;
-  inode_truncate(inode, 0);
 
-  read_inode(inode->index, &minix_inode);
-  unmark_zmap(minix_inode.i_zone[0]);
+  if ((r = inode_truncate(inode, 0)) < 0 || (r = read_inode(inode->index, &minix_inode)) < 0) {
+    return r;
+  }
+  if ((r = unmark_zmap(minix_inode.i_zone[0])) < 0) {
+    return r;
+  }
   memset(&minix_inode, 0, sizeof(struct minix2_inode));
-  write_inode(inode->index, &minix_inode);
+  if ((r = write_inode(inode->index, &minix_inode)) < 0 || (r = unmark_imap(inode->index)) < 0) {
+    return r;
+  }
 
-  unmark_imap(inode->index);
   release_inode(inode);
   return 0;
 }
@@ -458,11 +577,14 @@ int inode_truncate(struct inode *inode, size_t size) {
   size_t tsize, tstart, toffset, tcopy;
   block_index ind_block;
 
-  _page_cleanup_ struct page *page = buddy_alloc(BLOCK_SIZE);
-  char *buf = page_address(page);
+  _kmalloc_cleanup_ char *buf = kmalloc(BLOCK_SIZE);
+
+  if (!buf) {
+    return -ENOMEM;
+  }
 
   if (size != inode->size) {
-    read_inode(inode->index, &minix_inode);
+    read_inode_with(inode->index, &minix_inode, buf);
 
     if (size > inode->size) {
       tstart = inode->size;
@@ -472,12 +594,13 @@ int inode_truncate(struct inode *inode, size_t size) {
       if (r < 0) {
         return r;
       }
+      zero_inode_page_tail(inode, inode->size);
 
       while (tsize > 0) {
         toffset = calculate_block_offset(tstart);
         tcopy = calculate_block_copy_size(tstart, tsize);
 
-        ind_block = get_block(inode, tstart / BLOCK_SIZE);
+        ind_block = get_block(inode, tstart / BLOCK_SIZE, buf);
         if (!ind_block) {
           return -ENOSPC;
         }
@@ -492,11 +615,16 @@ int inode_truncate(struct inode *inode, size_t size) {
         SYSTEM_BUG_ON((tstart + tsize) != size);
       }
     } else {
-      shrink_zone(&minix_inode, size);
+      r = shrink_zone(&minix_inode, size);
+      if (r < 0) {
+        return r;
+      }
+      release_inode_pages(inode, (size + PAGE_SIZE - 1) / PAGE_SIZE);
+      zero_inode_page_tail(inode, size);
     }
 
     inode->size = minix_inode.i_size;
-    write_inode(inode->index, &minix_inode);
+    return write_inode(inode->index, &minix_inode);
   }
 
   return 0;
@@ -506,9 +634,9 @@ struct inode *inode_get(inode_index index) {
   struct inode *inode;
   struct minix2_inode minix_inode;
 
-  read_inode(index, &minix_inode);
-
-  inode = get_inode(index);
+  if (read_inode(index, &minix_inode) < 0 || !(inode = get_inode(index))) {
+    return NULL;
+  }
   inode->mode = minix_inode.i_mode;
   inode->size = minix_inode.i_size;
   inode->nlinks = minix_inode.i_nlinks;
@@ -516,26 +644,34 @@ struct inode *inode_get(inode_index index) {
   return inode;
 }
 
-void inode_set(struct inode *inode) {
+int inode_set(struct inode *inode) {
+  int r;
   struct minix2_inode minix_inode;
-  read_inode(inode->index, &minix_inode);
+
+  if ((r = read_inode(inode->index, &minix_inode)) < 0) {
+    return r;
+  }
 
   minix_inode.i_mode   = inode->mode;
   minix_inode.i_size   = inode->size;
   minix_inode.i_nlinks = inode->nlinks;
 
-  write_inode(inode->index, &minix_inode);
+  return write_inode(inode->index, &minix_inode);
 }
 
 ssize_t inode_write(struct inode *inode, size_t size, size_t start, const void *data) {
   int r, errno;
   block_index ind_zone, ind_block, ind_start, ind_end;
+  struct inode_page *ipage;
 
   const char *cur_data = data;
   size_t offset, copy, cur_size = size, cur_start = start;
 
-  _page_cleanup_ struct page *page = buddy_alloc(BLOCK_SIZE);
-  char *buf = page_address(page);
+  _kmalloc_cleanup_ char *buf = kmalloc(BLOCK_SIZE);
+
+  if (!buf) {
+    return -ENOMEM;
+  }
 
   ind_start = start / BLOCK_SIZE;
   ind_end   = (start + size) / BLOCK_SIZE;
@@ -556,7 +692,7 @@ ssize_t inode_write(struct inode *inode, size_t size, size_t start, const void *
       }
     }
 
-    ind_block = get_block(inode, ind_zone);
+    ind_block = get_block(inode, ind_zone, buf);
     if (!ind_block) {
       errno = -EINVAL;
       goto fail;
@@ -566,6 +702,10 @@ ssize_t inode_write(struct inode *inode, size_t size, size_t start, const void *
     memcpy(buf + offset, cur_data, copy);
     block_write(ind_block, buf);
 
+    if ((ipage = find_inode_page(inode, ind_zone))) {
+      memcpy((char*)page_address(ipage->page) + offset, cur_data, copy);
+    }
+
     cur_data  += copy;
     cur_start += copy;
     cur_size  -= copy;
@@ -580,14 +720,19 @@ fail:
 ssize_t inode_read(struct inode *inode, size_t size, size_t start, void *data) {
   block_index ind_zone, ind_block, ind_start, ind_end;
   size_t offset, copy, cur_size, cur_start;
+  struct inode_page *ipage;
 
-  _page_cleanup_ struct page *page = buddy_alloc(BLOCK_SIZE);
-  char *buf = page_address(page), *cur_data = data;
+  _kmalloc_cleanup_ char *buf = kmalloc(BLOCK_SIZE);
+  char *cur_data = data;
 
   if (inode->size <= start) {
     return 0;
   }
 
+  if (!buf) {
+    return -ENOMEM;
+  }
+
   if (inode->size < (start + size)) {
     size = inode->size - start;
   }
@@ -602,13 +747,18 @@ ssize_t inode_read(struct inode *inode, size_t size, size_t start, void *data) {
     offset = calculate_block_offset(cur_start);
     copy = calculate_block_copy_size(cur_start, cur_size);
 
-    ind_block = get_block(inode, ind_zone);
-    if (ind_block) {
-      block_read(ind_block, buf);
+    /* cached pages may hold writes through shared mappings */
+    if ((ipage = find_inode_page(inode, ind_zone))) {
+      memcpy(cur_data, (char*)page_address(ipage->page) + offset, copy);
     } else {
-      memset(buf, 0, BLOCK_SIZE);
+      ind_block = get_block(inode, ind_zone, buf);
+      if (ind_block) {
+        block_read(ind_block, buf);
+      } else {
+        memset(buf, 0, BLOCK_SIZE);
+      }
+      memcpy(cur_data, buf + offset, copy);
     }
-    memcpy(cur_data, buf + offset, copy);
 
     cur_data  += copy;
     cur_start += copy;
@@ -617,3 +767,100 @@ ssize_t inode_read(struct inode *inode, size_t size, size_t start, void *data) {
 
   return size;
 }
+
+struct page *inode_get_page(struct inode *inode, size_t index) {
+  struct inode_page *ipage;
+  block_index block;
+  size_t start = index * PAGE_SIZE;
+  char *buf;
+
+  if ((ipage = find_inode_page(inode, index))) {
+    return ipage->page;
+  }
+
+  if (!(ipage = slab_cache_alloc(inode_page_cache))) {
+    return NULL;
+  }
+  if (!(ipage->page = buddy_alloc(PAGE_SIZE))) {
+    slab_cache_free(inode_page_cache, ipage);
+    return NULL;
+  }
+  ipage->index = index;
+  ipage->dirty = false;
+
+  buf = page_address(ipage->page);
+
+  /* the page doubles as scratch space for the zone lookup */
+  if (start < inode->size && (block = get_block(inode, index, buf))) {
+    block_read(block, buf);
+  } else {
+    memset(buf, 0, PAGE_SIZE);
+  }
+
+  /* bytes past the end of file read as zero */
+  if (start < inode->size && inode->size - start < PAGE_SIZE) {
+    memset(buf + (inode->size - start), 0, PAGE_SIZE - (inode->size - start));
+  }
+
+  list_add(&inode->pages, &ipage->next);
+  return ipage->page;
+}
+
+void inode_dirty_page(struct inode *inode, size_t index) {
+  struct inode_page *ipage = find_inode_page(inode, index);
+
+  if (ipage) {
+    ipage->dirty = true;
+  }
+}
+
+int inode_sync(struct inode *inode) {
+  struct inode_page *ipage;
+  block_index block;
+
+  _kmalloc_cleanup_ void *buf = NULL;
+
+  list_foreach(ipage, &inode->pages, next) {
+    if (!ipage->dirty) {
+      continue;
+    }
+
+    if (!buf && !(buf = kmalloc(BLOCK_SIZE))) {
+      return -ENOMEM;
+    }
+
+    /* shared mappings never extend the file */
+    if (ipage->index * PAGE_SIZE < inode->size && (block = get_block(inode, ipage->index, buf))) {
+      block_write(block, page_address(ipage->page));
+    }
+
+    /* writable mappings left can dirty the page again without faulting */
+    if (ipage->page->count == 1) {
+      ipage->dirty = false;
+    }
+  }
+
+  return 0;
+}
+
+size_t inode_shrink(void) {
+  struct inode *inode;
+  struct inode_page *ipage, *temp;
+  size_t freed = 0;
+
+  if (!inode_cache) {
+    return 0;
+  }
+
+  /* clean pages nobody maps can always be read back from disk */
+  list_foreach(inode, &inodes, next) {
+    list_foreach_safe(ipage, temp, &inode->pages, next) {
+      if (!ipage->dirty && ipage->page->count == 1) {
+        release_inode_page(ipage);
+        freed++;
+      }
+    }
+  }
+
+  return freed;
+}
@@ -20,6 +20,7 @@ limitations under the License.
 #include "lib/type.h"
 #include "lib/list.h"
 #include "block.h"
+#include "page.h"
 
 #define S_ISREG(m)  (m & S_IFREG)
 #define S_ISDIR(m)  (m & S_IFDIR)
@@ -61,6 +62,7 @@ struct inode {
   uint32_t mode;
   uint32_t nlinks;
   size_t size;
+  struct list pages;
 };
 
 void inode_init(void);
@@ -68,8 +70,12 @@ struct inode *inode_create(uint32_t mode);
 int inode_destroy(struct inode *inode);
 int inode_truncate(struct inode *inode, size_t size);
 struct inode *inode_get(inode_index index);
-void inode_set(struct inode *inode);
+int inode_set(struct inode *inode);
 ssize_t inode_write(struct inode *inode, size_t size, size_t start, const void *data);
 ssize_t inode_read(struct inode *inode, size_t size, size_t start, void *data);
+struct page *inode_get_page(struct inode *inode, size_t index);
+void inode_dirty_page(struct inode *inode, size_t index);
+int inode_sync(struct inode *inode);
+size_t inode_shrink(void);
 
 #endif
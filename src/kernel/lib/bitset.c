@@ -15,3 +15,16 @@ limitations under the License.
 */
 
 #include "lib/bitset.h"
+
+/* lowest set bit, or -1 when the set is empty */
+int bitset_find_first(const bitset *set, size_t nslots) {
+  size_t i;
+
+  for (i = 0; i < nslots; ++i) {
+    if (set[i]) {
+      return (i * sizeof(bitset) * 8) + __builtin_ctz(set[i]);
+    }
+  }
+
+  return -1;
+}
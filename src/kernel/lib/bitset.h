@@ -28,4 +28,6 @@ typedef uint32_t bitset;
 #define bitset_remove(p, n) ((p)[bitset_slot(n)] &= ~bitset_mask(n))
 #define bitset_test(p, n) ((p)[bitset_slot(n)] & bitset_mask(n))
 
+int bitset_find_first(const bitset *set, size_t nslots);
+
 #endif
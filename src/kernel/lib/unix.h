@@ -69,6 +69,49 @@ limitations under the License.
 #define TIOCGWINSZ 0x5413
 #define TIOCGPGRP  0x540f
 
+// for clone
+#define CSIGNAL     0x000000ff
+#define CLONE_VM    0x00000100
+#define CLONE_VFORK 0x00004000
+
+// for mmap
+#define PROT_NONE  0x0
+#define PROT_READ  0x1
+#define PROT_WRITE 0x2
+#define PROT_EXEC  0x4
+
+#define MAP_SHARED    0x01
+#define MAP_PRIVATE   0x02
+#define MAP_TYPE      0x0f
+#define MAP_FIXED     0x10
+#define MAP_ANONYMOUS 0x20
+
+#define MREMAP_MAYMOVE 1
+#define MREMAP_FIXED   2
+
+#define MADV_DONTNEED 4
+
+#define MS_ASYNC      1
+#define MS_INVALIDATE 2
+#define MS_SYNC       4
+
+// for getpriority and setpriority
+#define PRIO_PROCESS 0
+#define PRIO_PGRP    1
+#define PRIO_USER    2
+
+// for sched_setscheduler
+#define SCHED_OTHER 0
+#define SCHED_FIFO  1
+#define SCHED_RR    2
+
+// for clock_gettime
+#define CLOCK_REALTIME  0
+#define CLOCK_MONOTONIC 1
+
+// for clock_nanosleep
+#define TIMER_ABSTIME 1
+
 typedef int32_t  pid_t;
 typedef uint64_t dev_t;
 typedef uint32_t mode_t;
@@ -84,12 +127,17 @@ typedef int64_t  blkcnt64_t;
 typedef uint64_t ino_t;
 typedef uint64_t ino64_t;
 typedef int32_t  time_t;
+typedef int32_t  clockid_t;
 
 struct timespec {
   time_t tv_sec;
   long tv_nsec;
 };
 
+struct sched_param {
+  int sched_priority;
+};
+
 struct stat64 {
   dev_t st_dev;
   int __st_dev_padding;
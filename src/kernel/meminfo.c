@@ -0,0 +1,102 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "meminfo.h"
+#include "buddy.h"
+#include "slab.h"
+#include "reclaim.h"
+#include "mmu.h"
+#include "lib/stdarg.h"
+#include "lib/errno.h"
+
+#define MEMINFO_MAX_CACHES 32
+
+struct meminfo_buffer {
+  char *data;
+  size_t size;
+  size_t length;
+};
+
+static void meminfo_printf(struct meminfo_buffer *buf, const char *format, ...) {
+  int n;
+  va_list ap;
+  size_t offset = (buf->length < buf->size) ? buf->length : buf->size;
+
+  va_start(ap, format);
+  n = vsnprintf(buf->data + offset, buf->size - offset, format, ap);
+  va_end(ap);
+
+  if (n > 0) {
+    buf->length += n;
+  }
+}
+
+/*
+ * Text report of the page and slab allocators, one "key value" line per
+ * counter followed by a table per allocator. The mapping counters are the
+ * caller's own, the ones the OOM killer ranks processes by. Works like
+ * snprintf: the full length is returned even when it did not fit.
+ */
+int meminfo_format(char *data, size_t size) {
+  size_t i, n;
+  struct buddy_stat buddy;
+  struct reclaim_stat reclaim;
+  struct mmu_stat mmu;
+  struct meminfo_buffer buf = { .data = data, .size = size, .length = 0 };
+
+  _kmalloc_cleanup_ struct slab_stat *slabs = kmalloc(sizeof(struct slab_stat) * MEMINFO_MAX_CACHES);
+
+  if (!slabs) {
+    return -ENOMEM;
+  }
+
+  buddy_get_stat(&buddy);
+  reclaim_get_stat(&reclaim);
+  n = slab_get_stat(slabs, MEMINFO_MAX_CACHES);
+
+  meminfo_printf(&buf, "free_pages %u\n", buddy.free_pages);
+  meminfo_printf(&buf, "zeroed_pages %u\n", buddy.zeroed_pages);
+  meminfo_printf(&buf, "zero_hits %u\n", buddy.zero_hits);
+  meminfo_printf(&buf, "zero_misses %u\n", buddy.zero_misses);
+  meminfo_printf(&buf, "compactions %u\n", buddy.compactions);
+  meminfo_printf(&buf, "compact_failures %u\n", buddy.compact_failures);
+  meminfo_printf(&buf, "migrated_pages %u\n", buddy.migrated_pages);
+  meminfo_printf(&buf, "reclaimed_pages %u\n", reclaim.cache_pages);
+  meminfo_printf(&buf, "oom_kills %u\n", reclaim.oom_kills);
+
+  /* a vfork child borrows its parent's table and has none to report */
+  if (mmu_get_stat(process_getpid(), &mmu) == 0) {
+    meminfo_printf(&buf, "sections %u\n", mmu.sections);
+    meminfo_printf(&buf, "large_pages %u\n", mmu.large_pages);
+    meminfo_printf(&buf, "small_pages %u\n", mmu.small_pages);
+  }
+
+  meminfo_printf(&buf, "\norder free failures\n");
+  for (i = 0; i < PAGE_MAX_DEPTH; ++i) {
+    meminfo_printf(&buf, "%5u %4u %8u\n", i, buddy.free_blocks[i], buddy.alloc_failures[i]);
+  }
+
+  meminfo_printf(&buf, "\n%16s %6s %5s %6s %6s %8s %8s %5s %5s %5s\n",
+                 "cache", "size", "slab", "active", "max", "allocs", "frees", "slabs", "empty", "pages");
+  for (i = 0; i < n; ++i) {
+    meminfo_printf(&buf, "%16s %6u %5u %6u %6u %8u %8u %5u %5u %5u\n",
+                   slabs[i].name, slabs[i].object_size, slabs[i].objects_per_slab,
+                   slabs[i].active, slabs[i].active_max, slabs[i].allocs, slabs[i].frees,
+                   slabs[i].slabs, slabs[i].empty_slabs, slabs[i].pages);
+  }
+
+  return buf.length;
+}
@@ -18,7 +18,9 @@ limitations under the License.
 #include "process.h"
 #include "buddy.h"
 #include "system.h"
+#include "logger.h"
 #include "slab.h"
+#include "cache.h"
 #include "lib/string.h"
 #include "lib/list.h"
 
@@ -28,20 +30,71 @@ limitations under the License.
 #define L1_SIZE (L1_ENTRY_NUM * 4)
 #define L2_SIZE (L2_ENTRY_NUM * 4)
 
+/* TTBR0 translates [0x00000000 - 0x80000000], TTBR1 the rest */
+#define TTBCR_N 1
+
+#define USER_L1_ENTRY_NUM (L1_ENTRY_NUM >> TTBCR_N)
+#define USER_L1_SIZE (USER_L1_ENTRY_NUM * 4)
+
+#define TTBR0_MASK (~((uint32_t)USER_L1_SIZE - 1))
+#define TTBR1_MASK (~((uint32_t)L1_SIZE - 1))
+
 #define GET_L1_INDEX(addr) ((addr) >> 20)
 #define GET_L2_INDEX(addr) (((addr) & 0xff000) >> 12)
 
 #define GET_PAGE_SIZE(size) (((size) + PAGE_SIZE - 1) >> 12)
 
-#define FL_PAGE_TABLE       0x1
+#define SECTION_SIZE    0x100000
+#define LARGE_PAGE_SIZE 0x10000
 
+#define LARGE_PAGE_ENTRY_NUM (LARGE_PAGE_SIZE / PAGE_SIZE)
+
+/* buddy orders backing a section and a large page */
+#define SECTION_ORDER    8
+#define LARGE_PAGE_ORDER 4
+
+#define IS_ALIGNED(addr, size) (!((addr) & ((size) - 1)))
+
+#define FL_TYPE(desc)       ((desc) & 0x3)
+#define FL_PAGE_TABLE       0x1
+#define FL_SECTION          0x2
+#define FL_AP(ap)           ((ap) << 10)
+#define FL_TEX(tex)         ((tex) << 12)
+#define FL_APX              0x8000
+#define FL_S                0x10000
+#define FL_NG               0x20000
+
+#define SL_TYPE(desc)       ((desc) & 0x3)
+#define SL_LARGE_PAGE       0x1
 #define SL_SHORT_DESCRIPTOR 0x2
 #define SL_B                0x4
 #define SL_C                0x8
+#define SL_AP(ap)           ((ap) << 4)
+#define SL_TEX(tex)         ((tex) << 6)
+#define SL_LARGE_TEX(tex)   ((tex) << 12)
+#define SL_APX              0x200
 #define SL_S                0x400
+#define SL_NG               0x800
 
-#define AP_PRIVILEGED_ACCESS 0x10
-#define AP_FULL_ACCESS       0x30
+#define L2_TABLE_BASE(desc)   ((uint32_t*)((desc) & 0xfffffc00))
+#define SECTION_BASE(desc)    ((desc) & 0xfff00000)
+#define LARGE_PAGE_BASE(desc) ((desc) & 0xffff0000)
+#define SMALL_PAGE_BASE(desc) ((desc) & 0xfffff000)
+
+#define IS_SMALL_PAGE(desc) ((desc) & SL_SHORT_DESCRIPTOR)
+#define IS_LARGE_PAGE(desc) (SL_TYPE(desc) == SL_LARGE_PAGE)
+
+/* memory types encoded as TEX[2:0]:C:B (SCTLR.TRE = 0) */
+#define MT_STRONGLY_ORDERED 0x00
+#define MT_DEVICE           0x01
+#define MT_NORMAL           0x07
+
+#define MT_TEX(mt) ((mt) >> 2)
+#define MT_CB(mt)  (((mt) & 0x3) << 2)
+
+/* AP[1:0] */
+#define AP_PRIVILEGED_ACCESS 0x1
+#define AP_FULL_ACCESS       0x3
 
 #define DA_NO_ACCESS 0x0
 #define DA_CLIENT    0x1
@@ -49,152 +102,685 @@ limitations under the License.
 
 #define VIRT_VECTORS_ADDR 0xffff0000
 
+#define KERNEL_PID 0
+#define KERNEL_START 0x60000000
+
+#define MAPPING_HASH_SIZE 64
+#define MAPPING_HASH(pid) ((uint32_t)(pid) % MAPPING_HASH_SIZE)
+
+/* CONTEXTIDR: PROCID[31:8], ASID[7:0] */
+#define ASID_BITS  8
+#define ASID_MASK  ((1 << ASID_BITS) - 1)
+#define ASID_FIRST_GENERATION (1 << ASID_BITS)
+#define ASID_RESERVED 0
+
+#define CONTEXTIDR(pid, context) (((uint32_t)(pid) << ASID_BITS) | ((context) & ASID_MASK))
+
 extern char vectors_start;
 extern char vectors_end;
 
 struct mapping {
   struct list next;
   pid_t pid;
-  struct page *page_head;
+  uint32_t context;
   uint32_t *address;
+  struct mmu_stat stat;
 };
 
-static struct list mappings;
+static struct list mappings[MAPPING_HASH_SIZE];
 static struct slab_cache *mapping_cache;
+static struct mapping *current_mapping;
 
-static void add_page(struct mapping *mapping, struct page *page) {
-  page->next = mapping->page_head;
-  mapping->page_head = page;
+/* global kernel view, installed in TTBR1 and shared by every mapping */
+static struct mapping kernel_mapping;
+
+/* upper bits: generation, lower ASID_BITS: ASID */
+static uint32_t asid_generation;
+static uint32_t next_asid;
+
+/* backs untouched demand-zero pages read-only, never released */
+static struct page *zero_page;
+
+/* user pages are reference counted on the head of their buddy block */
+static struct page *mmu_page_head(uint32_t paddr) {
+  return page_find_head(page_find_by_address((void*)paddr));
+}
+
+/*
+ * A section or large page block that some mapping has split is counted page
+ * by page, so the other mappings still holding the block take or drop a
+ * reference on every piece.
+ */
+static bool mmu_block_is_exclusive(uint32_t paddr, unsigned int order) {
+  struct page *page = page_find_by_address((void*)paddr);
+  return page->order == order && page->count == 1;
+}
+
+static void mmu_get_block(uint32_t paddr, unsigned int order) {
+  struct page *page = page_find_by_address((void*)paddr);
+  uint32_t i;
+
+  if (page->order == order) {
+    page_get(page);
+    return;
+  }
+
+  for (i = 0; i < (1U << order); ++i) {
+    page_get(&page[i]);
+  }
+}
+
+static void mmu_put_block(uint32_t paddr, unsigned int order) {
+  struct page *page = page_find_by_address((void*)paddr);
+  uint32_t i;
+
+  if (page->order == order) {
+    page_put(page);
+    return;
+  }
+
+  for (i = 0; i < (1U << order); ++i) {
+    page_put(&page[i]);
+  }
+}
+
+/* the first split of a block hands every piece its own reference count */
+static void mmu_split_block(uint32_t paddr, unsigned int order) {
+  struct page *page = page_find_by_address((void*)paddr);
+
+  if (page->order == order) {
+    buddy_split(page);
+  }
+}
+
+static void release_pl2(uint32_t *pl2) {
+  uint32_t i;
+
+  for (i = 0; i < L2_ENTRY_NUM; ++i) {
+    if (IS_LARGE_PAGE(pl2[i])) {
+      if (IS_ALIGNED(i, LARGE_PAGE_ENTRY_NUM)) {
+        mmu_put_block(LARGE_PAGE_BASE(pl2[i]), LARGE_PAGE_ORDER);
+      }
+    } else if (IS_SMALL_PAGE(pl2[i])) {
+      page_put(mmu_page_head(SMALL_PAGE_BASE(pl2[i])));
+    }
+  }
+
+  buddy_free(page_find_by_address(pl2));
 }
 
 static void release_pages(struct mapping *mapping) {
-  struct page *page = mapping->page_head, *next;
+  uint32_t i, *pl1 = mapping->address;
 
-  while (page) {
-    next = page->next;
-    page->next = NULL;
-    buddy_free(page);
-    page = next;
+  for (i = 0; i < USER_L1_ENTRY_NUM; ++i) {
+    if (kernel_mapping.address[i]) {
+      continue;
+    }
+
+    switch (FL_TYPE(pl1[i])) {
+      case FL_SECTION:
+        mmu_put_block(SECTION_BASE(pl1[i]), SECTION_ORDER);
+        break;
+      case FL_PAGE_TABLE:
+        release_pl2(L2_TABLE_BASE(pl1[i]));
+        break;
+    }
   }
+
+  buddy_free(page_find_by_address(pl1));
 }
 
-static uint32_t *mmu_create_pl1(struct mapping *mapping) {
-  struct page *page = buddy_alloc(L1_SIZE);
-  add_page(mapping, page);
-  return memset(page_address(page), 0, L1_SIZE);
+static uint32_t *mmu_create_pl1(void) {
+  struct page *page = buddy_alloc(USER_L1_SIZE);
+  uint32_t *pl1;
+
+  if (!page) {
+    return NULL;
+  }
+
+  /* kernel entries below the TTBR1 boundary point at the shared L2 tables */
+  pl1 = memcpy(page_address(page), kernel_mapping.address, USER_L1_SIZE);
+
+  cache_clean_dcache(pl1, USER_L1_SIZE);
+  return pl1;
 }
 
-static uint32_t *mmu_create_pl2(struct mapping *mapping) {
-  struct page *page = buddy_alloc(L2_SIZE);
-  add_page(mapping, page);
-  return memset(page_address(page), 0, L2_SIZE);
+static uint32_t *mmu_create_pl2(void) {
+  struct page *page = buddy_alloc_zeroed(L2_SIZE);
+  uint32_t *pl2;
+
+  if (!page) {
+    return NULL;
+  }
+  pl2 = page_address(page);
+
+  cache_clean_dcache(pl2, L2_SIZE);
+  return pl2;
 }
 
-static uint32_t *mmu_create_page(struct mapping *mapping) {
+static uint32_t *mmu_create_page(void) {
   struct page *page = buddy_alloc(PAGE_SIZE);
-  add_page(mapping, page);
-  return page_address(page);
+  return page ? page_address(page) : NULL;
+}
+
+static uint32_t section_descriptor(uint32_t paddr, uint32_t type, bool is_privileged) {
+  return (paddr & 0xfff00000) | FL_SECTION | FL_TEX(MT_TEX(type)) | MT_CB(type) |
+    (is_privileged ? FL_AP(AP_PRIVILEGED_ACCESS) : (FL_NG | FL_AP(AP_FULL_ACCESS)));
+}
+
+static uint32_t large_page_descriptor(uint32_t paddr, uint32_t type, bool is_privileged) {
+  return (paddr & 0xffff0000) | SL_LARGE_PAGE | SL_LARGE_TEX(MT_TEX(type)) | MT_CB(type) |
+    (is_privileged ? SL_AP(AP_PRIVILEGED_ACCESS) : (SL_NG | SL_AP(AP_FULL_ACCESS)));
+}
+
+static uint32_t small_page_descriptor(uint32_t paddr, uint32_t type, bool is_privileged) {
+  return (paddr & 0xfffff000) | SL_SHORT_DESCRIPTOR | SL_TEX(MT_TEX(type)) | MT_CB(type) |
+    (is_privileged ? SL_AP(AP_PRIVILEGED_ACCESS) : (SL_NG | SL_AP(AP_FULL_ACCESS)));
 }
 
 static uint32_t *mmu_create_and_fill_pl2(struct mapping *mapping, uint32_t l1_i) {
   uint32_t *pl1 = mapping->address, *pl2;
 
-  if (!(pl1[l1_i] & FL_PAGE_TABLE)) {
-    pl2 = mmu_create_pl2(mapping);
+  if (FL_TYPE(pl1[l1_i]) == FL_SECTION) {
+    return NULL;
+  }
+
+  if (FL_TYPE(pl1[l1_i]) != FL_PAGE_TABLE) {
+    if (!(pl2 = mmu_create_pl2())) {
+      return NULL;
+    }
     pl1[l1_i] = (0xfffffc00 & (uint32_t)pl2) | FL_PAGE_TABLE;
+    cache_clean_dcache(&pl1[l1_i], sizeof(uint32_t));
   }
 
   return (uint32_t*)(0xfffffc00 & pl1[l1_i]);
 }
 
-static int mmu_create_mapping(struct mapping *mapping, uint32_t addr, size_t size, bool is_privileged) {
-  uint32_t i, *page, *pl2;
-  uint32_t l1_i = GET_L1_INDEX(addr), l2_i = GET_L2_INDEX(addr);
+static bool mmu_can_map_section(const struct mapping *mapping, uint32_t addr, uint32_t end) {
+  return IS_ALIGNED(addr, SECTION_SIZE) && (end - addr) >= SECTION_SIZE &&
+    !mapping->address[GET_L1_INDEX(addr)];
+}
 
-  if (L2_ENTRY_NUM < (l2_i + GET_PAGE_SIZE(size))) {
-    return -1;
+static bool mmu_can_map_large_page(const uint32_t *pl2, uint32_t addr, uint32_t end) {
+  uint32_t i, l2_i = GET_L2_INDEX(addr);
+
+  if (!IS_ALIGNED(addr, LARGE_PAGE_SIZE) || (end - addr) < LARGE_PAGE_SIZE) {
+    return false;
   }
 
-  pl2 = mmu_create_and_fill_pl2(mapping, l1_i);
-  for (i = l2_i; i < (l2_i + GET_PAGE_SIZE(size)); ++i) {
-    page = mmu_create_page(mapping);
-    pl2[i] = (uint32_t)page | SL_SHORT_DESCRIPTOR | (is_privileged ? AP_PRIVILEGED_ACCESS : AP_FULL_ACCESS);
+  for (i = 0; i < LARGE_PAGE_ENTRY_NUM; ++i) {
+    if (pl2[l2_i + i]) {
+      return false;
+    }
   }
 
-  return 0;
+  return true;
 }
 
-static int mmu_create_straight_mapping(struct mapping *mapping, uint32_t addr, size_t size) {
-  uint32_t i, new_addr, *pl2;
-  uint32_t l1_i = GET_L1_INDEX(addr), l2_i = GET_L2_INDEX(addr);
+static void mmu_set_section(struct mapping *mapping, uint32_t addr, uint32_t desc) {
+  uint32_t *pl1 = mapping->address;
+  uint32_t l1_i = GET_L1_INDEX(addr);
 
-  if (L2_ENTRY_NUM < (l2_i + GET_PAGE_SIZE(size))) {
-    return -1;
+  pl1[l1_i] = desc;
+  cache_clean_dcache(&pl1[l1_i], sizeof(uint32_t));
+
+  mapping->stat.sections++;
+}
+
+static void mmu_set_large_page(struct mapping *mapping, uint32_t *pl2, uint32_t addr, uint32_t desc) {
+  uint32_t i, l2_i = GET_L2_INDEX(addr);
+
+  /* a large page descriptor is repeated in 16 consecutive entries */
+  for (i = 0; i < LARGE_PAGE_ENTRY_NUM; ++i) {
+    pl2[l2_i + i] = desc;
+  }
+  cache_clean_dcache(&pl2[l2_i], LARGE_PAGE_ENTRY_NUM * sizeof(uint32_t));
+
+  mapping->stat.large_pages++;
+}
+
+static void mmu_set_small_page(struct mapping *mapping, uint32_t *pl2, uint32_t addr, uint32_t desc) {
+  uint32_t l2_i = GET_L2_INDEX(addr);
+
+  pl2[l2_i] = desc;
+  cache_clean_dcache(&pl2[l2_i], sizeof(uint32_t));
+
+  mapping->stat.small_pages++;
+}
+
+static uint32_t section_to_small_page(uint32_t desc, uint32_t paddr) {
+  return paddr | SL_SHORT_DESCRIPTOR | (desc & (SL_C | SL_B)) |
+    SL_TEX((desc >> 12) & 0x7) | SL_AP((desc >> 10) & 0x3) |
+    ((desc & FL_APX) ? SL_APX : 0) | ((desc & FL_S) ? SL_S : 0) | ((desc & FL_NG) ? SL_NG : 0);
+}
+
+static uint32_t large_to_small_page(uint32_t desc, uint32_t paddr) {
+  return paddr | SL_SHORT_DESCRIPTOR | (desc & (SL_C | SL_B | SL_AP(0x3) | SL_APX | SL_S | SL_NG)) |
+    SL_TEX((desc >> 12) & 0x7);
+}
+
+/*
+ * Splitting turns the block into single pages with their own reference
+ * counts, so a piece only this mapping holds is written in place and every
+ * piece returns to the allocator as soon as it is released.
+ */
+static bool mmu_split_section(struct mapping *mapping, uint32_t l1_i) {
+  uint32_t i, desc = mapping->address[l1_i], *pl2 = mmu_create_pl2();
+
+  if (!pl2) {
+    return false;
   }
 
-  pl2 = mmu_create_and_fill_pl2(mapping, l1_i);
-  for (i = 0; i < GET_PAGE_SIZE(size); ++i) {
-    new_addr = (addr & 0xfffff000) + (PAGE_SIZE * i);
-    pl2[l2_i + i] = new_addr | SL_SHORT_DESCRIPTOR | AP_PRIVILEGED_ACCESS;
+  for (i = 0; i < L2_ENTRY_NUM; ++i) {
+    pl2[i] = section_to_small_page(desc, SECTION_BASE(desc) + (i * PAGE_SIZE));
+  }
+  cache_clean_dcache(pl2, L2_SIZE);
+
+  mmu_split_block(SECTION_BASE(desc), SECTION_ORDER);
+
+  mapping->address[l1_i] = (uint32_t)pl2 | FL_PAGE_TABLE;
+  cache_clean_dcache(&mapping->address[l1_i], sizeof(uint32_t));
+
+  mapping->stat.sections--;
+  mapping->stat.small_pages += L2_ENTRY_NUM;
+  return true;
+}
+
+static void mmu_unshare_large_page(uint32_t *pl2, uint32_t l2_i) {
+  uint32_t i;
+
+  l2_i &= ~(LARGE_PAGE_ENTRY_NUM - 1);
+
+  for (i = 0; i < LARGE_PAGE_ENTRY_NUM; ++i) {
+    pl2[l2_i + i] &= ~SL_APX;
+  }
+  cache_clean_dcache(&pl2[l2_i], LARGE_PAGE_ENTRY_NUM * sizeof(uint32_t));
+}
+
+static void mmu_split_large_page(struct mapping *mapping, uint32_t *pl2, uint32_t l2_i) {
+  uint32_t i, desc = pl2[l2_i];
+
+  l2_i &= ~(LARGE_PAGE_ENTRY_NUM - 1);
+
+  for (i = 0; i < LARGE_PAGE_ENTRY_NUM; ++i) {
+    pl2[l2_i + i] = large_to_small_page(desc, LARGE_PAGE_BASE(desc) + (i * PAGE_SIZE));
+  }
+  cache_clean_dcache(&pl2[l2_i], LARGE_PAGE_ENTRY_NUM * sizeof(uint32_t));
+
+  mmu_split_block(LARGE_PAGE_BASE(desc), LARGE_PAGE_ORDER);
+
+  mapping->stat.large_pages--;
+  mapping->stat.small_pages += LARGE_PAGE_ENTRY_NUM;
+}
+
+static uint32_t *mmu_share_pl2(uint32_t *ppl2) {
+  uint32_t i, *pl2 = mmu_create_pl2();
+
+  if (!pl2) {
+    return NULL;
+  }
+
+  for (i = 0; i < L2_ENTRY_NUM; ++i) {
+    if (IS_LARGE_PAGE(ppl2[i])) {
+      if (IS_ALIGNED(i, LARGE_PAGE_ENTRY_NUM)) {
+        mmu_get_block(LARGE_PAGE_BASE(ppl2[i]), LARGE_PAGE_ORDER);
+      }
+      ppl2[i] |= SL_APX;
+    } else if (IS_SMALL_PAGE(ppl2[i])) {
+      page_get(mmu_page_head(SMALL_PAGE_BASE(ppl2[i])));
+      ppl2[i] |= SL_APX;
+    }
+
+    pl2[i] = ppl2[i];
+  }
+
+  cache_clean_dcache(ppl2, L2_SIZE);
+  cache_clean_dcache(pl2, L2_SIZE);
+
+  return pl2;
+}
+
+/* both address spaces keep the same frames read-only until one writes */
+static int mmu_share_pages(struct mapping *mapping, struct mapping *parent) {
+  uint32_t i, *pl1 = mapping->address, *ppl1 = parent->address, *pl2;
+  int r = 0;
+
+  for (i = 0; i < USER_L1_ENTRY_NUM; ++i) {
+    if (kernel_mapping.address[i]) {
+      continue;
+    }
+
+    switch (FL_TYPE(ppl1[i])) {
+      case FL_SECTION:
+        mmu_get_block(SECTION_BASE(ppl1[i]), SECTION_ORDER);
+        ppl1[i] |= FL_APX;
+        pl1[i] = ppl1[i];
+        break;
+      case FL_PAGE_TABLE:
+        /* what was shared so far stays consistent, the caller drops the copy */
+        if (!(pl2 = mmu_share_pl2(L2_TABLE_BASE(ppl1[i])))) {
+          r = -1;
+          goto out;
+        }
+        pl1[i] = (uint32_t)pl2 | FL_PAGE_TABLE;
+        break;
+    }
+  }
+
+out:
+  cache_clean_dcache(ppl1, USER_L1_SIZE);
+  cache_clean_dcache(pl1, USER_L1_SIZE);
+  return r;
+}
+
+static int mmu_create_mapping(struct mapping *mapping, uint32_t addr, size_t size, bool is_privileged) {
+  uint32_t l1_i, next, end, *pl2, *pl;
+  struct page *page;
+
+  addr = addr & ~(PAGE_SIZE - 1);
+  end  = addr + (GET_PAGE_SIZE(size) * PAGE_SIZE);
+
+  while (addr < end) {
+    l1_i = GET_L1_INDEX(addr);
+
+    if (l1_i >= USER_L1_ENTRY_NUM || kernel_mapping.address[l1_i]) {
+      return -1;
+    }
+
+    if (mmu_can_map_section(mapping, addr, end) && (page = buddy_try_alloc(SECTION_SIZE))) {
+      mmu_set_section(mapping, addr, section_descriptor((uint32_t)page_address(page), MT_NORMAL, is_privileged));
+
+      addr += SECTION_SIZE;
+      continue;
+    }
+
+    if (!(pl2 = mmu_create_and_fill_pl2(mapping, l1_i))) {
+      return -1;
+    }
+
+    next = (addr & ~(SECTION_SIZE - 1)) + SECTION_SIZE;
+    next = next < end ? next : end;
+
+    while (addr < next) {
+      if (mmu_can_map_large_page(pl2, addr, next) && (page = buddy_try_alloc(LARGE_PAGE_SIZE))) {
+          mmu_set_large_page(mapping, pl2, addr, large_page_descriptor((uint32_t)page_address(page), MT_NORMAL, is_privileged));
+
+        addr += LARGE_PAGE_SIZE;
+        continue;
+      }
+
+      if (!pl2[GET_L2_INDEX(addr)]) {
+        if (!(pl = mmu_create_page())) {
+          return -1;
+        }
+        mmu_set_small_page(mapping, pl2, addr, small_page_descriptor((uint32_t)pl, MT_NORMAL, is_privileged));
+      }
+
+      addr += PAGE_SIZE;
+    }
+  }
+
+  return 0;
+}
+
+static int mmu_create_straight_mapping(struct mapping *mapping, uint32_t addr, size_t size, uint32_t type) {
+  uint32_t end, *pl2;
+
+  addr = addr & ~(PAGE_SIZE - 1);
+  end  = addr + (GET_PAGE_SIZE(size) * PAGE_SIZE);
+
+  while (addr < end) {
+    if (mmu_can_map_section(mapping, addr, end)) {
+      mmu_set_section(mapping, addr, section_descriptor(addr, type, true));
+      addr += SECTION_SIZE;
+      continue;
+    }
+
+    if (!(pl2 = mmu_create_and_fill_pl2(mapping, GET_L1_INDEX(addr)))) {
+      return -1;
+    }
+
+    if (mmu_can_map_large_page(pl2, addr, end)) {
+      mmu_set_large_page(mapping, pl2, addr, large_page_descriptor(addr, type, true));
+      addr += LARGE_PAGE_SIZE;
+      continue;
+    }
+
+    mmu_set_small_page(mapping, pl2, addr, small_page_descriptor(addr, type, true));
+    addr += PAGE_SIZE;
   }
 
   return 0;
 }
 
 static void mmu_create_vectors_mapping(struct mapping *mapping) {
-  uint32_t l1_i = GET_L1_INDEX(VIRT_VECTORS_ADDR);
-  uint32_t l2_i = GET_L2_INDEX(VIRT_VECTORS_ADDR);
+  uint32_t *pl2 = mmu_create_and_fill_pl2(mapping, GET_L1_INDEX(VIRT_VECTORS_ADDR));
+  uint32_t *page = mmu_create_page();
 
-  uint32_t *pl2 = mmu_create_and_fill_pl2(mapping, l1_i);
-  uint32_t *page = mmu_create_page(mapping);
+  if (!pl2 || !page) {
+    logger_fatal("out of memory for the vectors");
+    system_halt();
+  }
 
   memcpy(page, &vectors_start, (&vectors_end - &vectors_start));
-  pl2[l2_i] = (uint32_t)page | SL_SHORT_DESCRIPTOR | AP_PRIVILEGED_ACCESS;
+  cache_sync_icache(page, (&vectors_end - &vectors_start));
+
+  mmu_set_small_page(mapping, pl2, VIRT_VECTORS_ADDR, small_page_descriptor((uint32_t)page, MT_NORMAL, true));
 }
 
 static int mmu_create_kernel_mappings(struct mapping *mapping) {
-  int i;
-
   /* Exception Vectors */
   mmu_create_vectors_mapping(mapping);
 
-  /* Kernel [0x60000000 - 0x69000000] */
-  for (i = 0; i < 0x90; ++i) {
-    mmu_create_straight_mapping(mapping, 0x60000000 + (0x100000 * i), 0x100000);
-  }
+  /* Kernel and page pool [0x60000000 - end of the pool] */
+  mmu_create_straight_mapping(mapping, KERNEL_START, (uint32_t)page_end() - KERNEL_START, MT_NORMAL);
 
   /* Motherboard peripherals [0x10000000 - 0x10020000] */
-  mmu_create_straight_mapping(mapping, 0x10000000, 0x20000);
+  mmu_create_straight_mapping(mapping, 0x10000000, 0x20000, MT_DEVICE);
 
   /* SCU [0x1e000000 - 0x1e002000] */
-  mmu_create_straight_mapping(mapping, 0x1e000000, 0x2000);
+  mmu_create_straight_mapping(mapping, 0x1e000000, 0x2000, MT_DEVICE);
 
   return 0;
 }
 
-static struct mapping *mmu_mapping_fetch(pid_t pid) {
+static void mmu_create_kernel_table(void) {
+  struct page *page = buddy_alloc(L1_SIZE);
+
+  if (!page) {
+    logger_fatal("out of memory for the kernel table");
+    system_halt();
+  }
+
+  memset(&kernel_mapping, 0, sizeof(struct mapping));
+  kernel_mapping.pid = KERNEL_PID;
+  kernel_mapping.context = ASID_RESERVED;
+  kernel_mapping.address = memset(page_address(page), 0, L1_SIZE);
+
+  mmu_create_kernel_mappings(&kernel_mapping);
+
+  cache_clean_dcache(kernel_mapping.address, L1_SIZE);
+}
+
+static struct mapping *mmu_mapping_find(pid_t pid) {
   struct mapping *mapping;
 
-  list_foreach(mapping, &mappings, next) {
+  if (pid == KERNEL_PID) {
+    return &kernel_mapping;
+  }
+
+  list_foreach(mapping, &mappings[MAPPING_HASH(pid)], next) {
     if (mapping->pid == pid) {
       return mapping;
     }
   }
 
-  mapping = memset(slab_cache_alloc(mapping_cache), 0, sizeof(struct mapping));
+  return NULL;
+}
+
+static struct mapping *mmu_mapping_fetch(pid_t pid) {
+  struct mapping *mapping = mmu_mapping_find(pid);
+
+  if (mapping) {
+    return mapping;
+  }
+
+  if (!(mapping = slab_cache_alloc(mapping_cache))) {
+    return NULL;
+  }
+  memset(mapping, 0, sizeof(struct mapping));
   mapping->pid = pid;
 
-  mapping->address = mmu_create_pl1(mapping);
-  mmu_create_kernel_mappings(mapping);
+  if (!(mapping->address = mmu_create_pl1())) {
+    slab_cache_free(mapping_cache, mapping);
+    return NULL;
+  }
 
-  list_add(&mappings, &mapping->next);
+  list_add(&mappings[MAPPING_HASH(pid)], &mapping->next);
   return mapping;
 }
 
+static void mmu_flush_tlb(void) {
+  /* TLBIALL, BPIALL */
+  __asm__ volatile (
+    "MCR   p15, 0, %[zero], c8, c7, 0 \n\t"
+    "MCR   p15, 0, %[zero], c7, c5, 6 \n\t"
+    "DSB                              \n\t"
+    "ISB                              \n\t"
+    :
+    : [zero] "r"(0)
+    : "memory"
+  );
+}
+
+static void mmu_flush_tlb_asid(uint32_t asid) {
+  /* TLBIASID, BPIALL */
+  __asm__ volatile (
+    "MCR   p15, 0, %[asid], c8, c7, 2 \n\t"
+    "MCR   p15, 0, %[zero], c7, c5, 6 \n\t"
+    "DSB                              \n\t"
+    "ISB                              \n\t"
+    :
+    : [asid] "r"(asid), [zero] "r"(0)
+    : "memory"
+  );
+}
+
+static void mmu_flush_tlb_page(const struct mapping *mapping, uint32_t addr) {
+  if ((mapping->context & ~ASID_MASK) != asid_generation) {
+    return;
+  }
+
+  /* TLBIMVA */
+  __asm__ volatile (
+    "MCR   p15, 0, %[mva], c8, c7, 1 \n\t"
+    "DSB                             \n\t"
+    "ISB                             \n\t"
+    :
+    : [mva] "r"((addr & 0xfffff000) | (mapping->context & ASID_MASK))
+    : "memory"
+  );
+}
+
+static void mmu_flush_tlb_mapping(const struct mapping *mapping) {
+  if ((mapping->context & ~ASID_MASK) == asid_generation) {
+    mmu_flush_tlb_asid(mapping->context & ASID_MASK);
+  }
+}
+
+static bool mmu_assign_asid(struct mapping *mapping) {
+  if ((mapping->context & ~ASID_MASK) == asid_generation) {
+    return false;
+  }
+
+  if (next_asid > ASID_MASK) {
+    asid_generation += ASID_FIRST_GENERATION;
+    if (!asid_generation) {
+      asid_generation = ASID_FIRST_GENERATION;
+    }
+
+    next_asid = ASID_RESERVED + 1;
+    mapping->context = asid_generation | next_asid++;
+
+    return true;
+  }
+
+  mapping->context = asid_generation | next_asid++;
+  return false;
+}
+
+static void mmu_set_ttbr0(const struct mapping *mapping) {
+  /* TTBR0 */
+  __asm__ volatile (
+    "MCR   p15, 0, %[ttb], c2, c0, 0 \n\t"
+    "ISB                             \n\t"
+    :
+    : [ttb] "r"((uint32_t)mapping->address & TTBR0_MASK)
+  );
+}
+
+static void mmu_switch_mapping(struct mapping *mapping) {
+  /* the kernel mapping has no non-global entries and runs on the reserved ASID */
+  bool rollover = (mapping != &kernel_mapping) && mmu_assign_asid(mapping);
+
+  /*
+   * Walk the kernel table while the ASID changes. It only holds global
+   * entries, so a speculative walk in between caches nothing under either
+   * ASID, and user tables are never walked under any ASID but their own.
+   */
+  mmu_set_ttbr0(&kernel_mapping);
+
+  if (rollover) {
+    mmu_flush_tlb();
+  }
+
+  /* CONTEXTIDR */
+  __asm__ volatile (
+    "MCR   p15, 0, %[context], c13, c0, 1 \n\t"
+    "ISB                                  \n\t"
+    :
+    : [context] "r"(CONTEXTIDR(mapping->pid, mapping->context))
+  );
+
+  mmu_set_ttbr0(mapping);
+
+  current_mapping = mapping;
+}
+
 void mmu_init(void) {
-  list_init(&mappings);
+  int i;
+
+  for (i = 0; i < MAPPING_HASH_SIZE; ++i) {
+    list_init(&mappings[i]);
+  }
   mapping_cache = slab_cache_create("mapping", sizeof(struct mapping));
 
+  current_mapping = NULL;
+  asid_generation = ASID_FIRST_GENERATION;
+  next_asid = ASID_RESERVED + 1;
+
+  mmu_create_kernel_table();
+
+  if (!(zero_page = buddy_alloc(PAGE_SIZE))) {
+    logger_fatal("out of memory for the zero page");
+    system_halt();
+  }
+  memset(page_address(zero_page), 0, PAGE_SIZE);
+
+  /* TTBCR */
+  __asm__ (
+    "MCR   p15, 0, %[ttbcr], c2, c0, 2 \n\t"
+    :
+    : [ttbcr] "r"(TTBCR_N)
+  );
+
+  /* TTBR1 */
+  __asm__ (
+    "MCR   p15, 0, %[ttb], c2, c0, 1 \n\t"
+    :
+    : [ttb] "r"((uint32_t)kernel_mapping.address & TTBR1_MASK)
+  );
+
   /* DACR */
   __asm__ (
     "MCR   p15, 0, %[domain], c3, c0, 0 \n\t"
@@ -202,23 +788,22 @@ void mmu_init(void) {
     : [domain] "r"(DA_CLIENT)
   );
 
-  mmu_set_ttb(0);
+  mmu_switch_mapping(&kernel_mapping);
+  mmu_flush_tlb();
 }
 
 int mmu_destroy(pid_t pid) {
-  struct mapping *mapping = NULL;
+  struct mapping *mapping = mmu_mapping_find(pid);
 
-  list_foreach(mapping, &mappings, next) {
-    if (mapping->pid == pid) {
-      break;
-    }
+  if (!mapping || mapping == &kernel_mapping) {
+    return -1;
   }
 
-  if (!mapping) {
-    return -1;
+  if (mapping == current_mapping) {
+    mmu_set_ttb(KERNEL_PID);
   }
 
-  mmu_set_ttb(0);
+  mmu_flush_tlb_mapping(mapping);
 
   list_remove(&mapping->next);
   release_pages(mapping);
@@ -227,31 +812,624 @@ int mmu_destroy(pid_t pid) {
   return 0;
 }
 
+/*
+ * Returns the pid of the previous table, or -1 with the previous table
+ * still installed when the new one can not be set up.
+ */
 pid_t mmu_set_ttb(pid_t pid) {
-  static pid_t current_pid = 0;
+  pid_t old_pid = current_mapping->pid;
+  struct mapping *mapping;
 
-  pid_t old_pid;
-  struct mapping *mapping = mmu_mapping_fetch(pid);
-  uint32_t addr = (uint32_t)mapping->address;
+  if (pid != old_pid) {
+    if (!(mapping = mmu_mapping_fetch(pid))) {
+      logger_warn("no translation table for pid=%d", pid);
+      return -1;
+    }
+    mmu_switch_mapping(mapping);
+  }
 
-  mmu_disable();
+  return old_pid;
+}
 
-  /* TTBR0 */
-  __asm__ (
-    "MCR   p15, 0, %[ttb], c2, c0, 0 \n\t"
-    :
-    : [ttb] "r"(addr & 0xffffc000)
-  );
+/*
+ * Returns the start of the highest section in [addr, addr + size) that the
+ * kernel shares with every process, or 0 when user mappings may use it all.
+ */
+uint32_t mmu_find_kernel_section(uint32_t addr, size_t size) {
+  uint32_t i, first = GET_L1_INDEX(addr);
+
+  if (!size) {
+    return 0;
+  }
+
+  for (i = GET_L1_INDEX(addr + size - 1) + 1; i-- > first;) {
+    if (kernel_mapping.address[i]) {
+      return i << 20;
+    }
+  }
+
+  return 0;
+}
 
-  mmu_enable();
+int mmu_get_stat(pid_t pid, struct mmu_stat *stat) {
+  struct mapping *mapping = mmu_mapping_find(pid);
 
-  old_pid = current_pid;
-  current_pid = pid;
+  if (!mapping) {
+    return -1;
+  }
 
-  return old_pid;
+  memcpy(stat, &mapping->stat, sizeof(struct mmu_stat));
+  return 0;
 }
 
 int mmu_alloc(pid_t pid, uint32_t addr, size_t size) {
   struct mapping *mapping = mmu_mapping_fetch(pid);
+
+  if (!mapping) {
+    return -1;
+  }
   return mmu_create_mapping(mapping, addr, size, false);
 }
+
+int mmu_fork(pid_t pid, pid_t parent_pid) {
+  struct mapping *parent = mmu_mapping_find(parent_pid), *mapping;
+  int r;
+
+  if (!parent || parent == &kernel_mapping || pid == parent_pid) {
+    return -1;
+  }
+
+  if (!(mapping = mmu_mapping_fetch(pid))) {
+    return -1;
+  }
+  r = mmu_share_pages(mapping, parent);
+
+  memcpy(&mapping->stat, &parent->stat, sizeof(struct mmu_stat));
+
+  /* the parent may still hold writable translations */
+  mmu_flush_tlb_mapping(parent);
+  return r;
+}
+
+bool mmu_copy_on_write(pid_t pid, uint32_t addr) {
+  struct mapping *mapping = mmu_mapping_find(pid);
+  uint32_t l1_i = GET_L1_INDEX(addr), l2_i = GET_L2_INDEX(addr), desc, *pl2;
+  struct page *head, *page;
+
+  if (!mapping || mapping == &kernel_mapping || l1_i >= USER_L1_ENTRY_NUM || kernel_mapping.address[l1_i]) {
+    return false;
+  }
+
+  desc = mapping->address[l1_i];
+
+  if (FL_TYPE(desc) == FL_SECTION) {
+    if (!(desc & FL_APX)) {
+      return false;
+    }
+
+    if (mmu_block_is_exclusive(SECTION_BASE(desc), SECTION_ORDER)) {
+      mapping->address[l1_i] = desc & ~FL_APX;
+      cache_clean_dcache(&mapping->address[l1_i], sizeof(uint32_t));
+      mmu_flush_tlb_mapping(mapping);
+      return true;
+    }
+
+    if (!mmu_split_section(mapping, l1_i)) {
+      return false;
+    }
+    mmu_flush_tlb_mapping(mapping);
+  }
+
+  if (FL_TYPE(mapping->address[l1_i]) != FL_PAGE_TABLE) {
+    return false;
+  }
+
+  pl2 = L2_TABLE_BASE(mapping->address[l1_i]);
+  desc = pl2[l2_i];
+
+  if (IS_LARGE_PAGE(desc)) {
+    if (!(desc & SL_APX)) {
+      return false;
+    }
+
+    if (mmu_block_is_exclusive(LARGE_PAGE_BASE(desc), LARGE_PAGE_ORDER)) {
+      mmu_unshare_large_page(pl2, l2_i);
+      mmu_flush_tlb_mapping(mapping);
+      return true;
+    }
+
+    mmu_split_large_page(mapping, pl2, l2_i);
+    mmu_flush_tlb_mapping(mapping);
+    desc = pl2[l2_i];
+  }
+
+  if (!IS_SMALL_PAGE(desc) || !(desc & SL_APX)) {
+    return false;
+  }
+
+  head = mmu_page_head(SMALL_PAGE_BASE(desc));
+
+  if (head->count == 1) {
+    desc &= ~SL_APX;
+  } else {
+    if (!(page = (head == zero_page) ? buddy_alloc_zeroed(PAGE_SIZE) : buddy_alloc(PAGE_SIZE))) {
+      return false;
+    }
+
+    if (head != zero_page) {
+      memcpy(page_address(page), (void*)SMALL_PAGE_BASE(desc), PAGE_SIZE);
+      cache_sync_icache(page_address(page), PAGE_SIZE);
+    }
+    page_put(head);
+
+    desc = (uint32_t)page_address(page) | (desc & ~(0xfffff000 | SL_APX));
+  }
+
+  pl2[l2_i] = desc;
+  cache_clean_dcache(&pl2[l2_i], sizeof(uint32_t));
+
+  mmu_flush_tlb_page(mapping, addr);
+  return true;
+}
+
+int mmu_alloc_zero_page(pid_t pid, uint32_t addr, bool writable) {
+  struct mapping *mapping = mmu_mapping_fetch(pid);
+  uint32_t l1_i = GET_L1_INDEX(addr), desc, *pl2;
+  struct page *page;
+
+  if (!mapping || l1_i >= USER_L1_ENTRY_NUM || kernel_mapping.address[l1_i]) {
+    return -1;
+  }
+
+  if (!(pl2 = mmu_create_and_fill_pl2(mapping, l1_i))) {
+    return FL_TYPE(mapping->address[l1_i]) == FL_SECTION ? 0 : -1;
+  }
+
+  if (pl2[GET_L2_INDEX(addr)]) {
+    return 0;
+  }
+
+  if (writable) {
+    if (!(page = buddy_alloc_zeroed(PAGE_SIZE))) {
+      return -1;
+    }
+    desc = small_page_descriptor((uint32_t)page_address(page), MT_NORMAL, false);
+  } else {
+    page_get(zero_page);
+    desc = small_page_descriptor((uint32_t)page_address(zero_page), MT_NORMAL, false) | SL_APX;
+  }
+
+  mmu_set_small_page(mapping, pl2, addr, desc);
+  return 0;
+}
+
+int mmu_map_page(pid_t pid, uint32_t addr, struct page *page, bool writable) {
+  struct mapping *mapping = mmu_mapping_fetch(pid);
+  uint32_t l1_i = GET_L1_INDEX(addr), desc, *pl2;
+
+  if (!mapping || l1_i >= USER_L1_ENTRY_NUM || kernel_mapping.address[l1_i]) {
+    return -1;
+  }
+
+  if (!(pl2 = mmu_create_and_fill_pl2(mapping, l1_i))) {
+    return FL_TYPE(mapping->address[l1_i]) == FL_SECTION ? 0 : -1;
+  }
+
+  if (pl2[GET_L2_INDEX(addr)]) {
+    return 0;
+  }
+
+  page_get(page);
+  desc = small_page_descriptor((uint32_t)page_address(page), MT_NORMAL, false);
+
+  mmu_set_small_page(mapping, pl2, addr, writable ? desc : (desc | SL_APX));
+  return 0;
+}
+
+/* grants write access to a page without unsharing it */
+bool mmu_set_writable(pid_t pid, uint32_t addr) {
+  struct mapping *mapping = mmu_mapping_find(pid);
+  uint32_t l1_i = GET_L1_INDEX(addr), l2_i = GET_L2_INDEX(addr), *pl2;
+
+  if (!mapping || mapping == &kernel_mapping || l1_i >= USER_L1_ENTRY_NUM || kernel_mapping.address[l1_i]) {
+    return false;
+  }
+
+  if (FL_TYPE(mapping->address[l1_i]) != FL_PAGE_TABLE) {
+    return false;
+  }
+
+  pl2 = L2_TABLE_BASE(mapping->address[l1_i]);
+
+  if (!IS_SMALL_PAGE(pl2[l2_i]) || !(pl2[l2_i] & SL_APX)) {
+    return false;
+  }
+
+  pl2[l2_i] &= ~SL_APX;
+  cache_clean_dcache(&pl2[l2_i], sizeof(uint32_t));
+
+  mmu_flush_tlb_page(mapping, addr);
+  return true;
+}
+
+/* whether the kernel can touch the page without taking an abort */
+bool mmu_is_accessible(pid_t pid, uint32_t addr, bool write) {
+  struct mapping *mapping = mmu_mapping_find(pid);
+  uint32_t l1_i = GET_L1_INDEX(addr), desc;
+
+  if (!mapping || mapping == &kernel_mapping || l1_i >= USER_L1_ENTRY_NUM || kernel_mapping.address[l1_i]) {
+    return false;
+  }
+
+  desc = mapping->address[l1_i];
+
+  if (FL_TYPE(desc) == FL_SECTION) {
+    return !write || !(desc & FL_APX);
+  }
+
+  if (FL_TYPE(desc) != FL_PAGE_TABLE) {
+    return false;
+  }
+
+  desc = L2_TABLE_BASE(desc)[GET_L2_INDEX(addr)];
+
+  if (!desc) {
+    return false;
+  }
+
+  return !write || !(desc & SL_APX);
+}
+
+int mmu_free(pid_t pid, uint32_t addr, size_t size) {
+  struct mapping *mapping = mmu_mapping_find(pid);
+  uint32_t l1_i, l2_i, next, end, *pl1, *pl2;
+
+  if (!mapping || mapping == &kernel_mapping) {
+    return -1;
+  }
+
+  pl1  = mapping->address;
+  addr = addr & ~(PAGE_SIZE - 1);
+  end  = addr + (GET_PAGE_SIZE(size) * PAGE_SIZE);
+
+  while (addr < end) {
+    l1_i = GET_L1_INDEX(addr);
+    next = (addr & ~(SECTION_SIZE - 1)) + SECTION_SIZE;
+    next = next < end ? next : end;
+
+    if (l1_i >= USER_L1_ENTRY_NUM || kernel_mapping.address[l1_i]) {
+      return -1;
+    }
+
+    if (FL_TYPE(pl1[l1_i]) == FL_SECTION) {
+      if (IS_ALIGNED(addr, SECTION_SIZE) && (next - addr) == SECTION_SIZE) {
+        mmu_put_block(SECTION_BASE(pl1[l1_i]), SECTION_ORDER);
+
+        pl1[l1_i] = 0;
+        cache_clean_dcache(&pl1[l1_i], sizeof(uint32_t));
+
+        mapping->stat.sections--;
+        addr = next;
+        continue;
+      }
+
+      if (!mmu_split_section(mapping, l1_i)) {
+        return -1;
+      }
+    }
+
+    if (FL_TYPE(pl1[l1_i]) != FL_PAGE_TABLE) {
+      addr = next;
+      continue;
+    }
+
+    pl2 = L2_TABLE_BASE(pl1[l1_i]);
+
+    for (; addr < next; addr += PAGE_SIZE) {
+      l2_i = GET_L2_INDEX(addr);
+
+      if (IS_LARGE_PAGE(pl2[l2_i])) {
+        if (IS_ALIGNED(addr, LARGE_PAGE_SIZE) && (next - addr) >= LARGE_PAGE_SIZE) {
+          mmu_put_block(LARGE_PAGE_BASE(pl2[l2_i]), LARGE_PAGE_ORDER);
+
+          memset(&pl2[l2_i], 0, LARGE_PAGE_ENTRY_NUM * sizeof(uint32_t));
+          cache_clean_dcache(&pl2[l2_i], LARGE_PAGE_ENTRY_NUM * sizeof(uint32_t));
+
+          mapping->stat.large_pages--;
+          addr += LARGE_PAGE_SIZE - PAGE_SIZE;
+          continue;
+        }
+
+        mmu_split_large_page(mapping, pl2, l2_i);
+      }
+
+      if (IS_SMALL_PAGE(pl2[l2_i])) {
+        page_put(mmu_page_head(SMALL_PAGE_BASE(pl2[l2_i])));
+
+        pl2[l2_i] = 0;
+        cache_clean_dcache(&pl2[l2_i], sizeof(uint32_t));
+
+        mapping->stat.small_pages--;
+      }
+    }
+  }
+
+  mmu_flush_tlb_mapping(mapping);
+  return 0;
+}
+
+/*
+ * Write-protects the range so the next write goes through the copy-on-write
+ * path, which checks the caller's permissions. Inaccessible pages keep only
+ * privileged access.
+ */
+int mmu_protect(pid_t pid, uint32_t addr, size_t size, bool accessible) {
+  struct mapping *mapping = mmu_mapping_find(pid);
+  uint32_t l1_i, l2_i, next, end, *pl1, *pl2;
+  uint32_t ap = accessible ? AP_FULL_ACCESS : AP_PRIVILEGED_ACCESS;
+
+  if (!mapping || mapping == &kernel_mapping) {
+    return -1;
+  }
+
+  pl1  = mapping->address;
+  addr = addr & ~(PAGE_SIZE - 1);
+  end  = addr + (GET_PAGE_SIZE(size) * PAGE_SIZE);
+
+  while (addr < end) {
+    l1_i = GET_L1_INDEX(addr);
+    next = (addr & ~(SECTION_SIZE - 1)) + SECTION_SIZE;
+    next = next < end ? next : end;
+
+    if (l1_i >= USER_L1_ENTRY_NUM || kernel_mapping.address[l1_i]) {
+      return -1;
+    }
+
+    if (FL_TYPE(pl1[l1_i]) == FL_SECTION) {
+      if (IS_ALIGNED(addr, SECTION_SIZE) && (next - addr) == SECTION_SIZE) {
+        pl1[l1_i] = (pl1[l1_i] & ~FL_AP(0x3)) | FL_AP(ap) | FL_APX;
+        cache_clean_dcache(&pl1[l1_i], sizeof(uint32_t));
+
+        addr = next;
+        continue;
+      }
+
+      if (!mmu_split_section(mapping, l1_i)) {
+        return -1;
+      }
+    }
+
+    if (FL_TYPE(pl1[l1_i]) != FL_PAGE_TABLE) {
+      addr = next;
+      continue;
+    }
+
+    pl2 = L2_TABLE_BASE(pl1[l1_i]);
+
+    for (; addr < next; addr += PAGE_SIZE) {
+      l2_i = GET_L2_INDEX(addr);
+
+      if (IS_LARGE_PAGE(pl2[l2_i]) && !(IS_ALIGNED(addr, LARGE_PAGE_SIZE) && (next - addr) >= LARGE_PAGE_SIZE)) {
+        mmu_split_large_page(mapping, pl2, l2_i);
+      }
+
+      if (pl2[l2_i]) {
+        pl2[l2_i] = (pl2[l2_i] & ~SL_AP(0x3)) | SL_AP(ap) | SL_APX;
+        cache_clean_dcache(&pl2[l2_i], sizeof(uint32_t));
+      }
+    }
+  }
+
+  mmu_flush_tlb_mapping(mapping);
+  return 0;
+}
+
+static bool mmu_move_section(struct mapping *mapping, uint32_t from, uint32_t to, uint32_t end) {
+  uint32_t *pl1 = mapping->address, from_i = GET_L1_INDEX(from), to_i = GET_L1_INDEX(to);
+
+  if (!IS_ALIGNED(from, SECTION_SIZE) || !IS_ALIGNED(to, SECTION_SIZE) || (end - from) < SECTION_SIZE) {
+    return false;
+  }
+
+  if (FL_TYPE(pl1[from_i]) != FL_SECTION || pl1[to_i]) {
+    return false;
+  }
+
+  pl1[to_i] = pl1[from_i];
+  pl1[from_i] = 0;
+
+  cache_clean_dcache(&pl1[to_i], sizeof(uint32_t));
+  cache_clean_dcache(&pl1[from_i], sizeof(uint32_t));
+
+  return true;
+}
+
+/*
+ * Detaches the small page descriptor for addr, splitting blocks if needed.
+ * desc is left zero for a hole, while -1 means a block could not be split.
+ */
+static int mmu_take_small_page(struct mapping *mapping, uint32_t addr, uint32_t *desc) {
+  uint32_t l1_i = GET_L1_INDEX(addr), l2_i = GET_L2_INDEX(addr), *pl2;
+
+  *desc = 0;
+
+  if (FL_TYPE(mapping->address[l1_i]) == FL_SECTION && !mmu_split_section(mapping, l1_i)) {
+    return -1;
+  }
+
+  if (FL_TYPE(mapping->address[l1_i]) != FL_PAGE_TABLE) {
+    return 0;
+  }
+
+  pl2 = L2_TABLE_BASE(mapping->address[l1_i]);
+
+  if (IS_LARGE_PAGE(pl2[l2_i])) {
+    mmu_split_large_page(mapping, pl2, l2_i);
+  }
+
+  *desc = pl2[l2_i];
+  pl2[l2_i] = 0;
+  cache_clean_dcache(&pl2[l2_i], sizeof(uint32_t));
+
+  return 0;
+}
+
+/* moves page table entries up to end and returns the address it stopped at */
+static uint32_t mmu_move_range(struct mapping *mapping, uint32_t from, uint32_t to, uint32_t end) {
+  uint32_t desc, *pl2;
+
+  while (from < end) {
+    if (GET_L1_INDEX(from) >= USER_L1_ENTRY_NUM || kernel_mapping.address[GET_L1_INDEX(from)] ||
+        GET_L1_INDEX(to) >= USER_L1_ENTRY_NUM || kernel_mapping.address[GET_L1_INDEX(to)]) {
+      break;
+    }
+
+    if (mmu_move_section(mapping, from, to, end)) {
+      from += SECTION_SIZE;
+      to   += SECTION_SIZE;
+      continue;
+    }
+
+    if (mmu_take_small_page(mapping, from, &desc) < 0) {
+      break;
+    }
+
+    if (desc) {
+      if (!(pl2 = mmu_create_and_fill_pl2(mapping, GET_L1_INDEX(to)))) {
+        /* the table the page came from still has its slot */
+        pl2 = L2_TABLE_BASE(mapping->address[GET_L1_INDEX(from)]);
+        pl2[GET_L2_INDEX(from)] = desc;
+        cache_clean_dcache(&pl2[GET_L2_INDEX(from)], sizeof(uint32_t));
+        break;
+      }
+
+      pl2[GET_L2_INDEX(to)] = desc;
+      cache_clean_dcache(&pl2[GET_L2_INDEX(to)], sizeof(uint32_t));
+    }
+
+    from += PAGE_SIZE;
+    to   += PAGE_SIZE;
+  }
+
+  return from;
+}
+
+/*
+ * Moves page table entries, the frames themselves are never copied. On
+ * failure the pages already moved are put back, which needs no memory as
+ * each of them left an empty slot behind, and nothing has changed.
+ */
+int mmu_move(pid_t pid, uint32_t from, uint32_t to, size_t size) {
+  struct mapping *mapping = mmu_mapping_find(pid);
+  uint32_t end, reached;
+
+  if (!mapping || mapping == &kernel_mapping) {
+    return -1;
+  }
+
+  from = from & ~(PAGE_SIZE - 1);
+  to   = to & ~(PAGE_SIZE - 1);
+  end  = from + (GET_PAGE_SIZE(size) * PAGE_SIZE);
+
+  if ((reached = mmu_move_range(mapping, from, to, end)) < end) {
+    mmu_move_range(mapping, to, from, to + (reached - from));
+  }
+
+  mmu_flush_tlb_mapping(mapping);
+  return reached < end ? -1 : 0;
+}
+
+struct migration {
+  page_index start;
+  page_index end;
+  size_t moved;
+};
+
+typedef void (*page_visitor)(struct mapping *mapping, uint32_t *pl2, uint32_t addr, void *arg);
+
+static void mmu_visit_small_pages(page_visitor visit, void *arg) {
+  int h;
+  uint32_t l1_i, l2_i, *pl1, *pl2;
+  struct mapping *mapping;
+
+  for (h = 0; h < MAPPING_HASH_SIZE; ++h) {
+    list_foreach(mapping, &mappings[h], next) {
+      pl1 = mapping->address;
+
+      for (l1_i = 0; l1_i < USER_L1_ENTRY_NUM; ++l1_i) {
+        if (kernel_mapping.address[l1_i] || FL_TYPE(pl1[l1_i]) != FL_PAGE_TABLE) {
+          continue;
+        }
+
+        pl2 = L2_TABLE_BASE(pl1[l1_i]);
+
+        for (l2_i = 0; l2_i < L2_ENTRY_NUM; ++l2_i) {
+          if (IS_SMALL_PAGE(pl2[l2_i])) {
+            visit(mapping, pl2, (l1_i << 20) | (l2_i << 12), arg);
+          }
+        }
+      }
+    }
+  }
+}
+
+/* a single page block referenced by exactly one user translation */
+static struct page *mmu_movable_page(uint32_t desc) {
+  struct page *page = page_find_by_address((void*)SMALL_PAGE_BASE(desc));
+
+  if (!page || page == zero_page || !(page->flags & PF_FIRST_PAGE) || page->order || page->count != 1) {
+    return NULL;
+  }
+
+  return page;
+}
+
+static void mmu_mark_movable(struct mapping *mapping, uint32_t *pl2, uint32_t addr, void *arg) {
+  struct page *page = mmu_movable_page(pl2[GET_L2_INDEX(addr)]);
+
+  (void)mapping;
+  (void)arg;
+
+  if (page) {
+    page->flags |= PF_MOVABLE;
+  }
+}
+
+static void mmu_migrate(struct mapping *mapping, uint32_t *pl2, uint32_t addr, void *arg) {
+  struct migration *migration = arg;
+  uint32_t l2_i = GET_L2_INDEX(addr), desc = pl2[l2_i];
+  struct page *page = page_find_by_address((void*)SMALL_PAGE_BASE(desc)), *to;
+
+  if (!page || !(page->flags & PF_MOVABLE) || PAGE_INDEX(page) < migration->start || PAGE_INDEX(page) >= migration->end) {
+    return;
+  }
+
+  if (!(to = buddy_try_alloc(PAGE_SIZE))) {
+    return;
+  }
+
+  memcpy(page_address(to), page_address(page), PAGE_SIZE);
+  cache_sync_icache(page_address(to), PAGE_SIZE);
+
+  pl2[l2_i] = (uint32_t)page_address(to) | (desc & ~0xfffff000);
+  cache_clean_dcache(&pl2[l2_i], sizeof(uint32_t));
+
+  mmu_flush_tlb_page(mapping, addr);
+
+  /* the old frame is handed back to the caller, not to the free lists */
+  page->flags &= ~(PF_MOVABLE | PF_FIRST_PAGE);
+  page->count = 0;
+
+  migration->moved++;
+}
+
+void mmu_mark_movable_pages(void) {
+  mmu_visit_small_pages(mmu_mark_movable, NULL);
+}
+
+size_t mmu_migrate_pages(page_index start, page_index end) {
+  struct migration migration = { start, end, 0 };
+
+  mmu_visit_small_pages(mmu_migrate, &migration);
+  return migration.moved;
+}
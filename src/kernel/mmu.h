@@ -19,11 +19,32 @@ limitations under the License.
 
 #include "lib/type.h"
 #include "process.h"
+#include "page.h"
+
+/* translations a process holds, kept in step by every map, split and release */
+struct mmu_stat {
+  uint32_t sections;
+  uint32_t large_pages;
+  uint32_t small_pages;
+};
 
 void mmu_init(void);
 int mmu_destroy(pid_t pid);
 int mmu_alloc(pid_t pid, uint32_t addr, size_t size);
 pid_t mmu_set_ttb(pid_t pid);
+uint32_t mmu_find_kernel_section(uint32_t addr, size_t size);
+int mmu_get_stat(pid_t pid, struct mmu_stat *stat);
+int mmu_fork(pid_t pid, pid_t parent_pid);
+bool mmu_copy_on_write(pid_t pid, uint32_t addr);
+int mmu_alloc_zero_page(pid_t pid, uint32_t addr, bool writable);
+int mmu_map_page(pid_t pid, uint32_t addr, struct page *page, bool writable);
+bool mmu_set_writable(pid_t pid, uint32_t addr);
+bool mmu_is_accessible(pid_t pid, uint32_t addr, bool write);
+int mmu_free(pid_t pid, uint32_t addr, size_t size);
+int mmu_protect(pid_t pid, uint32_t addr, size_t size, bool accessible);
+int mmu_move(pid_t pid, uint32_t from, uint32_t to, size_t size);
+void mmu_mark_movable_pages(void);
+size_t mmu_migrate_pages(page_index start, page_index end);
 
 // implemented in asm/lib.S
 void mmu_enable(void);
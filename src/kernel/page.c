@@ -17,22 +17,54 @@ limitations under the License.
 #include "page.h"
 #include "buddy.h"
 #include "slab.h"
+#include "system.h"
+#include "boot.h"
+#include "logger.h"
 
 struct page *pages;
+page_index page_num;
+
+/*
+ * The pool runs from PAGE_START to the end of the RAM bank holding it.
+ * The boot parameters may be overwritten once pages are handed out, so
+ * this is only looked up on the first call.
+ */
+static page_index page_count(void) {
+  uint64_t end;
+
+  if (!boot_find_memory((uint32_t)PAGE_START, &end)) {
+    return PAGE_NUM_DEFAULT;
+  }
+
+  if (end > PAGE_END_MAX) {
+    end = PAGE_END_MAX;
+  }
+
+  return (page_index)((end - (uint32_t)PAGE_START) / PAGE_SIZE);
+}
 
 void page_init(void) {
+  if (!page_num) {
+    page_num = page_count();
+    logger_debug("page pool: %u pages", page_num);
+  }
+
   buddy_init();
   slab_cache_init();
 }
 
 void *page_address(const struct page *page) {
-  return PAGE_START + (PAGE_SIZE * page->index);
+  return PAGE_START + (PAGE_SIZE * PAGE_INDEX(page));
+}
+
+char *page_end(void) {
+  return PAGE_START + (PAGE_SIZE * page_num);
 }
 
 struct page *page_find_by_address(void *address) {
   page_index index = (page_index)(((char*)address - PAGE_START) / PAGE_SIZE);
 
-  if (index < PAGE_NUM) {
+  if (index < page_num) {
     return &pages[index];
   } else {
     return NULL;
@@ -40,17 +72,20 @@ struct page *page_find_by_address(void *address) {
 }
 
 struct page *page_find_head(const struct page *page) {
-  page_index index = page->index;
+  struct page *head = (struct page*)page - page->head;
+  return (head->flags & PF_FIRST_PAGE) ? head : NULL;
+}
+
+void page_get(struct page *page) {
+  page->count++;
+}
 
-  while (index < PAGE_NUM) {
-    if (pages[index].flags & PF_FIRST_PAGE) {
-      return &pages[index];
-    }
+void page_put(struct page *page) {
+  SYSTEM_BUG_ON(page->count == 0);
 
-    index--;
+  if (!--page->count) {
+    buddy_free(page);
   }
-
-  return NULL;
 }
 
 void page_cleanup(struct page **page) {
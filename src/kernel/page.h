@@ -17,37 +17,54 @@ limitations under the License.
 #ifndef _CYANURUS_PAGE_H_
 #define _CYANURUS_PAGE_H_
 
+#include "lib/type.h"
 #include "lib/list.h"
 #include "lib/extension.h"
 
 #define PAGE_START ((char*)(0x65000000))
 
 #define PAGE_SIZE 0x1000
-#define PAGE_NUM  0x4000
+
+/* used when the boot loader does not describe the memory */
+#define PAGE_NUM_DEFAULT 0x4000
+
+/* keep clear of the high vectors */
+#define PAGE_END_MAX 0xf0000000ULL
 
 #define PAGE_MAX_ORDER 10
 #define PAGE_MAX_DEPTH (PAGE_MAX_ORDER + 1)
 
 #define PF_FREE_LIST  (1 << 0)
 #define PF_FIRST_PAGE (1 << 1)
+#define PF_MOVABLE    (1 << 2)
+#define PF_ZEROED     (1 << 3)
+#define PF_SLAB       (1 << 4)
 
 #define _page_cleanup_ _cleanup_(page_cleanup)
 
+#define PAGE_INDEX(page) ((page_index)((page) - pages))
+
 typedef unsigned long page_index;
 
+/* 16 bytes per frame, the index is implied by the position in pages[] */
 struct page {
-  page_index index;
-  unsigned int flags;
-  unsigned int order;
-  struct page* next;
+  uint8_t flags;
+  uint8_t order;
+  uint16_t head;  /* distance back to the first page of the block */
+  uint32_t count;
+  struct list list;
 };
 
 extern struct page *pages;
+extern page_index page_num;
 
 void page_init(void);
 void *page_address(const struct page *page);
+char *page_end(void);
 struct page *page_find_by_address(void *address);
 struct page *page_find_head(const struct page *page);
+void page_get(struct page *page);
+void page_put(struct page *page);
 void page_cleanup(struct page **page);
 
 #endif
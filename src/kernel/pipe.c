@@ -16,6 +16,7 @@ limitations under the License.
 
 #include "pipe.h"
 #include "slab.h"
+#include "cache.h"
 #include "page.h"
 #include "file.h"
 #include "buddy.h"
@@ -26,18 +27,33 @@ limitations under the License.
 
 static struct slab_cache *pipe_cache;
 
+/* pipe_release frees a pipe only once both ends are gone and its queues are empty */
+static void pipe_ctor(void *obj) {
+  struct pipe *pipe = obj;
+
+  memset(pipe, 0, sizeof(struct pipe));
+  process_waitq_init(&pipe->readers_waitq);
+  process_waitq_init(&pipe->writers_waitq);
+}
+
 void pipe_init(void) {
-  pipe_cache = slab_cache_create("pipe", sizeof(struct pipe));
+  pipe_cache = slab_cache_create_with("pipe", sizeof(struct pipe), CACHE_LINE_SIZE, pipe_ctor);
 }
 
 struct pipe *pipe_create(void) {
-  struct pipe *pipe = memset(slab_cache_alloc(pipe_cache), 0, sizeof(struct pipe));
+  struct pipe *pipe = slab_cache_alloc(pipe_cache);
 
-  pipe->page = buddy_alloc(PAGE_SIZE);
+  if (!pipe) {
+    return NULL;
+  }
 
-  process_waitq_init(&pipe->readers_waitq);
-  process_waitq_init(&pipe->writers_waitq);
+  if (!(pipe->page = buddy_alloc(PAGE_SIZE))) {
+    slab_cache_free(pipe_cache, pipe);
+    return NULL;
+  }
 
+  pipe->offset = 0;
+  pipe->length = 0;
   pipe->readers = 1;
   pipe->writers = 1;
 
@@ -26,6 +26,7 @@ limitations under the License.
 #include "tty.h"
 #include "system.h"
 #include "mmu.h"
+#include "cache.h"
 #include "elf.h"
 #include "buddy.h"
 #include "logger.h"
@@ -34,24 +35,26 @@ limitations under the License.
 #include "inode.h"
 #include "file.h"
 #include "user.h"
+#include "vma.h"
+#include "gic.h"
+#include "timer.h"
+#include "config.h"
 
 #define MAX_PROCESS_SIZE 8
 #define MAX_FD_SIZE      32
 
-#define SEGMENT_TYPE_SIZE  4
-
-#define SEGMENT_TYPE_TEXT  0
-#define SEGMENT_TYPE_DATA  1
-#define SEGMENT_TYPE_STACK 2
-#define SEGMENT_TYPE_HEAP  3
-
-#define SEGMENT_FLAGS_GROWSUP   (1 << 0)
-#define SEGMENT_FLAGS_GROWSDOWN (1 << 1)
-
 #define STACK_START ((uint8_t*)0x58000000)
 #define STACK_END   USER_ADDRESS_END
 
+/* anonymous mappings are placed top-down between the heap limit and the stack */
+#define MMAP_START BRK_ADDRESS_END
+#define MMAP_END   STACK_START
+
+/* position independent executables are loaded where static ones are linked */
+#define ELF_DYN_BASE ((uint32_t)USER_ADDRESS_START)
+
 #define ARG_MAX (4 * 1024)
+#define AUXV_SIZE 8
 #define INITIAL_STACK_SIZE ARG_MAX
 
 #define ALIGN(p, n) (((p) + ((1 << (n)) - 1)) & ~((1 << (n)) - 1))
@@ -63,17 +66,32 @@ limitations under the License.
 
 #define KERNEL_STACK_SIZE (PAGE_SIZE * 4)
 
-struct segment {
-  uint8_t *start;
-  uint8_t *current;
-  uint8_t *end;
-  uint32_t flags;
-};
+#define NICE_MIN -20
+#define NICE_MAX 19
+#define NICE_LEVELS (NICE_MAX - NICE_MIN + 1)
+
+#define RT_PRIO_MIN 1
+#define RT_PRIO_MAX 99
+
+/*
+ * one run queue per priority, lower index runs first: real-time priority
+ * 99 down to 1 take 0-98, nice -20 to 19 take 99-138
+ */
+#define PRIO_LEVELS (RT_PRIO_MAX + NICE_LEVELS)
+#define RT_TO_PRIO(rt) (RT_PRIO_MAX - (rt))
+#define NICE_TO_PRIO(nice) (RT_PRIO_MAX + (nice) - NICE_MIN)
+
+/* usec per epoch, twice the base slice at nice -20 down to 1/20 at nice 19 */
+#define OTHER_SLICE_USEC (CYANURUS_OTHER_SLICE_MS * 1000)
+#define NICE_TO_SLICE(nice) (OTHER_SLICE_USEC / 20 * (NICE_LEVELS - ((nice) - NICE_MIN)))
+
+#define RR_QUANTUM_USEC (CYANURUS_RR_QUANTUM_MS * 1000)
 
 enum process_state {
   STATE_READY = 0,
   STATE_BLOCKED,
   STATE_DEAD,
+  STATE_NEW,
 };
 
 struct process_signal {
@@ -82,28 +100,52 @@ struct process_signal {
   struct k_sigaction actions[NSIG-1];
 };
 
+struct process_waitq_entry {
+  struct list next;
+  struct process *process;
+};
+
+struct prio_array {
+  bitset bitmap[bitset_nslots(PRIO_LEVELS)];
+  struct list queues[PRIO_LEVELS];
+};
+
 struct process {
   struct list next;
   struct list task;
   struct list children;
   struct list sibling;
   pid_t id;
+  pid_t mm;
   struct process *parent;
   enum process_state state;
+  int nice;
+  int policy;
+  int rt_priority;
+  int prio;
+  uint32_t slice;
+  uint32_t rr_left;
+  uint64_t dispatched;
+  bool yielded;
+  struct prio_array *array;
+  struct list sleeping;
+  uint64_t wake_at;
+  struct process_waitq sleep_waitq;
+  bool vfork;
+  struct process_waitq vfork_waitq;
   int exit_status;
   struct process_context context;
   struct process_context *suspend;
-  struct segment segments[SEGMENT_TYPE_SIZE];
+  struct list vmas;
+  uint8_t *heap_start;
   uint8_t *brk;
+  uint32_t tls;
   uint8_t *kernel_stack;
   struct file *files[MAX_FD_SIZE];
   bitset close_on_exec[bitset_nslots(MAX_FD_SIZE)];
   struct process_signal signal;
-};
-
-struct process_waitq_entry {
-  struct list next;
-  struct process *process;
+  struct process_waitq_entry waitq_entry;
+  struct process_context suspend_context;
 };
 
 struct argv_envp {
@@ -118,12 +160,20 @@ struct argv_envp {
 struct process *current_process;
 
 static struct list all_processes;
-static struct list run_queue;
+
+/*
+ * Ready processes wait on the active array until their slice is spent,
+ * then on the expired one. The arrays swap once the active one runs dry.
+ */
+static struct prio_array prio_arrays[2];
+static struct prio_array *active_array;
+static struct prio_array *expired_array;
+
+/* processes in nanosleep, nearest deadline first */
+static struct list sleepers;
 
 static struct slab_cache *process_cache;
 static struct slab_cache *file_cache;
-static struct slab_cache *waitq_cache;
-static struct slab_cache *context_cache;
 
 static struct process_waitq child_waitq;
 static struct termios terminal_config;
@@ -152,115 +202,441 @@ static struct process *find_toplevel_process() {
   return NULL;
 }
 
-static void create_segments(struct process *process, const struct elf_executable *executable) {
-  struct segment *segment;
+static int process_prio(const struct process *p) {
+  return (p->policy == SCHED_OTHER) ? NICE_TO_PRIO(p->nice) : RT_TO_PRIO(p->rt_priority);
+}
+
+static void enqueue_process(struct process *p, bool head) {
+  struct prio_array *array = active_array;
+
+  p->prio = process_prio(p);
+
+  /*
+   * a spent slice waits for the next epoch, so lower priorities get their
+   * turn; real-time processes never expire
+   */
+  if (p->policy == SCHED_OTHER && !p->slice) {
+    p->slice = NICE_TO_SLICE(p->nice);
+    array = expired_array;
+  }
 
-  uint8_t *text_start = (uint8_t*)executable->text.addr;
-  uint8_t *text_end   = (uint8_t*)PAGE_ALIGN(executable->text.addr + executable->text.memory_size);
+  if (head) {
+    list_add(&array->queues[p->prio], &p->task);
+  } else {
+    list_add(array->queues[p->prio].prev, &p->task);
+  }
 
-  uint8_t *data_start = (uint8_t*)PAGE_MASK(executable->data.addr);
-  uint8_t *data_end   = (uint8_t*)PAGE_ALIGN(executable->data.addr + executable->data.memory_size);
+  bitset_add(array->bitmap, p->prio);
+  p->array = array;
+}
 
-  segment = &process->segments[SEGMENT_TYPE_TEXT];
-  segment->start   = text_start;
-  segment->current = text_end;
-  segment->end     = text_end;
-  segment->flags   = SEGMENT_FLAGS_GROWSUP;
+static void dequeue_process(struct process *p) {
+  if (!p->array) {
+    return;
+  }
 
-  segment = &process->segments[SEGMENT_TYPE_DATA];
-  segment->start   = data_start;
-  segment->current = data_end;
-  segment->end     = data_end;
-  segment->flags   = SEGMENT_FLAGS_GROWSUP;
+  list_remove(&p->task);
+  list_init(&p->task);
 
-  segment = &process->segments[SEGMENT_TYPE_HEAP];
-  segment->start   = data_end ? data_end : text_end;
-  segment->current = segment->start;
-  segment->end     = segment->start;
-  segment->flags   = SEGMENT_FLAGS_GROWSUP;
+  if (list_empty(&p->array->queues[p->prio])) {
+    bitset_remove(p->array->bitmap, p->prio);
+  }
 
-  segment = &process->segments[SEGMENT_TYPE_STACK];
-  segment->start   = STACK_START;
-  segment->current = STACK_END - INITIAL_STACK_SIZE;
-  segment->end     = STACK_END;
-  segment->flags   = SEGMENT_FLAGS_GROWSDOWN;
+  p->array = NULL;
 }
 
-static struct segment *find_segment(uint8_t *address) {
-  int i;
-  struct segment *segment;
+static struct process *pick_next_process(void) {
+  int prio;
+  struct process *p;
+  struct prio_array *array;
 
-  for (i = 0; i < SEGMENT_TYPE_SIZE; ++i) {
-    segment = &current_process->segments[i];
+  if ((prio = bitset_find_first(active_array->bitmap, bitset_nslots(PRIO_LEVELS))) < 0) {
+    array = active_array;
+    active_array = expired_array;
+    expired_array = array;
 
-    if (address >= segment->start && address < segment->end) {
-      return segment;
+    if ((prio = bitset_find_first(active_array->bitmap, bitset_nslots(PRIO_LEVELS))) < 0) {
+      return NULL;
     }
   }
 
-  return NULL;
+  p = container_of(active_array->queues[prio].next, struct process, task);
+  dequeue_process(p);
+
+  return p;
 }
 
-static void alloc_segments(const struct process *process) {
-  int i;
-  const struct segment *segment;
-  uint8_t *start, *end;
+static bool runnable_empty(void) {
+  return bitset_find_first(active_array->bitmap, bitset_nslots(PRIO_LEVELS)) < 0 &&
+    bitset_find_first(expired_array->bitmap, bitset_nslots(PRIO_LEVELS)) < 0;
+}
 
-  for (i = 0; i < SEGMENT_TYPE_SIZE; ++i) {
-    segment = &process->segments[i];
+/* charges the time since the last dispatch to the slice or the quantum */
+static void account_process(struct process *p, uint64_t now) {
+  uint32_t used = (uint32_t)(now - p->dispatched);
 
-    if (segment->flags & SEGMENT_FLAGS_GROWSUP) {
-      start = segment->start;
-      end   = segment->current;
-    } else if (segment->flags & SEGMENT_FLAGS_GROWSDOWN) {
-      start = segment->current;
-      end   = segment->end;
+  if (p->policy == SCHED_OTHER) {
+    p->slice = (used < p->slice) ? p->slice - used : 0;
+  } else if (p->policy == SCHED_RR) {
+    p->rr_left = (used < p->rr_left) ? p->rr_left - used : 0;
+  }
+}
+
+/*
+ * Puts the process that just left the CPU back. Real-time processes stay
+ * in front of their queue until they block or yield, or for SCHED_RR until
+ * the quantum is used up.
+ */
+static void requeue_process(struct process *p) {
+  bool head = (p->policy == SCHED_FIFO);
+
+  if (p->policy == SCHED_RR) {
+    if (p->rr_left) {
+      head = true;
     } else {
-      logger_fatal("bad segment flags: 0x%x", segment->flags);
-      system_halt();
+      p->rr_left = RR_QUANTUM_USEC;
     }
+  }
 
-    mmu_alloc(process->id, (uint32_t)start, (uint32_t)(end - start));
+  if (p->yielded) {
+    p->yielded = false;
+    head = false;
   }
+
+  enqueue_process(p, head);
 }
 
-static void copy_segment(pid_t pid, const struct segment *seg) {
-  struct page *page;
-  uint8_t *start, *end, *cur, *buf;
-
-  if (seg->flags & SEGMENT_FLAGS_GROWSUP) {
-    start = seg->start;
-    end = seg->current;
-  } else if (seg->flags & SEGMENT_FLAGS_GROWSDOWN) {
-    start = seg->current;
-    end = seg->end;
+static void make_ready(struct process *p) {
+  p->state = STATE_READY;
+  enqueue_process(p, false);
+}
+
+static void wake_sleepers(uint64_t now) {
+  struct process *p;
+
+  while (!list_empty(&sleepers)) {
+    p = container_of(sleepers.next, struct process, sleeping);
+    if (p->wake_at > now) {
+      break;
+    }
+
+    list_remove(&p->sleeping);
+    list_init(&p->sleeping);
+    process_wake(&p->sleep_waitq);
+  }
+}
+
+/*
+ * Arms the one-shot timer for whichever comes first, the end of the slice
+ * or quantum of p or the nearest sleeper. A lone process needs no slice
+ * interrupt and SCHED_FIFO never gets one; with nothing due at all only a
+ * watchdog remains to keep the clock from missing a wrap.
+ */
+static void program_timer(const struct process *p, uint64_t now) {
+  uint64_t expiry = 0;
+  struct process *sleeper;
+
+  if (p && !runnable_empty()) {
+    if (p->policy == SCHED_OTHER) {
+      expiry = now + p->slice;
+    } else if (p->policy == SCHED_RR) {
+      expiry = now + p->rr_left;
+    }
+  }
+
+  if (!list_empty(&sleepers)) {
+    sleeper = container_of(sleepers.next, struct process, sleeping);
+    if (!expiry || sleeper->wake_at < expiry) {
+      expiry = sleeper->wake_at;
+    }
+  }
+
+  if (expiry && expiry <= now) {
+    timer_set_oneshot(0);
+  } else if (!expiry || expiry - now > TIMER_ONESHOT_MAX_USEC) {
+    timer_set_oneshot(TIMER_ONESHOT_MAX_USEC);
   } else {
-    logger_fatal("bad segment flags: 0x%x", seg->flags);
-    system_halt();
+    timer_set_oneshot((uint32_t)(expiry - now));
   }
+}
 
-  page = buddy_alloc(PAGE_SIZE);
-  buf = page_address(page);
+static void set_nice(struct process *p, int nice) {
+  bool queued = (p->array != NULL);
 
-  for (cur = start; cur < end; cur += PAGE_SIZE) {
-    memcpy(buf, cur, PAGE_SIZE);
+  if (nice < NICE_MIN) {
+    nice = NICE_MIN;
+  } else if (nice > NICE_MAX) {
+    nice = NICE_MAX;
+  }
 
-    mmu_alloc(pid, (uint32_t)cur, PAGE_SIZE);
-    mmu_set_ttb(pid);
+  dequeue_process(p);
 
-    memcpy(cur, buf, PAGE_SIZE);
-    mmu_set_ttb(current_process->id);
+  p->nice = nice;
+  if (p->slice > (uint32_t)NICE_TO_SLICE(nice)) {
+    p->slice = NICE_TO_SLICE(nice);
   }
 
-  buddy_free(page);
+  if (queued) {
+    enqueue_process(p, false);
+  }
 }
 
-static void copy_segments(struct process *process, const struct process *parent) {
-  int i;
+static void set_scheduler(struct process *p, int policy, int rt_priority) {
+  bool queued = (p->array != NULL);
+
+  dequeue_process(p);
+
+  p->policy = policy;
+  p->rt_priority = rt_priority;
+  p->rr_left = RR_QUANTUM_USEC;
+
+  if (queued) {
+    enqueue_process(p, false);
+  }
+}
+
+/* dirty pages of shared file mappings are written back before they go away */
+static void sync_vmas(const struct process *process, uint8_t *start, uint8_t *end) {
+  struct vma *vma;
+
+  list_foreach(vma, &process->vmas, next) {
+    if (vma->start < end && vma->end > start && (vma->flags & VMA_FLAGS_SHARED)) {
+      inode_sync(vma->inode);
+    }
+  }
+}
+
+static void release_vmas(struct process *process) {
+  sync_vmas(process, USER_ADDRESS_START, USER_ADDRESS_END);
+  vma_release(&process->vmas);
+}
+
+static uint32_t segment_to_vma_flags(const struct elf_segment *segment) {
+  return VMA_FLAGS_GROWSUP |
+         ((segment->flags & ELF_PH_FLAGS_R) ? VMA_FLAGS_READ  : 0) |
+         ((segment->flags & ELF_PH_FLAGS_W) ? VMA_FLAGS_WRITE : 0) |
+         ((segment->flags & ELF_PH_FLAGS_X) ? VMA_FLAGS_EXEC  : 0);
+}
+
+static struct vma *create_image_vmas(struct process *process, const struct elf_executable *executable) {
+  size_t i;
+  uint32_t flags;
+  uint8_t *start, *current, *end;
+
+  struct elf_segment *segment;
+  struct vma *vma = NULL;
+
+  for (i = 0; i < executable->segment_num; ++i) {
+    segment = &executable->segments[i];
+    flags = segment_to_vma_flags(segment);
+
+    start = (uint8_t*)PAGE_MASK(segment->addr);
+    end   = (uint8_t*)PAGE_ALIGN(segment->addr + segment->memory_size);
+
+    /* a page shared with the previous segment is populated and takes both permissions */
+    if (vma && start < vma->end) {
+      vma->current = vma->end;
+      vma->flags |= flags & VMA_FLAGS_PROT;
+      start = vma->end;
+    }
+
+    if (start >= end) {
+      continue;
+    }
+
+    /* mapped segments are faulted in from the page cache shared by every process running them */
+    if (segment->mapped) {
+      if (!(vma = vma_create(&process->vmas, start, start, end, flags))) {
+        return NULL;
+      }
+      vma->inode  = executable->inode;
+      vma->offset = PAGE_MASK(segment->offset);
+      continue;
+    }
+
+    /* pages past the file image (bss) are demand-zero */
+    current = (uint8_t*)PAGE_ALIGN(segment->addr + segment->file_size);
+    current = current > start ? current : start;
+
+    if (!(vma = vma_create(&process->vmas, start, current, end, flags))) {
+      return NULL;
+    }
+  }
+
+  return vma;
+}
+
+static int create_vmas(struct process *process, const struct elf_executable *executable, const struct elf_executable *interpreter) {
+  struct vma *vma;
+
+  release_vmas(process);
+
+  if (!(vma = create_image_vmas(process, executable))) {
+    return -ENOMEM;
+  }
+
+  process->heap_start = vma->end;
+  process->brk = process->heap_start;
+
+  if (interpreter->segment_num && !create_image_vmas(process, interpreter)) {
+    return -ENOMEM;
+  }
+
+  if (!vma_create(&process->vmas, STACK_START, STACK_END - INITIAL_STACK_SIZE, STACK_END, VMA_FLAGS_GROWSDOWN | VMA_FLAGS_READ | VMA_FLAGS_WRITE)) {
+    return -ENOMEM;
+  }
+
+  return 0;
+}
+
+/*
+ * Loads an executable and, when it asks for one, its program interpreter.
+ * The interpreter is placed right below the stack and mmap allocates
+ * further down from there.
+ */
+static int load_executable(const char *path, struct elf_executable *executable, struct elf_executable *interpreter) {
+  uint32_t size;
+
+  memset(interpreter, 0, sizeof(struct elf_executable));
+
+  if (elf_load(path, executable) < 0) {
+    return -EACCES;
+  }
 
-  for (i = 0; i < SEGMENT_TYPE_SIZE; ++i) {
-    copy_segment(process->id, &parent->segments[i]);
+  if (executable->dynamic && elf_relocate(executable, ELF_DYN_BASE) < 0) {
+    goto fail;
   }
+
+  if (!executable->interpreter) {
+    return 0;
+  }
+
+  if (elf_load(executable->interpreter, interpreter) < 0) {
+    goto fail;
+  }
+
+  if (!interpreter->dynamic || interpreter->interpreter) {
+    goto fail;
+  }
+
+  size = elf_image_size(interpreter) + PAGE_MASK(interpreter->segments[0].addr);
+
+  if (size > (uint32_t)(MMAP_END - MMAP_START) || elf_relocate(interpreter, (uint32_t)MMAP_END - size) < 0) {
+    goto fail;
+  }
+
+  return 0;
+
+fail:
+  elf_release(executable);
+  elf_release(interpreter);
+  return -EACCES;
+}
+
+static void fill_auxv(uint32_t *auxv, const struct elf_executable *executable, const struct elf_executable *interpreter) {
+  *auxv++ = AT_PHDR;   *auxv++ = executable->phdr;
+  *auxv++ = AT_PHENT;  *auxv++ = executable->phent;
+  *auxv++ = AT_PHNUM;  *auxv++ = executable->phnum;
+  *auxv++ = AT_PAGESZ; *auxv++ = PAGE_SIZE;
+  *auxv++ = AT_BASE;   *auxv++ = interpreter->base;
+  *auxv++ = AT_ENTRY;  *auxv++ = executable->entry_point;
+  *auxv++ = AT_HWCAP;  *auxv++ = HWCAP_TLS;
+  *auxv++ = AT_NULL;   *auxv++ = 0;
+}
+
+static struct vma *find_vma(uint8_t *address) {
+  return vma_find(&current_process->vmas, address);
+}
+
+static int alloc_vmas(const struct process *process) {
+  struct vma *vma;
+  uint8_t *start, *end;
+
+  list_foreach(vma, &process->vmas, next) {
+    if (vma->flags & VMA_FLAGS_GROWSUP) {
+      start = vma->start;
+      end   = vma->current;
+    } else if (vma->flags & VMA_FLAGS_GROWSDOWN) {
+      start = vma->current;
+      end   = vma->end;
+    } else {
+      logger_fatal("bad vma flags: 0x%x", vma->flags);
+      system_halt();
+    }
+
+    if (mmu_alloc(process->mm, (uint32_t)start, (uint32_t)(end - start)) < 0) {
+      return -ENOMEM;
+    }
+  }
+
+  return 0;
+}
+
+/* pages written while loading the image get the permissions of their vma */
+static int protect_vmas(const struct process *process) {
+  struct vma *vma;
+
+  list_foreach(vma, &process->vmas, next) {
+    if (!(vma->flags & VMA_FLAGS_GROWSUP) || (vma->flags & VMA_FLAGS_WRITE) || vma->current == vma->start) {
+      continue;
+    }
+
+    if (mmu_protect(process->mm, (uint32_t)vma->start, (size_t)(vma->current - vma->start), (vma->flags & VMA_FLAGS_PROT) != 0) < 0) {
+      return -ENOMEM;
+    }
+  }
+
+  return 0;
+}
+
+/* the highest free gap for mmap that stays clear of the kernel's own sections */
+static uint8_t *find_mmap_area(const struct process *process, size_t size) {
+  uint8_t *start, *upper = MMAP_END;
+  uint32_t section;
+
+  while ((start = vma_find_free(&process->vmas, size, MMAP_START, upper))) {
+    if (!(section = mmu_find_kernel_section((uint32_t)start, size))) {
+      return start;
+    }
+    upper = (uint8_t*)section;
+  }
+
+  return NULL;
+}
+
+static int unmap_vmas(struct process *process, uint8_t *start, uint8_t *end) {
+  int r;
+
+  sync_vmas(process, start, end);
+
+  if ((r = vma_remove(&process->vmas, start, end)) < 0) {
+    return r;
+  }
+
+  return mmu_free(process->mm, (uint32_t)start, (uint32_t)(end - start)) < 0 ? -ENOMEM : 0;
+}
+
+static bool is_mapped_range(const struct process *process, uint8_t *start, uint8_t *end) {
+  struct vma *vma;
+
+  while (start < end) {
+    if (!(vma = vma_find(&process->vmas, start))) {
+      return false;
+    }
+    start = vma->end;
+  }
+
+  return true;
+}
+
+static bool is_user_range(const uint8_t *start, size_t size) {
+  return start >= USER_ADDRESS_START && size <= (size_t)(USER_ADDRESS_END - start);
+}
+
+static uint32_t prot_to_vma_flags(int prot) {
+  return ((prot & PROT_READ)  ? VMA_FLAGS_READ  : 0) |
+         ((prot & PROT_WRITE) ? VMA_FLAGS_WRITE : 0) |
+         ((prot & PROT_EXEC)  ? VMA_FLAGS_EXEC  : 0);
 }
 
 static int alloc_file(struct process *p) {
@@ -268,7 +644,9 @@ static int alloc_file(struct process *p) {
   struct file *file;
   for (i = 0; i < MAX_FD_SIZE; ++i) {
     if (!p->files[i]) {
-      file = slab_cache_alloc(file_cache);
+      if (!(file = slab_cache_alloc(file_cache))) {
+        return -ENOMEM;
+      }
 
       memset(file, 0, sizeof(struct file));
       file->count = 1;
@@ -336,26 +714,57 @@ static struct file *get_file(int fd) {
 static struct process *process_alloc(void) {
   static pid_t max_id = 1;
   struct process *p = slab_cache_alloc(process_cache);
+  struct page *kernel_stack;
+
+  if (!p) {
+    return NULL;
+  }
+
+  if (!(kernel_stack = buddy_alloc(KERNEL_STACK_SIZE))) {
+    slab_cache_free(process_cache, p);
+    return NULL;
+  }
 
   memset(p, 0, sizeof(struct process));
   list_init(&p->task);
   list_init(&p->children);
   list_init(&p->sibling);
+  list_init(&p->vmas);
+  list_init(&p->sleeping);
+
+  /* never picked by the scheduler or the OOM killer while it is being built */
+  p->state = STATE_NEW;
+  p->slice = NICE_TO_SLICE(0);
+  p->rr_left = RR_QUANTUM_USEC;
 
   p->id = max_id++;
+  p->mm = p->id;
   list_add(&all_processes, &p->next);
 
-  p->kernel_stack = page_address(buddy_alloc(KERNEL_STACK_SIZE));
+  process_waitq_init(&p->vfork_waitq);
+  process_waitq_init(&p->sleep_waitq);
+
+  p->kernel_stack = page_address(kernel_stack);
   return p;
 }
 
+static void process_free(struct process *p) {
+  list_remove(&p->next);
+
+  buddy_free(page_find_by_address(p->kernel_stack));
+
+  release_vmas(p);
+  mmu_destroy(p->id);
+
+  slab_cache_free(process_cache, p);
+}
+
 static void process_destroy(struct process *p) {
   struct process *child, *toplevel;
 
   SYSTEM_BUG_ON(current_process->id == p->id);
 
-  list_remove(&p->task);
-  list_remove(&p->next);
+  dequeue_process(p);
   list_remove(&p->sibling);
 
   if (!list_empty(&p->children)) {
@@ -374,12 +783,54 @@ static void process_destroy(struct process *p) {
     }
   }
 
-  buddy_free(page_find_by_address(p->kernel_stack));
+  process_free(p);
+  mmu_set_ttb(current_process->mm);
+}
+
+/* hand the borrowed address space back and resume the vfork parent */
+static void release_vfork(struct process *p) {
+  if (p->vfork) {
+    p->vfork = false;
+    p->mm = p->id;
+    process_wake(&p->vfork_waitq);
+  }
+}
+
+/* leaves only what the parent collects with wait, the address space goes right away */
+static void exit_process(struct process *p, int status) {
+  int i;
+  struct file *file;
+
+  p->state = STATE_DEAD;
+  p->exit_status = status;
+
+  release_vfork(p);
+
+  for (i = 0; i < MAX_FD_SIZE; ++i) {
+    file = p->files[i];
+
+    if (file) {
+      p->files[i] = NULL;
+      release_file(file);
+    }
+  }
 
+  release_vmas(p);
   mmu_destroy(p->id);
-  mmu_set_ttb(current_process->id);
 
-  slab_cache_free(process_cache, p);
+  dequeue_process(p);
+}
+
+static void reset_signal_handlers(struct process *p) {
+  int i;
+  struct k_sigaction *ksa;
+
+  for (i = 0; i < (NSIG-1); ++i) {
+    ksa = &p->signal.actions[i];
+    if (ksa->handler != SIG_DFL && ksa->handler != SIG_IGN) {
+      ksa->handler = SIG_DFL;
+    }
+  }
 }
 
 static int prepare_argv_and_envp(struct argv_envp *avep, char *const argv[], char *const envp[]) {
@@ -398,7 +849,7 @@ static int prepare_argv_and_envp(struct argv_envp *avep, char *const argv[], cha
     nc += strlen(envp[i]) + 1;
   }
 
-  size = ALIGN(sizeof(long) + nr * sizeof(char*) + nc * sizeof(char), 3);
+  size = ALIGN(sizeof(long) + nr * sizeof(char*) + AUXV_SIZE * 2 * sizeof(uint32_t) + nc * sizeof(char), 3);
   size = size < 0x100 ? 0x100 : size;
 
   if (size > ARG_MAX) {
@@ -408,7 +859,10 @@ static int prepare_argv_and_envp(struct argv_envp *avep, char *const argv[], cha
   avep->argc = argc;
   avep->size = size;
   avep->nr   = nr;
-  avep->page = buddy_alloc(size);
+
+  if (!(avep->page = buddy_alloc(size))) {
+    return -ENOMEM;
+  }
 
   uarg  = (char**)page_address(avep->page);
   uchar = (char*)(uarg + nr);
@@ -432,7 +886,7 @@ static int prepare_argv_and_envp(struct argv_envp *avep, char *const argv[], cha
   return 0;
 }
 
-static void *copy_argv_and_envp(const struct argv_envp *avep, char *ustack) {
+static void *copy_argv_and_envp(const struct argv_envp *avep, char *ustack, const uint32_t *auxv) {
   int i;
   char **uarg, *uchar, *s;
 
@@ -440,7 +894,7 @@ static void *copy_argv_and_envp(const struct argv_envp *avep, char *ustack) {
   char **argv = avep->argv, **envp = avep->envp;
 
   uarg  = (char**)(ustack - size);
-  uchar = (char*)(uarg + nr) + sizeof(long);
+  uchar = (char*)(uarg + nr) + sizeof(long) + AUXV_SIZE * 2 * sizeof(uint32_t);
 
   *((long*)uarg) = avep->argc;
   uarg = (void*)((char*)uarg + sizeof(long));
@@ -459,6 +913,8 @@ static void *copy_argv_and_envp(const struct argv_envp *avep, char *ustack) {
   }
   *uarg++ = NULL;
 
+  memcpy(uarg, auxv, AUXV_SIZE * 2 * sizeof(uint32_t));
+
   return (ustack - size);
 }
 
@@ -513,23 +969,11 @@ static ssize_t emulate_writev(int fd, const struct iovec *iov, int iovcnt) {
   return nwritten;
 }
 
-static int process_dequeue() {
-  struct process *p;
-
-  list_foreach(p, &run_queue, task) {
-    list_remove(&p->task);
-    list_init(&p->task);
-
-    current_process = p;
-    return 1;
-  }
-
-  current_process = NULL;
-  return 0;
-}
 
 static uint32_t push_to_stack(uint32_t sp, void *data, size_t size) {
   uint32_t signal_sp = (sp - size) & ~((1 << 3) - 1);
+
+  process_prepare_write((void*)signal_sp, size);
   return (uint32_t)memcpy((void*)signal_sp, data, size);
 }
 
@@ -539,15 +983,28 @@ static uint32_t pop_from_stack(uint32_t sp, void *data, size_t size) {
 }
 
 void process_init(void) {
+  int i, prio;
+
   current_process = NULL;
 
-  process_cache = slab_cache_create("process", sizeof(struct process));
+  vma_init();
+
+  process_cache = slab_cache_create_with("process", sizeof(struct process), CACHE_LINE_SIZE, NULL);
   file_cache    = slab_cache_create("file",    sizeof(struct file));
-  waitq_cache   = slab_cache_create("waitq",   sizeof(struct process_waitq_entry));
-  context_cache = slab_cache_create("context", sizeof(struct process_context));
 
   list_init(&all_processes);
-  list_init(&run_queue);
+  list_init(&sleepers);
+
+  for (i = 0; i < 2; ++i) {
+    memset(prio_arrays[i].bitmap, 0, sizeof(prio_arrays[i].bitmap));
+
+    for (prio = 0; prio < PRIO_LEVELS; ++prio) {
+      list_init(&prio_arrays[i].queues[prio]);
+    }
+  }
+
+  active_array = &prio_arrays[0];
+  expired_array = &prio_arrays[1];
 
   process_waitq_init(&child_waitq);
   memset(&terminal_config, 0, sizeof(struct termios));
@@ -584,47 +1041,140 @@ void *process_get_kernel_stack(struct process *process) {
   return process->kernel_stack + KERNEL_STACK_SIZE;
 }
 
-int process_create(const char *path) {
+static void set_tls(uint32_t tls) {
+  /* TPIDRURO */
+  __asm__ volatile ("MCR p15, 0, %[tls], c13, c0, 3 \n\t" : : [tls] "r"(tls) : "memory");
+}
+
+/* fills the freshly mapped address space of process, which must be the active one */
+static int start_image(struct process *process, struct elf_executable *executable, struct elf_executable *interpreter, struct argv_envp *avep) {
+  uint32_t auxv[AUXV_SIZE * 2];
+  void *stack;
+
+  if (elf_copy(executable) < 0 || elf_copy(interpreter) < 0 || protect_vmas(process) < 0) {
+    return -ENOMEM;
+  }
+
+  fill_auxv(auxv, executable, interpreter);
+  stack = copy_argv_and_envp(avep, (void*)STACK_END, auxv);
+  release_argv_and_envp(avep);
+
+  memset(&process->context, 0, sizeof(struct process_context));
+  process->context.cpsr = 0x00000010;
+  process->context.sp   = (uint32_t)stack;
+  process->context.pc   = interpreter->segment_num ? interpreter->entry_point : executable->entry_point;
+  process->tls = 0;
+
+  elf_release(executable);
+  elf_release(interpreter);
+  return 0;
+}
+
+static int create_process(struct process **pp, const char *path, char *const argv[], char *const envp[]) {
   pid_t old_pid;
   struct argv_envp avep;
-  struct elf_executable executable;
+  struct elf_executable executable, interpreter;
   struct process *process;
-  struct file *tty = NULL;
-  void *stack;
   int r;
 
-  char *const argv[] = {
-    (void*)path,
-    NULL,
-  };
-
-  if ((r = prepare_argv_and_envp(&avep, argv, NULL)) < 0) {
+  if ((r = prepare_argv_and_envp(&avep, argv, envp)) < 0) {
     return r;
   }
 
-  if (elf_load(path, &executable) < 0) {
+  if ((r = load_executable(path, &executable, &interpreter)) < 0) {
     release_argv_and_envp(&avep);
-    return -EACCES;
+    return r;
   }
 
-  process = process_alloc();
-  process->parent = process;
+  if (!(process = process_alloc())) {
+    r = -ENOMEM;
+    goto fail;
+  }
 
-  create_segments(process, &executable);
-  process->brk = process->segments[SEGMENT_TYPE_HEAP].start;
+  if ((r = create_vmas(process, &executable, &interpreter)) < 0) {
+    goto fail_process;
+  }
 
-  old_pid = mmu_set_ttb(process->id);
-  alloc_segments(process);
+  if ((old_pid = mmu_set_ttb(process->mm)) < 0) {
+    r = -ENOMEM;
+    goto fail_process;
+  }
 
-  elf_copy(&executable);
-  elf_release(&executable);
+  if ((r = alloc_vmas(process)) < 0 || (r = start_image(process, &executable, &interpreter, &avep)) < 0) {
+    mmu_set_ttb(old_pid);
+    goto fail_process;
+  }
 
-  stack = copy_argv_and_envp(&avep, (void*)STACK_END);
+  mmu_set_ttb(old_pid);
+
+  make_ready(process);
+  *pp = process;
+  return 0;
+
+fail_process:
+  process_free(process);
+fail:
+  elf_release(&executable);
+  elf_release(&interpreter);
   release_argv_and_envp(&avep);
+  return r;
+}
 
-  process->context.cpsr = 0x00000010;
-  process->context.sp   = (uint32_t)stack;
-  process->context.pc   = executable.entry_point;
+static struct process *duplicate_process(const struct process_context *context) {
+  int i;
+  struct process *process;
+
+  if (!(process = process_alloc())) {
+    return NULL;
+  }
+
+  if (vma_copy(&process->vmas, &current_process->vmas) < 0) {
+    process_free(process);
+    return NULL;
+  }
+
+  list_add(&current_process->children, &process->sibling);
+  process->parent = current_process;
+
+  memcpy(&process->context, context, sizeof(struct process_context));
+  process->context.r[0] = 0;
+
+  process->heap_start = current_process->heap_start;
+  process->brk = current_process->brk;
+  process->tls = current_process->tls;
+
+  memcpy(process->files, current_process->files, sizeof(struct file*) * MAX_FD_SIZE);
+  for (i = 0; i < MAX_FD_SIZE; ++i) {
+    if (process->files[i]) {
+      countup_file(process->files[i]);
+    }
+  }
+  memcpy(process->close_on_exec, current_process->close_on_exec, sizeof(process->close_on_exec));
+
+  memcpy(&process->signal, &current_process->signal, sizeof(struct process_signal));
+
+  process->nice = current_process->nice;
+  process->policy = current_process->policy;
+  process->rt_priority = current_process->rt_priority;
+  process->slice = NICE_TO_SLICE(process->nice);
+  return process;
+}
+
+int process_create(const char *path) {
+  struct process *process;
+  struct file *tty = NULL;
+  int r;
+
+  char *const argv[] = {
+    (void*)path,
+    NULL,
+  };
+
+  if ((r = create_process(&process, path, argv, NULL)) < 0) {
+    return r;
+  }
+
+  process->parent = process;
 
   if (create_tty(process) < 0 || (tty = process->files[0]) == NULL) {
     logger_fatal("broken file descriptors");
@@ -637,36 +1187,56 @@ int process_create(const char *path) {
   countup_file(tty);
   process->files[2] = tty;
 
-  mmu_set_ttb(old_pid);
+  return process->id;
+}
+
+/*
+ * Builds a child of the current process straight from an executable,
+ * so nothing of the caller's address space is shared or copied.
+ */
+pid_t process_spawn(const char *path, char *const argv[], char *const envp[]) {
+  int i, r;
+  struct process *process;
+
+  if ((r = create_process(&process, path, argv, envp)) < 0) {
+    return r;
+  }
+
+  list_add(&current_process->children, &process->sibling);
+  process->parent = current_process;
+
+  for (i = 0; i < MAX_FD_SIZE; ++i) {
+    if (current_process->files[i] && !bitset_test(current_process->close_on_exec, i)) {
+      countup_file(current_process->files[i]);
+      process->files[i] = current_process->files[i];
+    }
+  }
+
+  memcpy(&process->signal, &current_process->signal, sizeof(struct process_signal));
+  sigemptyset(&process->signal.pending);
+  reset_signal_handlers(process);
+
   return process->id;
 }
 
 int process_exec(const char *path, char *const argv[], char *const envp[]) {
   int i, r;
-  struct k_sigaction *ksa;
-  struct elf_executable executable;
+  struct elf_executable executable, interpreter;
   struct argv_envp avep;
   struct process *process = current_process;
-  void *stack;
 
   if ((r = prepare_argv_and_envp(&avep, argv, envp)) < 0) {
     return r;
   }
 
-  if (elf_load(path, &executable) < 0) {
+  if ((r = load_executable(path, &executable, &interpreter)) < 0) {
     release_argv_and_envp(&avep);
-    return -EACCES;
+    return r;
   }
 
-  create_segments(process, &executable);
-  process->brk = process->segments[SEGMENT_TYPE_HEAP].start;
-
-  for (i = 0; i < (NSIG-1); ++i) {
-    ksa = &process->signal.actions[i];
-    if (ksa->handler != SIG_DFL && ksa->handler != SIG_IGN) {
-      ksa->handler = SIG_DFL;
-    }
-  }
+  /* the old image is gone from here on, so a failure kills the process */
+  r = create_vmas(process, &executable, &interpreter);
+  reset_signal_handlers(process);
 
   for (i = 0; i < MAX_FD_SIZE; ++i) {
     if (process->files[i] && bitset_test(process->close_on_exec, i)) {
@@ -676,241 +1246,725 @@ int process_exec(const char *path, char *const argv[], char *const envp[]) {
     }
   }
 
-  mmu_destroy(process->id);
-  mmu_set_ttb(process->id);
-  alloc_segments(process);
+  if (process->vfork) {
+    release_vfork(process);
+  } else {
+    mmu_destroy(process->id);
+  }
 
-  elf_copy(&executable);
-  elf_release(&executable);
+  if (mmu_set_ttb(process->mm) < 0 && r >= 0) {
+    r = -ENOMEM;
+  }
 
-  stack = copy_argv_and_envp(&avep, (void*)STACK_END);
-  release_argv_and_envp(&avep);
+  if (r < 0 || (r = alloc_vmas(process)) < 0 || (r = start_image(process, &executable, &interpreter, &avep)) < 0) {
+    elf_release(&executable);
+    elf_release(&interpreter);
+    release_argv_and_envp(&avep);
 
-  memset(&process->context, 0, sizeof(struct process_context));
-  process->context.cpsr = 0x00000010;
-  process->context.sp   = (uint32_t)stack;
-  process->context.pc   = executable.entry_point;
+    process_exit(WAIT_SIGNAL(SIGKILL));
+    return r;
+  }
+
+  set_tls(process->tls);
 
   return 0;
 }
 
 pid_t process_fork(const struct process_context *context) {
-  int i;
-  struct process *process;
+  struct process *process = duplicate_process(context);
+
+  if (!process) {
+    return -ENOMEM;
+  }
+
+  if (mmu_fork(process->id, current_process->mm) < 0) {
+    exit_process(process, 0);
+    process_destroy(process);
+    return -ENOMEM;
+  }
+
+  make_ready(process);
+  return process->id;
+}
+
+/*
+ * The child runs on the parent's address space while the parent sleeps
+ * until the child calls execve or exits.
+ */
+pid_t process_vfork(const struct process_context *context, void *stack) {
+  struct process *process = duplicate_process(context);
+
+  if (!process) {
+    return -ENOMEM;
+  }
+
+  process->mm = current_process->mm;
+  process->vfork = true;
+  make_ready(process);
+
+  if (stack) {
+    process->context.sp = (uint32_t)stack;
+  }
+
+  while (process->vfork) {
+    process_sleep(&process->vfork_waitq);
+  }
+
+  return process->id;
+}
+
+/* a process sleeps on one queue at a time, so blocking never allocates */
+void process_sleep(struct process_waitq *waitq) {
+  struct process *process = current_process;
+  struct process_waitq_entry *entry = &process->waitq_entry;
+  struct process_context *suspend = &process->suspend_context;
+
+  entry->process = process;
+  entry->process->state = STATE_BLOCKED;
+
+  /* a yield only applies to the switch right after it */
+  process->yielded = false;
+  list_add(&waitq->next, &entry->next);
+
+  memset(suspend, 0, sizeof(struct process_context));
+  entry->process->suspend = suspend;
+
+  system_suspend((uint32_t)suspend);
+}
+
+int process_wake(struct process_waitq *waitq) {
+  struct process_waitq_entry *entry;
+
+  list_foreach(entry, &waitq->next, next) {
+    make_ready(entry->process);
+
+    list_remove(&entry->next);
+    return 1;
+  }
+
+  return 0;
+}
+
+void process_switch(void) {
+  uint64_t now = timer_get_usec();
+
+  if (current_process) {
+    account_process(current_process, now);
+  }
+
+  wake_sleepers(now);
+
+  /* the process that just left the CPU goes to the back of its queue */
+  if (current_process && current_process->state == STATE_READY && !current_process->array) {
+    requeue_process(current_process);
+  }
+
+  current_process = pick_next_process();
+  program_timer(current_process, now);
+
+  if (current_process) {
+    current_process->dispatched = now;
+    process_dispatch();
+  } else {
+    /* spare cycles go to zeroing pages until an interrupt is waiting */
+    while (!gic_irq_pending() && buddy_zero_idle());
+    system_idle();
+  }
+}
+
+pid_t process_wait(int *status) {
+  int exit_status;
+  struct process *p;
+  pid_t child_pid;
+
+  if (list_empty(&current_process->children)) {
+    return -ECHILD;
+  }
+
+  while (1) {
+    list_foreach(p, &current_process->children, sibling) {
+      if (p->state == STATE_DEAD) {
+        child_pid = p->id;
+        exit_status = p->exit_status;
+
+        process_destroy(p);
+
+        *status = exit_status;
+        return child_pid;
+      }
+    }
+
+    process_sleep(&child_waitq);
+  }
+}
+
+void process_exit(int status) {
+  exit_process(current_process, status);
+
+  if (list_length(&all_processes) == 1) {
+    system_shutdown();
+  }
+
+  process_wake(&child_waitq);
+}
+
+void process_dispatch(void) {
+  int sig;
+  uint32_t signal_sp;
+  sigset_t set;
+  struct k_sigaction *ksa;
+  struct process_context *context = &current_process->context;
+  struct process_context *suspend;
+
+  /* running on somebody else's table is never an option */
+  if (mmu_set_ttb(current_process->mm) < 0) {
+    process_exit(WAIT_SIGNAL(SIGKILL));
+    process_switch();
+    return;
+  }
+  set_tls(current_process->tls);
+
+  if (current_process->suspend) {
+    suspend = current_process->suspend;
+    current_process->suspend = NULL;
+
+    system_resume((uint32_t)suspend);
+  }
+
+  signotset(&set, &current_process->signal.mask);
+  sigandset(&set, &current_process->signal.pending, &set);
+
+  if ((sig = sigpeekset(&set))) {
+    ksa = &current_process->signal.actions[sig];
+
+    if (ksa->handler == SIG_DFL) {
+      switch (sig) {
+        case SIGCHLD:
+        case SIGURG:
+        case SIGWINCH:
+          break;
+
+        default:
+          process_exit(WAIT_SIGNAL(sig));
+          process_switch();
+          break;
+      }
+    } else if (ksa->handler != SIG_IGN) {
+      signal_sp = push_to_stack(context->sp, context, sizeof(struct process_context));
+      signal_sp = push_to_stack(signal_sp, &current_process->signal.mask, sizeof(sigset_t));
+
+      memset(context, 0, sizeof(struct process_context));
+      context->r[0] = (uint32_t)sig;
+      context->cpsr = 0x00000010;
+      context->sp   = (uint32_t)signal_sp;
+      context->lr   = (uint32_t)ksa->restorer;
+      context->pc   = (uint32_t)ksa->handler;
+
+      sigorset(&current_process->signal.mask, &current_process->signal.mask, &ksa->mask);
+      sigaddset(&current_process->signal.mask, sig);
+    }
+
+    sigdelset(&current_process->signal.pending, sig);
+  }
+
+  system_dispatch((uint32_t)context);
+}
+
+int process_set_tls(uint32_t tls) {
+  current_process->tls = tls;
+  set_tls(tls);
+
+  return 0;
+}
+
+pid_t process_getpid(void) {
+  return current_process->id;
+}
+
+pid_t process_getppid(void) {
+  return current_process->parent->id;
+}
+
+static struct process *find_priority_target(int which, pid_t who, int *error) {
+  struct process *p;
+
+  if (which != PRIO_PROCESS) {
+    *error = -EINVAL;
+    return NULL;
+  }
+
+  if (!(p = who ? find_process(who) : current_process)) {
+    *error = -ESRCH;
+  }
+
+  return p;
+}
+
+/* like Linux, the nice value comes back as 20 - nice so it is never negative */
+int process_getpriority(int which, pid_t who) {
+  int error;
+  struct process *p;
+
+  if (!(p = find_priority_target(which, who, &error))) {
+    return error;
+  }
+
+  return 20 - p->nice;
+}
+
+int process_setpriority(int which, pid_t who, int nice) {
+  int error;
+  struct process *p;
+
+  if (!(p = find_priority_target(which, who, &error))) {
+    return error;
+  }
+
+  set_nice(p, nice);
+  return 0;
+}
+
+static int check_sched_param(int policy, int priority) {
+  switch (policy) {
+    case SCHED_OTHER:
+      return priority ? -EINVAL : 0;
+
+    case SCHED_FIFO:
+    case SCHED_RR:
+      return (priority < RT_PRIO_MIN || priority > RT_PRIO_MAX) ? -EINVAL : 0;
+
+    default:
+      return -EINVAL;
+  }
+}
+
+/*
+ * There are no credentials to check, so any process may take any policy
+ * and priority, including a SCHED_FIFO 99 that never gives up the CPU.
+ */
+int process_sched_setscheduler(pid_t pid, int policy, int priority) {
+  int error;
+  struct process *p;
+
+  if (pid < 0) {
+    return -EINVAL;
+  }
+
+  if ((error = check_sched_param(policy, priority)) < 0) {
+    return error;
+  }
+
+  if (!(p = find_priority_target(PRIO_PROCESS, pid, &error))) {
+    return error;
+  }
+
+  set_scheduler(p, policy, priority);
+  return 0;
+}
+
+int process_sched_getscheduler(pid_t pid) {
+  int error;
+  struct process *p;
+
+  if (pid < 0) {
+    return -EINVAL;
+  }
+
+  if (!(p = find_priority_target(PRIO_PROCESS, pid, &error))) {
+    return error;
+  }
+
+  return p->policy;
+}
+
+int process_sched_setparam(pid_t pid, int priority) {
+  int error;
+  struct process *p;
+
+  if (pid < 0) {
+    return -EINVAL;
+  }
+
+  if (!(p = find_priority_target(PRIO_PROCESS, pid, &error))) {
+    return error;
+  }
+
+  if ((error = check_sched_param(p->policy, priority)) < 0) {
+    return error;
+  }
+
+  set_scheduler(p, p->policy, priority);
+  return 0;
+}
+
+int process_sched_getparam(pid_t pid) {
+  int error;
+  struct process *p;
+
+  if (pid < 0) {
+    return -EINVAL;
+  }
+
+  if (!(p = find_priority_target(PRIO_PROCESS, pid, &error))) {
+    return error;
+  }
+
+  return p->rt_priority;
+}
+
+int process_sched_yield(void) {
+  current_process->yielded = true;
+  return 0;
+}
+
+int process_sched_get_priority_max(int policy) {
+  switch (policy) {
+    case SCHED_OTHER: return 0;
+    case SCHED_FIFO:
+    case SCHED_RR:    return RT_PRIO_MAX;
+    default:          return -EINVAL;
+  }
+}
+
+int process_sched_get_priority_min(int policy) {
+  switch (policy) {
+    case SCHED_OTHER: return 0;
+    case SCHED_FIFO:
+    case SCHED_RR:    return RT_PRIO_MIN;
+    default:          return -EINVAL;
+  }
+}
+
+/* only SCHED_RR has a fixed quantum, the others report zero */
+int process_sched_rr_get_interval(pid_t pid, struct timespec *tp) {
+  int error;
+  struct process *p;
+
+  if (pid < 0) {
+    return -EINVAL;
+  }
+
+  if (!(p = find_priority_target(PRIO_PROCESS, pid, &error))) {
+    return error;
+  }
+
+  tp->tv_sec = 0;
+  tp->tv_nsec = 0;
+
+  if (p->policy == SCHED_RR) {
+    tp->tv_sec = RR_QUANTUM_USEC / 1000000;
+    tp->tv_nsec = (RR_QUANTUM_USEC % 1000000) * 1000;
+  }
+
+  return 0;
+}
+
+/* blocks the current process until the clock reaches deadline */
+int process_sleep_until(uint64_t deadline) {
+  struct process *p;
+
+  if (deadline <= timer_get_usec()) {
+    return 0;
+  }
+
+  current_process->wake_at = deadline;
+
+  list_foreach(p, &sleepers, sleeping) {
+    if (p->wake_at > deadline) {
+      break;
+    }
+  }
+  list_add(p->sleeping.prev, &current_process->sleeping);
+
+  process_sleep(&current_process->sleep_waitq);
+  return 0;
+}
+
+int process_nice(int increment) {
+  if (increment > NICE_LEVELS) {
+    increment = NICE_LEVELS;
+  } else if (increment < -NICE_LEVELS) {
+    increment = -NICE_LEVELS;
+  }
+
+  set_nice(current_process, current_process->nice + increment);
+  return 0;
+}
+
+uint32_t process_brk(uint32_t address) {
+  uint32_t current_brk = (uint32_t)current_process->brk;
+  uint8_t *start = current_process->heap_start;
+  uint8_t *old_end = (uint8_t*)PAGE_ALIGN(current_brk);
+  uint8_t *end;
 
-  process = process_alloc();
+  struct vma *vma;
 
-  list_add(&current_process->children, &process->sibling);
-  process->parent = current_process;
+  if ((address < (uint32_t)start) || (address >= (uint32_t)BRK_ADDRESS_END)) {
+    return current_brk;
+  }
 
-  memcpy(&process->context, context, sizeof(struct process_context));
-  process->context.r[0] = 0;
+  end = (uint8_t*)PAGE_ALIGN(address);
 
-  process->brk = current_process->brk;
-  memcpy(process->segments, current_process->segments, sizeof(struct segment) * SEGMENT_TYPE_SIZE);
-  copy_segments(process, current_process);
+  /* growing only moves the limit, pages are mapped on first touch */
+  if (end > old_end) {
+    if (!vma_is_free(&current_process->vmas, old_end, end)) {
+      return current_brk;
+    }
 
-  memcpy(process->files, current_process->files, sizeof(struct file*) * MAX_FD_SIZE);
-  for (i = 0; i < MAX_FD_SIZE; ++i) {
-    if (process->files[i]) {
-      countup_file(process->files[i]);
+    vma = old_end > start ? find_vma(old_end - 1) : NULL;
+
+    if (vma && (vma->flags & VMA_FLAGS_HEAP) && vma->end == old_end) {
+      vma->end = end;
+    } else if (!vma_create(&current_process->vmas, old_end, old_end, end, VMA_FLAGS_GROWSUP | VMA_FLAGS_READ | VMA_FLAGS_WRITE | VMA_FLAGS_HEAP)) {
+      return current_brk;
     }
+  } else if (end < old_end && unmap_vmas(current_process, end, old_end) < 0) {
+    return current_brk;
   }
 
-  memcpy(&process->signal, &current_process->signal, sizeof(struct process_signal));
-  return process->id;
+  current_process->brk = (uint8_t*)address;
+
+  return address;
 }
 
-void process_sleep(struct process_waitq *waitq) {
-  struct process *process = current_process;
-  struct process_waitq_entry *entry = slab_cache_alloc(waitq_cache);
-  struct process_context *suspend = slab_cache_alloc(context_cache);
+uint32_t process_mmap(void *addr, size_t length, int prot, int flags, int fd, uint32_t pgoff) {
+  uint8_t *start = (uint8_t*)PAGE_MASK((uint32_t)addr);
+  size_t size = PAGE_ALIGN(length);
 
-  entry->process = process;
-  entry->process->state = STATE_BLOCKED;
-  list_add(&waitq->next, &entry->next);
+  struct file *file;
+  struct inode *inode = NULL;
+  struct vma *vma;
+  uint32_t vma_flags = VMA_FLAGS_GROWSUP | prot_to_vma_flags(prot);
 
-  memset(suspend, 0, sizeof(struct process_context));
-  entry->process->suspend = suspend;
+  if (length == 0 || size < length || ((flags & MAP_FIXED) && start != addr)) {
+    return -EINVAL;
+  }
 
-  system_suspend((uint32_t)suspend);
-}
+  switch (flags & MAP_TYPE) {
+  case MAP_PRIVATE:
+    break;
+  case MAP_SHARED:
+    vma_flags |= VMA_FLAGS_SHARED;
+    break;
+  default:
+    return -EINVAL;
+  }
 
-int process_wake(struct process_waitq *waitq) {
-  struct process_waitq_entry *entry;
+  if (!(flags & MAP_ANONYMOUS)) {
+    if (!(file = get_file(fd))) {
+      return -EBADF;
+    }
 
-  list_foreach(entry, &waitq->next, next) {
-    entry->process->state = STATE_READY;
+    if (file->type != FF_INODE || !S_ISREG(file->dentry->inode->mode)) {
+      return -ENODEV;
+    }
 
-    list_remove(&entry->next);
-    slab_cache_free(waitq_cache, entry);
+    if (!FILE_FOR_READ(file) || ((flags & MAP_SHARED) && (prot & PROT_WRITE) && !FILE_FOR_WRITE(file))) {
+      return -EACCES;
+    }
 
-    return 1;
+    if (pgoff > (0xffffffff - size) / PAGE_SIZE) {
+      return -EOVERFLOW;
+    }
+
+    inode = file->dentry->inode;
+  } else if (flags & MAP_SHARED) {
+    /* shared anonymous memory needs an object to hang its pages on */
+    return -ENODEV;
   }
 
-  return 0;
-}
+  if (flags & MAP_FIXED) {
+    if (!is_user_range(start, size) || mmu_find_kernel_section((uint32_t)start, size)) {
+      return -EINVAL;
+    }
+    if (unmap_vmas(current_process, start, start + size) < 0) {
+      return -ENOMEM;
+    }
+  } else if (!addr || !is_user_range(start, size) || mmu_find_kernel_section((uint32_t)start, size) ||
+             !vma_is_free(&current_process->vmas, start, start + size)) {
+    if (!(start = find_mmap_area(current_process, size))) {
+      return -ENOMEM;
+    }
+  }
 
-void process_switch(void) {
-  if (list_empty(&run_queue)) {
-    process_schedule();
+  if (!(vma = vma_create(&current_process->vmas, start, start, start + size, vma_flags))) {
+    return -ENOMEM;
   }
 
-  if (process_dequeue()) {
-    process_dispatch();
-  } else {
-    system_idle();
+  if (inode) {
+    vma->inode  = inode;
+    vma->offset = pgoff * PAGE_SIZE;
   }
+
+  return (uint32_t)start;
 }
 
-void process_schedule(void) {
-  struct process *p;
+int process_munmap(void *addr, size_t length) {
+  uint8_t *start = addr;
+  size_t size = PAGE_ALIGN(length);
 
-  list_foreach(p, &all_processes, next) {
-    if (p->state == STATE_READY) {
-      list_add(&run_queue, &p->task);
-    }
+  if (length == 0 || size < length || start != (uint8_t*)PAGE_MASK((uint32_t)addr) || !is_user_range(start, size)) {
+    return -EINVAL;
   }
+
+  return unmap_vmas(current_process, start, start + size);
 }
 
-pid_t process_wait(int *status) {
-  int exit_status;
-  struct process *p;
-  pid_t child_pid;
+int process_mprotect(void *addr, size_t length, int prot) {
+  uint8_t *start = addr;
+  size_t size = PAGE_ALIGN(length);
 
-  if (list_empty(&current_process->children)) {
-    return -ECHILD;
+  if (size < length || start != (uint8_t*)PAGE_MASK((uint32_t)addr) || !is_user_range(start, size)) {
+    return -EINVAL;
   }
 
-  while (1) {
-    list_foreach(p, &current_process->children, sibling) {
-      if (p->state == STATE_DEAD) {
-        child_pid = p->id;
-        exit_status = p->exit_status;
+  if (!is_mapped_range(current_process, start, start + size)) {
+    return -ENOMEM;
+  }
 
-        process_destroy(p);
+  if (vma_protect(&current_process->vmas, start, start + size, prot_to_vma_flags(prot)) < 0 ||
+      mmu_protect(current_process->mm, (uint32_t)start, size, prot != PROT_NONE) < 0) {
+    return -ENOMEM;
+  }
 
-        *status = exit_status;
-        return child_pid;
-      }
-    }
+  return 0;
+}
 
-    process_sleep(&child_waitq);
+uint32_t process_mremap(void *old_address, size_t old_size, size_t new_size, int flags) {
+  uint8_t *start = old_address, *new_start;
+  size_t old_length = PAGE_ALIGN(old_size), new_length = PAGE_ALIGN(new_size);
+
+  struct vma *vma, *new_vma;
+  struct inode *inode;
+  uint32_t vma_flags;
+  size_t current, offset;
+
+  if (start != (uint8_t*)PAGE_MASK((uint32_t)old_address) || new_length == 0 || new_length < new_size || old_length < old_size) {
+    return -EINVAL;
   }
-}
 
-void process_exit(int status) {
-  int i;
-  struct file *file;
-  struct process *p = current_process;
+  if ((flags & ~MREMAP_MAYMOVE) || old_length == 0) {
+    return -EINVAL;
+  }
 
-  p->state = STATE_DEAD;
-  p->exit_status = status;
+  /* the whole range must lie in a single mapping */
+  vma = find_vma(start);
 
-  for (i = 0; i < MAX_FD_SIZE; ++i) {
-    file = p->files[i];
+  if (!vma || start + old_length > vma->end || (vma->flags & (VMA_FLAGS_GROWSDOWN | VMA_FLAGS_HEAP))) {
+    return -EFAULT;
+  }
 
-    if (file) {
-      p->files[i] = NULL;
-      release_file(file);
+  if (new_length <= old_length) {
+    if (unmap_vmas(current_process, start + new_length, start + old_length) < 0) {
+      return -ENOMEM;
     }
+    return (uint32_t)start;
   }
 
-  if (list_length(&all_processes) == 1) {
-    system_shutdown();
+  if (start + old_length == vma->end && is_user_range(start, new_length) &&
+      !mmu_find_kernel_section((uint32_t)start, new_length) &&
+      vma_is_free(&current_process->vmas, vma->end, start + new_length)) {
+    vma->end = start + new_length;
+    return (uint32_t)start;
   }
 
-  process_wake(&child_waitq);
-}
+  if (!(flags & MREMAP_MAYMOVE)) {
+    return -ENOMEM;
+  }
 
-void process_dispatch(void) {
-  int sig;
-  uint32_t signal_sp;
-  sigset_t set;
-  struct k_sigaction *ksa;
-  struct process_context *context = &current_process->context;
-  struct process_context suspend, *t_suspend;
+  if (!(new_start = find_mmap_area(current_process, new_length))) {
+    return -ENOMEM;
+  }
 
-  mmu_set_ttb(current_process->id);
+  /* populated pages move with their descriptors, the rest stays lazy */
+  vma_flags = vma->flags;
+  inode  = vma->inode;
+  offset = vma->offset + (size_t)(start - vma->start);
 
-  if (current_process->suspend) {
-    t_suspend = current_process->suspend;
-    current_process->suspend = NULL;
+  current = vma->current < start ? 0 : (size_t)(vma->current - start);
+  current = current < old_length ? current : old_length;
 
-    memcpy(&suspend, t_suspend, sizeof(struct process_context));
-    slab_cache_free(context_cache, t_suspend);
+  /* the destination exists before the source goes, so running out of memory changes nothing */
+  if (!(new_vma = vma_create(&current_process->vmas, new_start, new_start + current, new_start + new_length, vma_flags))) {
+    return -ENOMEM;
+  }
 
-    system_resume((uint32_t)&suspend);
+  if (mmu_move(current_process->mm, (uint32_t)start, (uint32_t)new_start, old_length) < 0) {
+    vma_remove(&current_process->vmas, new_start, new_start + new_length);
+    return -ENOMEM;
   }
 
-  signotset(&set, &current_process->signal.mask);
-  sigandset(&set, &current_process->signal.pending, &set);
+  /* moving the pages back only fills the slots they left */
+  if (vma_remove(&current_process->vmas, start, start + old_length) < 0) {
+    mmu_move(current_process->mm, (uint32_t)new_start, (uint32_t)start, old_length);
+    vma_remove(&current_process->vmas, new_start, new_start + new_length);
+    return -ENOMEM;
+  }
 
-  if ((sig = sigpeekset(&set))) {
-    ksa = &current_process->signal.actions[sig];
+  if (inode) {
+    new_vma->inode  = inode;
+    new_vma->offset = offset;
+  }
 
-    if (ksa->handler == SIG_DFL) {
-      switch (sig) {
-        case SIGCHLD:
-        case SIGURG:
-        case SIGWINCH:
-          break;
+  return (uint32_t)new_start;
+}
 
-        default:
-          process_exit(WAIT_SIGNAL(sig));
-          process_switch();
-          break;
-      }
-    } else if (ksa->handler != SIG_IGN) {
-      signal_sp = push_to_stack(context->sp, context, sizeof(struct process_context));
-      signal_sp = push_to_stack(signal_sp, &current_process->signal.mask, sizeof(sigset_t));
+int process_msync(void *addr, size_t length, int flags) {
+  uint8_t *start = addr, *end;
 
-      memset(context, 0, sizeof(struct process_context));
-      context->r[0] = (uint32_t)sig;
-      context->cpsr = 0x00000010;
-      context->sp   = (uint32_t)signal_sp;
-      context->lr   = (uint32_t)ksa->restorer;
-      context->pc   = (uint32_t)ksa->handler;
+  if (start != (uint8_t*)PAGE_MASK((uint32_t)addr) || !is_user_range(start, length)) {
+    return -EINVAL;
+  }
 
-      sigorset(&current_process->signal.mask, &current_process->signal.mask, &ksa->mask);
-      sigaddset(&current_process->signal.mask, sig);
-    }
+  if ((flags & ~(MS_ASYNC | MS_INVALIDATE | MS_SYNC)) || ((flags & MS_ASYNC) && (flags & MS_SYNC))) {
+    return -EINVAL;
+  }
 
-    sigdelset(&current_process->signal.pending, sig);
+  end = (uint8_t*)PAGE_ALIGN((uint32_t)start + length);
+
+  if (!is_mapped_range(current_process, start, end)) {
+    return -ENOMEM;
   }
 
-  system_dispatch((uint32_t)context);
-}
+  /* block writes are synchronous, so MS_ASYNC is as good as MS_SYNC */
+  sync_vmas(current_process, start, end);
 
-pid_t process_getpid(void) {
-  return current_process->id;
+  return 0;
 }
 
-pid_t process_getppid(void) {
-  return current_process->parent->id;
-}
+int process_madvise(void *addr, size_t length, int advice) {
+  uint8_t *start = addr, *end;
+  struct vma *vma;
 
-uint32_t process_brk(uint32_t address) {
-  struct segment *segment = &current_process->segments[SEGMENT_TYPE_HEAP];
-  uint32_t current_brk = (uint32_t)current_process->brk;
-  pid_t pid = current_process->id;
+  if (start != (uint8_t*)PAGE_MASK((uint32_t)addr) || !is_user_range(start, length)) {
+    return -EINVAL;
+  }
 
-  if ((address < current_brk) || (address >= (uint32_t)BRK_ADDRESS_END)) {
-    return current_brk;
+  if (advice != MADV_DONTNEED) {
+    return 0;
   }
 
-  current_process->brk = (uint8_t*)address;
+  end = (uint8_t*)PAGE_ALIGN((uint32_t)start + length);
+
+  if (!is_mapped_range(current_process, start, end)) {
+    return -ENOMEM;
+  }
 
-  if (segment->end < current_process->brk) {
-    segment->end = (uint8_t*)PAGE_ALIGN((uint32_t)current_process->brk);
+  /* only lazily mapped parts can be dropped and refilled with zeros */
+  for (; start < end; start = vma->end) {
+    vma = find_vma(start);
 
-    while (segment->current < segment->end) {
-      mmu_alloc(pid, (uint32_t)segment->current, PAGE_SIZE);
-      segment->current += PAGE_SIZE;
+    if ((vma->flags & VMA_FLAGS_GROWSUP) && vma->current < vma->end) {
+      uint8_t *from = start > vma->current ? start : vma->current;
+      uint8_t *to   = end < vma->end ? end : vma->end;
+
+      if (from < to) {
+        mmu_free(current_process->mm, (uint32_t)from, (uint32_t)(to - from));
+      }
     }
   }
 
-  return address;
+  return 0;
 }
 
 int process_open(const char *path, int flags, mode_t mode) {
@@ -950,9 +2004,9 @@ int process_open(const char *path, int flags, mode_t mode) {
   file->type   = FF_INODE;
   file->dentry = dentry;
 
-  if (flags & O_TRUNC) {
-    r = inode_truncate(dentry->inode, 0);
-    SYSTEM_BUG_ON(r < 0);
+  if ((flags & O_TRUNC) && (r = inode_truncate(dentry->inode, 0)) < 0) {
+    process_close(fd);
+    return r;
   }
 
   if (flags & O_CLOEXEC) {
@@ -1445,7 +2499,12 @@ int process_pipe2(int *pipefd, int flags) {
     return wfd;
   }
 
-  pipe = pipe_create();
+  if (!(pipe = pipe_create())) {
+    process_close(wfd);
+    process_close(rfd);
+    return -ENOMEM;
+  }
+
   rfile = current_process->files[rfd];
   wfile = current_process->files[wfd];
 
@@ -1465,34 +2524,191 @@ int process_pipe2(int *pipefd, int flags) {
   return 0;
 }
 
-bool process_demand_page(uint8_t *address) {
+static bool is_accessible(const struct vma *vma, bool write) {
+  return vma->flags & (write ? VMA_FLAGS_WRITE : VMA_FLAGS_PROT);
+}
+
+static size_t file_page_index(const struct vma *vma, const uint8_t *address) {
+  return (vma->offset + (size_t)((uint8_t*)PAGE_MASK((uint32_t)address) - vma->start)) / PAGE_SIZE;
+}
+
+/*
+ * Cached file pages are mapped in place. Private mappings get them
+ * read-only and copy on the first write, shared mappings mark them dirty
+ * when they become writable.
+ */
+static bool map_file_page(const struct vma *vma, uint8_t *address, bool write) {
+  pid_t pid = current_process->mm;
+  uint32_t addr = PAGE_MASK((uint32_t)address);
+  size_t index = file_page_index(vma, address);
+  bool shared = vma->flags & VMA_FLAGS_SHARED;
+  struct page *page;
+  int r;
+
+  if (index >= PAGE_ALIGN(vma->inode->size) / PAGE_SIZE) {
+    return false;
+  }
+
+  if (!(page = inode_get_page(vma->inode, index))) {
+    return false;
+  }
+
+  /* held across the mapping, where reclaim could otherwise drop it from the cache */
+  page_get(page);
+  r = mmu_map_page(pid, addr, page, shared && write);
+  page_put(page);
+
+  if (r < 0) {
+    return false;
+  }
+
+  if (vma->flags & VMA_FLAGS_EXEC) {
+    cache_sync_icache((void*)addr, PAGE_SIZE);
+  }
+
+  if (shared && write) {
+    inode_dirty_page(vma->inode, index);
+  } else if (write) {
+    mmu_copy_on_write(pid, addr);
+  }
+
+  return true;
+}
+
+bool process_demand_page(uint8_t *address, bool write) {
   uint8_t *base;
 
-  pid_t pid = current_process->id;
-  struct segment *segment = find_segment(address);
+  pid_t pid = current_process->mm;
+  struct vma *vma = find_vma(address);
 
-  if (!segment) {
+  if (!vma || !is_accessible(vma, write)) {
     return false;
   }
 
-  if (segment->flags & SEGMENT_FLAGS_GROWSDOWN) {
+  if (vma->flags & VMA_FLAGS_GROWSDOWN) {
     base = (void*)PAGE_MASK((uint32_t)address);
 
-    if (address < segment->start && address >= segment->current) {
+    while (vma->current > base) {
+      if (mmu_alloc(pid, (uint32_t)vma->current - PAGE_SIZE, PAGE_SIZE) < 0) {
+        return false;
+      }
+      vma->current -= PAGE_SIZE;
+    }
+
+    return true;
+  }
+
+  if (vma->inode) {
+    return map_file_page(vma, address, write);
+  }
+
+  if (address >= vma->current) {
+    return mmu_alloc_zero_page(pid, PAGE_MASK((uint32_t)address), write) == 0;
+  }
+
+  return false;
+}
+
+bool process_copy_on_write(uint8_t *address) {
+  struct vma *vma = find_vma(address);
+
+  if (!vma || !(vma->flags & VMA_FLAGS_WRITE)) {
+    return false;
+  }
+
+  if (vma->inode && (vma->flags & VMA_FLAGS_SHARED)) {
+    inode_dirty_page(vma->inode, file_page_index(vma, address));
+    return mmu_set_writable(current_process->mm, (uint32_t)address);
+  }
+
+  return mmu_copy_on_write(current_process->mm, (uint32_t)address);
+}
+
+/*
+ * The kernel cannot resume from its own aborts, so lazy pages are mapped
+ * and shared pages are unshared before it touches user memory. A page
+ * that cannot be allocated fails the access instead.
+ */
+static bool prepare_access(const void *address, size_t size, bool write) {
+  uint32_t addr = PAGE_MASK((uint32_t)address), end = (uint32_t)address + size;
+  pid_t pid = current_process->mm;
+  struct vma *vma;
+
+  for (; addr < end; addr += PAGE_SIZE) {
+    if (!(vma = find_vma((uint8_t*)addr)) || !is_accessible(vma, write)) {
       return false;
     }
 
-    while (segment->current > base) {
-      segment->current -= PAGE_SIZE;
-      mmu_alloc(pid, (uint32_t)segment->current, PAGE_SIZE);
+    if (!mmu_is_accessible(pid, addr, false) && !process_demand_page((uint8_t*)addr, write)) {
+      return false;
     }
 
-    return true;
+    if (write && !mmu_is_accessible(pid, addr, true) && !process_copy_on_write((uint8_t*)addr)) {
+      return false;
+    }
   }
 
-  return false;
+  return true;
+}
+
+bool process_prepare_read(const void *address, size_t size) {
+  return prepare_access(address, size, false);
+}
+
+bool process_prepare_write(void *address, size_t size) {
+  return prepare_access(address, size, true);
 }
 
 void process_waitq_init(struct process_waitq *waitq) {
   list_init(&waitq->next);
 }
+
+/*
+ * Frees memory by killing the process with the largest address space.
+ * Only a runnable process sitting at the user boundary can be torn down
+ * in place, anything else is left a SIGKILL to act on when it next runs.
+ */
+bool process_oom_kill(void) {
+  struct process *p, *victim = NULL;
+  struct mmu_stat stat;
+  size_t pages, victim_pages = 0;
+
+  if (!process_cache) {
+    return false;
+  }
+
+  list_foreach(p, &all_processes, next) {
+    if (p->state == STATE_DEAD || p->state == STATE_NEW || p->parent == p) {
+      continue;
+    }
+
+    /* a vfork child owns no address space of its own */
+    if (mmu_get_stat(p->id, &stat) < 0) {
+      continue;
+    }
+
+    /* large pages and sections span 16 and 256 small pages */
+    pages = stat.small_pages + (stat.large_pages * 16) + (stat.sections * 256);
+
+    if (pages > victim_pages) {
+      victim = p;
+      victim_pages = pages;
+    }
+  }
+
+  if (!victim) {
+    return false;
+  }
+
+  if (victim == current_process || victim->state != STATE_READY || victim->suspend) {
+    sigaddset(&victim->signal.pending, SIGKILL);
+    return false;
+  }
+
+  logger_warn("out of memory: killed pid=%d pages=%d", victim->id, victim_pages);
+
+  exit_process(victim, WAIT_SIGNAL(SIGKILL));
+  process_wake(&child_waitq);
+
+  return true;
+}
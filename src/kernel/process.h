@@ -50,16 +50,36 @@ void *process_get_kernel_stack(struct process *process);
 int process_create(const char *path);
 int process_exec(const char *path, char *const argv[], char *const envp[]);
 pid_t process_fork(const struct process_context *context);
+pid_t process_vfork(const struct process_context *context, void *stack);
+pid_t process_spawn(const char *path, char *const argv[], char *const envp[]);
 void process_sleep(struct process_waitq *waitq);
 int process_wake(struct process_waitq *waitq);
 void process_switch(void);
-void process_schedule(void);
 pid_t process_wait(int *status);
 void process_exit(int status);
 void process_dispatch(void);
 pid_t process_getpid(void);
 pid_t process_getppid(void);
+int process_getpriority(int which, pid_t who);
+int process_setpriority(int which, pid_t who, int nice);
+int process_sleep_until(uint64_t deadline);
+int process_nice(int increment);
+int process_sched_setscheduler(pid_t pid, int policy, int priority);
+int process_sched_getscheduler(pid_t pid);
+int process_sched_setparam(pid_t pid, int priority);
+int process_sched_getparam(pid_t pid);
+int process_sched_yield(void);
+int process_sched_get_priority_max(int policy);
+int process_sched_get_priority_min(int policy);
+int process_sched_rr_get_interval(pid_t pid, struct timespec *tp);
+int process_set_tls(uint32_t tls);
 uint32_t process_brk(uint32_t address);
+uint32_t process_mmap(void *addr, size_t length, int prot, int flags, int fd, uint32_t pgoff);
+int process_munmap(void *addr, size_t length);
+int process_mprotect(void *addr, size_t length, int prot);
+uint32_t process_mremap(void *old_address, size_t old_size, size_t new_size, int flags);
+int process_msync(void *addr, size_t length, int flags);
+int process_madvise(void *addr, size_t length, int advice);
 
 int process_open(const char *path, int flags, mode_t mode);
 int process_close(int fd);
@@ -84,7 +104,11 @@ int process_dup3(int oldfd, int newfd, int flags);
 int process_pipe(int *pipefd);
 int process_pipe2(int *pipefd, int flags);
 
-bool process_demand_page(uint8_t *address);
+bool process_demand_page(uint8_t *address, bool write);
+bool process_copy_on_write(uint8_t *address);
+bool process_oom_kill(void);
+bool process_prepare_read(const void *address, size_t size);
+bool process_prepare_write(void *address, size_t size);
 void process_waitq_init(struct process_waitq *waitq);
 
 #endif
@@ -0,0 +1,47 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "reclaim.h"
+#include "block.h"
+#include "inode.h"
+#include "process.h"
+#include "slab.h"
+
+static struct reclaim_stat reclaim_stat;
+
+/*
+ * Called by the page allocator when it runs dry. Clean cached pages go
+ * first; only when nothing is left to drop is a process killed.
+ */
+bool reclaim_memory(void) {
+  size_t freed;
+
+  if ((freed = block_shrink() + inode_shrink() + slab_shrink())) {
+    reclaim_stat.cache_pages += freed;
+    return true;
+  }
+
+  if (process_oom_kill()) {
+    reclaim_stat.oom_kills++;
+    return true;
+  }
+
+  return false;
+}
+
+void reclaim_get_stat(struct reclaim_stat *stat) {
+  *stat = reclaim_stat;
+}
@@ -0,0 +1,30 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _CYANURUS_RECLAIM_H_
+#define _CYANURUS_RECLAIM_H_
+
+#include "lib/type.h"
+
+struct reclaim_stat {
+  size_t cache_pages;
+  size_t oom_kills;
+};
+
+bool reclaim_memory(void);
+void reclaim_get_stat(struct reclaim_stat *stat);
+
+#endif
@@ -16,64 +16,128 @@ limitations under the License.
 
 #include "slab.h"
 #include "buddy.h"
+#include "cache.h"
 #include "logger.h"
+#include "lib/list.h"
+#include "lib/stdarg.h"
 #include "lib/string.h"
 #include "system.h"
 
-#define MAX_SLAB_NAME 32
 #define SLAB_FREE_END 0xffffffff
+#define SLAB_EMPTY_LIMIT 1
+
+#define KMALLOC_MIN_SHIFT 5
+/* a page or more is better served as a single buddy block than by a slab */
+#define KMALLOC_MAX_SHIFT 11
+#define KMALLOC_CLASSES (KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1)
 
 #define SLAB_HEADER_SIZE (sizeof(struct slab_header) + sizeof(uint32_t))
+#define SLAB_MIN_ALIGN 4
+
+#define ALIGN_UP(n, align) (((n) + ((align) - 1)) & ~((align) - 1))
 
 struct slab_header {
-  struct slab_header *next;
+  struct list next;
+  struct slab_cache *cache;
   uint32_t *free;
   uint8_t *object;
+  size_t inuse;
 };
 
 struct slab_cache {
   char name[MAX_SLAB_NAME];
 
   struct slab_cache *next;
+  struct list link;
 
   size_t slab_size;
   size_t object_size;
+  size_t object_num;
+  size_t align;
+
+  /* successive slabs shift their objects by color * align bytes */
+  size_t color_num;
+  size_t color_next;
+
+  void (*ctor)(void*);
+
+  struct list slabs_full;
+  struct list slabs_partial;
+  struct list slabs_empty;
 
-  struct slab_header *slabs_full;
-  struct slab_header *slabs_partial;
+  size_t empty_count;
+  size_t empty_limit;
+
+  size_t slab_count;
+  size_t allocs;
+  size_t frees;
+  size_t active;
+  size_t active_max;
 };
 
 static uint32_t slab_size_limits[PAGE_MAX_DEPTH] = {0};
 struct slab_cache *free_cache_head = NULL;
+static struct list slab_caches;
+static struct slab_cache *kmalloc_caches[KMALLOC_CLASSES];
 
-static size_t slab_max_object_num(const struct slab_cache *cache) {
-  return (cache->slab_size - SLAB_HEADER_SIZE) / (cache->object_size + sizeof(uint32_t));
-}
-
-static struct slab_header *slab_new(const struct slab_cache *cache) {
+static struct slab_header *slab_new(struct slab_cache *cache) {
+  struct page *page;
   struct slab_header *header;
-  size_t i, max_object_num = slab_max_object_num(cache);
+  size_t i, offset;
+
+  if (!(page = buddy_alloc(cache->slab_size))) {
+    return NULL;
+  }
 
-  header = (struct slab_header*)page_address(buddy_alloc(cache->slab_size));
-  memset(header, 0, sizeof(struct slab_header));
+  page->flags |= PF_SLAB;
+  cache->slab_count++;
 
+  header = memset(page_address(page), 0, sizeof(struct slab_header));
+
+  header->cache = (struct slab_cache*)cache;
   header->free = (void*)(header + 1);
-  header->object = (void*)(header->free + max_object_num + 1);
 
-  for (i = 0; i < max_object_num; ++i) {
+  offset = (uint8_t*)(header->free + cache->object_num + 1) - (uint8_t*)header;
+  offset = ALIGN_UP(offset, cache->align) + (cache->color_next * cache->align);
+  header->object = (uint8_t*)header + offset;
+
+  if (++cache->color_next >= cache->color_num) {
+    cache->color_next = 0;
+  }
+
+  for (i = 0; i < cache->object_num; ++i) {
     header->free[i] = i + 1;
   }
-  header->free[max_object_num] = SLAB_FREE_END;
+  header->free[cache->object_num] = SLAB_FREE_END;
+
+  if (cache->ctor) {
+    for (i = 0; i < cache->object_num; ++i) {
+      cache->ctor(header->object + (cache->object_size * i));
+    }
+  }
 
   return header;
 }
 
+static void slab_delete(struct slab_header *header) {
+  struct page *page = page_find_by_address(header);
+
+  header->cache->slab_count--;
+  page->flags &= ~PF_SLAB;
+  buddy_free(page);
+}
+
 static struct slab_cache *slab_cache_new(void) {
   size_t i;
+  struct page *page;
   struct slab_cache *cache;
 
   if (!free_cache_head) {
-    cache = memset(page_address(buddy_alloc(PAGE_SIZE)), 0, PAGE_SIZE);
+    if (!(page = buddy_alloc_zeroed(PAGE_SIZE))) {
+      return NULL;
+    }
+
+    cache = page_address(page);
 
     for (i = 0; i < (PAGE_SIZE / sizeof(struct slab_cache)) - 1; ++i) {
       cache[i].next = &cache[i+1];
@@ -96,8 +160,25 @@ static void slab_cache_delete(struct slab_cache *cache) {
   free_cache_head = cache;
 }
 
+static void slab_cache_release_empty(struct slab_cache *cache, size_t limit, size_t *freed) {
+  struct slab_header *header;
+
+  while (cache->empty_count > limit) {
+    header = container_of(cache->slabs_empty.next, struct slab_header, next);
+    list_remove(&header->next);
+    cache->empty_count--;
+
+    slab_delete(header);
+
+    if (freed) {
+      *freed += cache->slab_size / PAGE_SIZE;
+    }
+  }
+}
+
 void slab_cache_init(void) {
   size_t i, page_size;
+  char name[MAX_SLAB_NAME];
 
   for (i = 0; i < PAGE_MAX_DEPTH; ++i) {
     page_size = PAGE_SIZE * (1 << i);
@@ -105,24 +186,55 @@ void slab_cache_init(void) {
   }
 
   free_cache_head = NULL;
+  list_init(&slab_caches);
+
+  for (i = 0; i < KMALLOC_CLASSES; ++i) {
+    snprintf(name, sizeof(name), "kmalloc-%u", 1 << (KMALLOC_MIN_SHIFT + i));
+
+    if (!(kmalloc_caches[i] = slab_cache_create_with(name, 1 << (KMALLOC_MIN_SHIFT + i), CACHE_LINE_SIZE, NULL))) {
+      logger_fatal("cannot create %s", name);
+      system_halt();
+    }
+  }
 }
 
 struct slab_cache *slab_cache_create(const char *name, size_t size) {
+  return slab_cache_create_with(name, size, SLAB_MIN_ALIGN, NULL);
+}
+
+/*
+ * align must be a power of two. ctor runs once for every object when its
+ * slab is created, so objects have to be freed back in that state.
+ */
+struct slab_cache *slab_cache_create_with(const char *name, size_t size, size_t align, void (*ctor)(void*)) {
   int i;
+  size_t used;
   struct slab_cache *cache;
 
   if (!size) {
     return NULL;
   }
 
+  if (align < SLAB_MIN_ALIGN) {
+    align = SLAB_MIN_ALIGN;
+  }
+
+  if (align & (align - 1)) {
+    return NULL;
+  }
+
   if (strlen(name) >= MAX_SLAB_NAME) {
     return NULL;
   }
 
-  cache = slab_cache_new();
+  if (!(cache = slab_cache_new())) {
+    return NULL;
+  }
 
   strcpy(cache->name, name);
-  cache->object_size = (size + 0x3) & ~0x3;
+  cache->object_size = ALIGN_UP(size, align);
+  cache->align = align;
+  cache->ctor = ctor;
 
   for (i = 0; i < PAGE_MAX_DEPTH; ++i) {
     if (cache->object_size <= slab_size_limits[i]) {
@@ -132,29 +244,42 @@ struct slab_cache *slab_cache_create(const char *name, size_t size) {
   }
 
   if (!cache->slab_size) {
+    slab_cache_delete(cache);
     return NULL;
   }
 
+  cache->object_num = (cache->slab_size - SLAB_HEADER_SIZE - (align - SLAB_MIN_ALIGN)) / (cache->object_size + sizeof(uint32_t));
+
+  used = ALIGN_UP(SLAB_HEADER_SIZE + (cache->object_num * sizeof(uint32_t)), align);
+  used += cache->object_num * cache->object_size;
+  cache->color_num = ((cache->slab_size - used) / align) + 1;
+  cache->empty_limit = SLAB_EMPTY_LIMIT;
+
+  list_init(&cache->slabs_full);
+  list_init(&cache->slabs_partial);
+  list_init(&cache->slabs_empty);
+
+  list_add(&slab_caches, &cache->link);
+
   return cache;
 }
 
 void slab_cache_destroy(struct slab_cache *cache) {
   struct slab_header *header, *next_header;
 
-  header = cache->slabs_full;
-  while (header) {
-    next_header = header->next;
-    buddy_free(page_find_by_address(header));
-    header = next_header;
+  list_foreach_safe(header, next_header, &cache->slabs_full, next) {
+    slab_delete(header);
+  }
+
+  list_foreach_safe(header, next_header, &cache->slabs_partial, next) {
+    slab_delete(header);
   }
 
-  header = cache->slabs_partial;
-  while (header) {
-    next_header = header->next;
-    buddy_free(page_find_by_address(header));
-    header = next_header;
+  list_foreach_safe(header, next_header, &cache->slabs_empty, next) {
+    slab_delete(header);
   }
 
+  list_remove(&cache->link);
   slab_cache_delete(cache);
 }
 
@@ -162,11 +287,19 @@ void *slab_cache_alloc(struct slab_cache *cache) {
   struct slab_header *header;
   uint32_t index, next_index, *free_list;
 
-  header = cache->slabs_partial;
-
-  if (!header) {
-    header = slab_new(cache);
-    cache->slabs_partial = header;
+  if (!list_empty(&cache->slabs_partial)) {
+    header = container_of(cache->slabs_partial.next, struct slab_header, next);
+  } else if (!list_empty(&cache->slabs_empty)) {
+    header = container_of(cache->slabs_empty.next, struct slab_header, next);
+    list_remove(&header->next);
+    list_add(&cache->slabs_partial, &header->next);
+    cache->empty_count--;
+  } else {
+    if (!(header = slab_new(cache))) {
+      return NULL;
+    }
+    /* reclaim inside slab_new may have freed objects back into this cache */
+    list_add(&cache->slabs_partial, &header->next);
   }
 
   free_list = (void*)(header + 1);
@@ -177,15 +310,14 @@ void *slab_cache_alloc(struct slab_cache *cache) {
   free_list[index] = SLAB_FREE_END;
   header->free = &free_list[next_index];
 
-  if (*header->free == SLAB_FREE_END) {
-    cache->slabs_partial = header->next;
+  if (++header->inuse == cache->object_num) {
+    list_remove(&header->next);
+    list_add(&cache->slabs_full, &header->next);
+  }
 
-    if (cache->slabs_full) {
-      header->next = cache->slabs_full;
-    } else {
-      header->next = NULL;
-    }
-    cache->slabs_full = header;
+  cache->allocs++;
+  if (++cache->active > cache->active_max) {
+    cache->active_max = cache->active;
   }
 
   return (header->object + (cache->object_size * index));
@@ -195,7 +327,9 @@ void slab_cache_free(struct slab_cache *cache, void *obj) {
   uint32_t index, next_index, *free_list;
 
   struct page *page = page_find_head(page_find_by_address(obj));
-  struct slab_header *header = (void*)page_address(page), *h, **hp;
+  struct slab_header *header = (void*)page_address(page);
+
+  SYSTEM_BUG_ON(!header->inuse);
 
   free_list = (void*)(header + 1);
 
@@ -205,25 +339,104 @@ void slab_cache_free(struct slab_cache *cache, void *obj) {
   free_list[index] = next_index;
   header->free = &free_list[index];
 
-  if (free_list[next_index] == SLAB_FREE_END) {
-    hp = &cache->slabs_full;
-    h = cache->slabs_full;
+  cache->frees++;
+  cache->active--;
+
+  if (header->inuse-- == cache->object_num) {
+    list_remove(&header->next);
+    list_add(&cache->slabs_partial, &header->next);
+  }
+
+  if (!header->inuse) {
+    list_remove(&header->next);
+    list_add(&cache->slabs_empty, &header->next);
+    cache->empty_count++;
+
+    slab_cache_release_empty(cache, cache->empty_limit, NULL);
+  }
+}
+
+/*
+ * Returns every cached empty slab to the page allocator. Each cache
+ * keeps up to empty_limit of them to absorb alloc/free churn, which is
+ * exactly what reclaim wants back when memory runs out.
+ */
+size_t slab_shrink(void) {
+  size_t freed = 0;
+  struct slab_cache *cache;
+
+  list_foreach(cache, &slab_caches, link) {
+    slab_cache_release_empty(cache, 0, &freed);
+  }
+
+  return freed;
+}
+
+/*
+ * General purpose allocations, rounded up to the next power of two. Sizes
+ * beyond the largest class go straight to the page allocator; PF_SLAB on
+ * the head page tells kfree which way a pointer came.
+ */
+void *kmalloc(size_t size) {
+  size_t i;
+  struct page *page;
+
+  for (i = 0; i < KMALLOC_CLASSES; ++i) {
+    if (size <= (1U << (KMALLOC_MIN_SHIFT + i))) {
+      return slab_cache_alloc(kmalloc_caches[i]);
+    }
+  }
 
-    while (h) {
-      if (h == header) {
-        *hp = h->next;
+  if (!(page = buddy_alloc(size))) {
+    return NULL;
+  }
 
-        h->next = cache->slabs_partial;
-        cache->slabs_partial = h;
+  return page_address(page);
+}
 
-        return;
-      }
+void kfree(void *ptr) {
+  struct page *page;
+  struct slab_header *header;
 
-      hp = &h->next;
-      h = h->next;
+  if (!ptr) {
+    return;
+  }
+
+  page = page_find_head(page_find_by_address(ptr));
+
+  if (page->flags & PF_SLAB) {
+    header = page_address(page);
+    slab_cache_free(header->cache, ptr);
+  } else {
+    buddy_free(page);
+  }
+}
+
+void kmalloc_cleanup(void *ptr) {
+  kfree(*(void**)ptr);
+}
+
+size_t slab_get_stat(struct slab_stat *stats, size_t max) {
+  size_t n = 0;
+  struct slab_cache *cache;
+
+  list_foreach(cache, &slab_caches, link) {
+    if (n >= max) {
+      break;
     }
 
-    logger_fatal("broken slab");
-    system_halt();
+    strcpy(stats[n].name, cache->name);
+    stats[n].object_size = cache->object_size;
+    stats[n].objects_per_slab = cache->object_num;
+    stats[n].allocs = cache->allocs;
+    stats[n].frees = cache->frees;
+    stats[n].active = cache->active;
+    stats[n].active_max = cache->active_max;
+    stats[n].slabs = cache->slab_count;
+    stats[n].empty_slabs = cache->empty_count;
+    stats[n].pages = cache->slab_count * (cache->slab_size / PAGE_SIZE);
+    n++;
   }
+
+  return n;
 }
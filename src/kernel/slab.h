@@ -18,11 +18,36 @@ limitations under the License.
 #define _CYANURUS_SLAB_H_
 
 #include "lib/type.h"
+#include "lib/extension.h"
+
+#define _kmalloc_cleanup_ _cleanup_(kmalloc_cleanup)
+
+#define MAX_SLAB_NAME 32
+
+struct slab_stat {
+  char name[MAX_SLAB_NAME];
+  size_t object_size;
+  size_t objects_per_slab;
+  size_t allocs;
+  size_t frees;
+  size_t active;
+  size_t active_max;
+  size_t slabs;
+  size_t empty_slabs;
+  size_t pages;
+};
 
 void slab_cache_init(void);
 struct slab_cache *slab_cache_create(const char *name, size_t size);
+struct slab_cache *slab_cache_create_with(const char *name, size_t size, size_t align, void (*ctor)(void*));
 void slab_cache_destroy(struct slab_cache *cache);
 void *slab_cache_alloc(struct slab_cache *cache);
 void slab_cache_free(struct slab_cache *cache, void *obj);
+size_t slab_shrink(void);
+size_t slab_get_stat(struct slab_stat *stats, size_t max);
+
+void *kmalloc(size_t size);
+void kfree(void *ptr);
+void kmalloc_cleanup(void *ptr);
 
 #endif
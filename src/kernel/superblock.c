@@ -19,15 +19,14 @@ limitations under the License.
 #include "block.h"
 #include "logger.h"
 #include "system.h"
-#include "buddy.h"
+#include "slab.h"
 
 #define SUPERBLOCK_ADDRESS 0x400
 
 struct minix3_superblock superblock;
 
 void superblock_init(void) {
-  _page_cleanup_ struct page *page = buddy_alloc(BLOCK_SIZE);
-  char *buf = page_address(page);
+  _kmalloc_cleanup_ char *buf = kmalloc(BLOCK_SIZE);
 
   SYSTEM_BUG_ON((SUPERBLOCK_ADDRESS + sizeof(struct minix3_superblock)) > BLOCK_SIZE);
 
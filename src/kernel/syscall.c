@@ -28,8 +28,16 @@ limitations under the License.
 #include "lib/termios.h"
 #include "lib/arithmetic.h"
 #include "user.h"
+#include "meminfo.h"
 
-static bool check_address_range(const void *p, size_t s) {
+/* private syscall in the ARM specific range, see also test-user */
+#define NR_ARM_SET_TLS      0x0f0005
+#define NR_CYANURUS_SPAWN   0x0f0100
+#define NR_CYANURUS_MEMINFO 0x0f0101
+
+#define IS_PAGE_START(p) (!((uint32_t)(p) & (PAGE_SIZE - 1)))
+
+static bool is_user_range(const void *p, size_t s) {
   const uint8_t *data = p;
 
   if (add_overflow_unsigned_long((unsigned long)data, s)) {
@@ -39,7 +47,25 @@ static bool check_address_range(const void *p, size_t s) {
   return IS_USER_ADDRESSS(data) && IS_USER_ADDRESSS(data + s);
 }
 
-static bool check_iovec(const struct iovec *iov, int iovcnt) {
+/* lazy pages must be mapped before the kernel reads them */
+static bool check_address_range(const void *p, size_t s) {
+  if (!is_user_range(p, s)) {
+    return false;
+  }
+
+  return process_prepare_read(p, s);
+}
+
+/* shared copy-on-write pages must be private before the kernel writes them */
+static bool check_writable_range(void *p, size_t s) {
+  if (!is_user_range(p, s)) {
+    return false;
+  }
+
+  return process_prepare_write(p, s);
+}
+
+static bool check_iovec(const struct iovec *iov, int iovcnt, bool writable) {
   int i;
 
   for (i = 0; i < iovcnt; ++i) {
@@ -47,8 +73,10 @@ static bool check_iovec(const struct iovec *iov, int iovcnt) {
       return false;
     }
 
-    if (iov->iov_len && !check_address_range(iov->iov_base, iov->iov_len)) {
-      return false;
+    if (iov->iov_len) {
+      if (writable ? !check_writable_range(iov->iov_base, iov->iov_len) : !check_address_range(iov->iov_base, iov->iov_len)) {
+        return false;
+      }
     }
 
     iov++;
@@ -58,16 +86,24 @@ static bool check_iovec(const struct iovec *iov, int iovcnt) {
 }
 
 static bool check_string(const char *s) {
+  const char *head = s;
+
   do {
     if (!IS_USER_ADDRESSS(s)) {
       return false;
     }
+
+    if ((s == head || IS_PAGE_START(s)) && !process_prepare_read(s, 1)) {
+      return false;
+    }
   } while (*s++);
 
   return true;
 }
 
 static bool check_avep(char **avep) {
+  char **head = avep;
+
   if (!avep) {
     return true;
   }
@@ -77,6 +113,10 @@ static bool check_avep(char **avep) {
       return false;
     }
 
+    if ((avep == head || IS_PAGE_START(avep)) && !process_prepare_read(avep, sizeof(char*))) {
+      return false;
+    }
+
     if (!*avep) {
       return true;
     }
@@ -101,6 +141,55 @@ void syscall_fork(struct process_context *context) {
   args[0] = process_fork(context);
 }
 
+void syscall_vfork(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+  args[0] = process_vfork(context, NULL);
+}
+
+void syscall_clone(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+
+  unsigned long flags = (unsigned long)args[0];
+  void *stack = (void*)args[1];
+
+  if ((flags & ~CSIGNAL) == (CLONE_VM|CLONE_VFORK)) {
+    args[0] = process_vfork(context, stack);
+  } else if (!(flags & ~CSIGNAL) && !stack) {
+    args[0] = process_fork(context);
+  } else {
+    args[0] = -EINVAL;
+  }
+}
+
+void syscall_spawn(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+
+  const char *path = (const char*)args[0];
+  char **argv = (char**)args[1];
+  char **envp = (char**)args[2];
+
+  if (!check_string(path) || !check_avep(argv) || !check_avep(envp)) {
+    args[0] = -EFAULT;
+    return;
+  }
+
+  args[0] = process_spawn(path, argv, envp);
+}
+
+void syscall_meminfo(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+
+  char *data = (char*)args[0];
+  size_t size = (size_t)args[1];
+
+  if (!check_writable_range(data, size)) {
+    args[0] = -EFAULT;
+    return;
+  }
+
+  args[0] = meminfo_format(data, size);
+}
+
 void syscall_read(struct process_context *context) {
   uint32_t *args = &context->r[0];
 
@@ -108,7 +197,7 @@ void syscall_read(struct process_context *context) {
   void *data = (void*)args[1];
   size_t size = (size_t)args[2];
 
-  if (!check_address_range(data, size)) {
+  if (!check_writable_range(data, size)) {
     args[0] = -EFAULT;
     return;
   }
@@ -193,6 +282,104 @@ void syscall_getppid(struct process_context *context) {
   args[0] = process_getppid();
 }
 
+void syscall_nice(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+  args[0] = process_nice((int)args[0]);
+}
+
+void syscall_getpriority(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+  args[0] = process_getpriority((int)args[0], (pid_t)args[1]);
+}
+
+void syscall_setpriority(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+  args[0] = process_setpriority((int)args[0], (pid_t)args[1], (int)args[2]);
+}
+
+void syscall_sched_setparam(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+
+  pid_t pid = (pid_t)args[0];
+  const struct sched_param *param = (const struct sched_param*)args[1];
+
+  if (!check_address_range(param, sizeof(struct sched_param))) {
+    args[0] = -EFAULT;
+    return;
+  }
+
+  args[0] = process_sched_setparam(pid, param->sched_priority);
+}
+
+void syscall_sched_getparam(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+
+  pid_t pid = (pid_t)args[0];
+  struct sched_param *param = (struct sched_param*)args[1];
+  int r;
+
+  if (!check_writable_range(param, sizeof(struct sched_param))) {
+    args[0] = -EFAULT;
+    return;
+  }
+
+  if ((r = process_sched_getparam(pid)) >= 0) {
+    param->sched_priority = r;
+    r = 0;
+  }
+
+  args[0] = r;
+}
+
+void syscall_sched_setscheduler(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+
+  pid_t pid = (pid_t)args[0];
+  int policy = (int)args[1];
+  const struct sched_param *param = (const struct sched_param*)args[2];
+
+  if (!check_address_range(param, sizeof(struct sched_param))) {
+    args[0] = -EFAULT;
+    return;
+  }
+
+  args[0] = process_sched_setscheduler(pid, policy, param->sched_priority);
+}
+
+void syscall_sched_getscheduler(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+  args[0] = process_sched_getscheduler((pid_t)args[0]);
+}
+
+void syscall_sched_yield(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+  args[0] = process_sched_yield();
+}
+
+void syscall_sched_get_priority_max(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+  args[0] = process_sched_get_priority_max((int)args[0]);
+}
+
+void syscall_sched_get_priority_min(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+  args[0] = process_sched_get_priority_min((int)args[0]);
+}
+
+void syscall_sched_rr_get_interval(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+
+  pid_t pid = (pid_t)args[0];
+  struct timespec *tp = (struct timespec*)args[1];
+
+  if (!check_writable_range(tp, sizeof(struct timespec))) {
+    args[0] = -EFAULT;
+    return;
+  }
+
+  args[0] = process_sched_rr_get_interval(pid, tp);
+}
+
 void syscall_kill(struct process_context *context) {
   uint32_t *args = &context->r[0];
 
@@ -253,7 +440,7 @@ void syscall_pipe(struct process_context *context) {
   uint32_t *args = &context->r[0];
   int *pipefd = (int*)args[0];
 
-  if (!check_address_range(pipefd, sizeof(int) * 2)) {
+  if (!check_writable_range(pipefd, sizeof(int) * 2)) {
     args[0] = -EFAULT;
     return;
   }
@@ -266,7 +453,7 @@ void syscall_pipe2(struct process_context *context) {
   int *pipefd = (int*)args[0];
   int flags = (int)args[1];
 
-  if (!check_address_range(pipefd, sizeof(int) * 2)) {
+  if (!check_writable_range(pipefd, sizeof(int) * 2)) {
     args[0] = -EFAULT;
     return;
   }
@@ -281,6 +468,76 @@ void syscall_brk(struct process_context *context) {
   args[0] = process_brk(address);
 }
 
+void syscall_set_tls(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+
+  uint32_t tls = (uint32_t)args[0];
+  args[0] = process_set_tls(tls);
+}
+
+void syscall_mmap2(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+
+  void *addr = (void*)args[0];
+  size_t length = (size_t)args[1];
+  int prot = (int)args[2];
+  int flags = (int)args[3];
+  int fd = (int)args[4];
+  uint32_t pgoff = (uint32_t)args[5];
+
+  args[0] = process_mmap(addr, length, prot, flags, fd, pgoff);
+}
+
+void syscall_munmap(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+
+  void *addr = (void*)args[0];
+  size_t length = (size_t)args[1];
+
+  args[0] = process_munmap(addr, length);
+}
+
+void syscall_mremap(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+
+  void *old_address = (void*)args[0];
+  size_t old_size = (size_t)args[1];
+  size_t new_size = (size_t)args[2];
+  int flags = (int)args[3];
+
+  args[0] = process_mremap(old_address, old_size, new_size, flags);
+}
+
+void syscall_mprotect(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+
+  void *addr = (void*)args[0];
+  size_t length = (size_t)args[1];
+  int prot = (int)args[2];
+
+  args[0] = process_mprotect(addr, length, prot);
+}
+
+void syscall_msync(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+
+  void *addr = (void*)args[0];
+  size_t length = (size_t)args[1];
+  int flags = (int)args[2];
+
+  args[0] = process_msync(addr, length, flags);
+}
+
+void syscall_madvise(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+
+  void *addr = (void*)args[0];
+  size_t length = (size_t)args[1];
+  int advice = (int)args[2];
+
+  args[0] = process_madvise(addr, length, advice);
+}
+
 void syscall_ioctl(struct process_context *context) {
   uint32_t *args = &context->r[0];
   int fd = (int)args[0];
@@ -292,13 +549,13 @@ void syscall_ioctl(struct process_context *context) {
     case TCSETS:
     case TCSETSW:
     case TCSETSF:
-      if (!check_address_range(argp, sizeof(struct termios))) {
+      if (!check_writable_range(argp, sizeof(struct termios))) {
         goto fail;
       }
       break;
 
     case TIOCGWINSZ:
-      if (!check_address_range(argp, sizeof(struct winsize))) {
+      if (!check_writable_range(argp, sizeof(struct winsize))) {
         goto fail;
       }
       break;
@@ -325,7 +582,7 @@ void syscall_rt_sigaction(struct process_context *context) {
     goto fail;
   }
 
-  if (ksa_old && !check_address_range(ksa_old, sizeof(struct k_sigaction))) {
+  if (ksa_old && !check_writable_range(ksa_old, sizeof(struct k_sigaction))) {
     goto fail;
   }
 
@@ -347,7 +604,7 @@ void syscall_rt_sigprocmask(struct process_context *context) {
     goto fail;
   }
 
-  if (oldset && !check_address_range(oldset, sizeof(sigset_t))) {
+  if (oldset && !check_writable_range(oldset, sizeof(sigset_t))) {
     goto fail;
   }
 
@@ -362,7 +619,7 @@ void syscall_wait4(struct process_context *context) {
   uint32_t *args = &context->r[0];
   int *status = (int*)args[1];
 
-  if (!check_address_range(status, sizeof(int))) {
+  if (!check_writable_range(status, sizeof(int))) {
     args[0] = -EFAULT;
     return;
   }
@@ -378,7 +635,7 @@ void syscall_uname(struct process_context *context) {
   uint32_t *args = &context->r[0];
   struct utsname *uts = (struct utsname *)args[0];
 
-  if (!check_address_range(uts, sizeof(struct utsname))) {
+  if (!check_writable_range(uts, sizeof(struct utsname))) {
     args[0] = -EFAULT;
     return;
   }
@@ -386,6 +643,48 @@ void syscall_uname(struct process_context *context) {
   args[0] = system_uname(uts);
 }
 
+void syscall_clock_gettime(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+
+  clockid_t clock_id = (clockid_t)args[0];
+  struct timespec *tp = (struct timespec *)args[1];
+
+  if (!check_writable_range(tp, sizeof(struct timespec))) {
+    args[0] = -EFAULT;
+    return;
+  }
+
+  args[0] = system_clock_gettime(clock_id, tp);
+}
+
+void syscall_nanosleep(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+
+  const struct timespec *req = (const struct timespec *)args[0];
+
+  if (!check_address_range(req, sizeof(struct timespec))) {
+    args[0] = -EFAULT;
+    return;
+  }
+
+  args[0] = system_clock_nanosleep(CLOCK_MONOTONIC, 0, req);
+}
+
+void syscall_clock_nanosleep(struct process_context *context) {
+  uint32_t *args = &context->r[0];
+
+  clockid_t clock_id = (clockid_t)args[0];
+  int flags = (int)args[1];
+  const struct timespec *req = (const struct timespec *)args[2];
+
+  if (!check_address_range(req, sizeof(struct timespec))) {
+    args[0] = -EFAULT;
+    return;
+  }
+
+  args[0] = system_clock_nanosleep(clock_id, flags, req);
+}
+
 void syscall_readv(struct process_context *context) {
   uint32_t *args = &context->r[0];
 
@@ -393,7 +692,7 @@ void syscall_readv(struct process_context *context) {
   const struct iovec *iov = (const struct iovec *)args[1];
   int iovcnt = args[2];
 
-  if (!check_iovec(iov, iovcnt)) {
+  if (!check_iovec(iov, iovcnt, true)) {
     args[0] = -EFAULT;
     return;
   }
@@ -408,7 +707,7 @@ void syscall_writev(struct process_context *context) {
   const struct iovec *iov = (const struct iovec *)args[1];
   int iovcnt = args[2];
 
-  if (!check_iovec(iov, iovcnt)) {
+  if (!check_iovec(iov, iovcnt, false)) {
     args[0] = -EFAULT;
     return;
   }
@@ -424,7 +723,7 @@ void syscall__llseek(struct process_context *context) {
   loff_t *result = (loff_t*)args[3];
   int whence = args[4];
 
-  if (!check_address_range(result, sizeof(loff_t))) {
+  if (!check_writable_range(result, sizeof(loff_t))) {
     args[0] = -EFAULT;
     return;
   }
@@ -451,7 +750,7 @@ void syscall_getcwd(struct process_context *context) {
     return;
   }
 
-  if (!check_address_range(buf, size)) {
+  if (!check_writable_range(buf, size)) {
     args[0] = -EFAULT;
     return;
   }
@@ -465,7 +764,7 @@ void syscall_stat64(struct process_context *context) {
   char *path = (char*)args[0];
   struct stat64 *buf = (struct stat64*)args[1];
 
-  if (!check_string(path) || !check_address_range(buf, sizeof(struct stat64))) {
+  if (!check_string(path) || !check_writable_range(buf, sizeof(struct stat64))) {
     args[0] = -EFAULT;
     return;
   }
@@ -479,7 +778,7 @@ void syscall_fstat64(struct process_context *context) {
   int fd = args[0];
   struct stat64 *buf = (struct stat64*)args[1];
 
-  if (!check_address_range(buf, sizeof(struct stat64))) {
+  if (!check_writable_range(buf, sizeof(struct stat64))) {
     args[0] = -EFAULT;
     return;
   }
@@ -493,7 +792,7 @@ void syscall_lstat64(struct process_context *context) {
   char *path = (char*)args[0];
   struct stat64 *buf = (struct stat64*)args[1];
 
-  if (!check_string(path) || !check_address_range(buf, sizeof(struct stat64))) {
+  if (!check_string(path) || !check_writable_range(buf, sizeof(struct stat64))) {
     args[0] = -EFAULT;
     return;
   }
@@ -508,7 +807,7 @@ void syscall_getdents64(struct process_context *context) {
   struct dirent64 *data = (struct dirent64*)args[1];
   size_t size = (size_t)args[2];
 
-  if (!check_address_range(data, size)) {
+  if (!check_writable_range(data, size)) {
     args[0] = -EFAULT;
     return;
   }
@@ -545,6 +844,7 @@ void syscall_handler(void) {
     case 10:  syscall_unlink(context);         break;
     case 11:  syscall_execve(context);         break;
     case 20:  syscall_getpid(context);         break;
+    case 34:  syscall_nice(context);           break;
     case 37:  syscall_kill(context);           break;
     case 39:  syscall_mkdir(context);          break;
     case 40:  syscall_rmdir(context);          break;
@@ -554,23 +854,48 @@ void syscall_handler(void) {
     case 54:  syscall_ioctl(context);          break;
     case 63:  syscall_dup2(context);           break;
     case 64:  syscall_getppid(context);        break;
+    case 91:  syscall_munmap(context);         break;
+    case 96:  syscall_getpriority(context);    break;
+    case 97:  syscall_setpriority(context);    break;
     case 114: syscall_wait4(context);          break;
     case 119: syscall_sigreturn(context);      break;
+    case 120: syscall_clone(context);          break;
     case 122: syscall_uname(context);          break;
+    case 125: syscall_mprotect(context);       break;
     case 140: syscall__llseek(context);        break;
+    case 144: syscall_msync(context);          break;
     case 145: syscall_readv(context);          break;
     case 146: syscall_writev(context);         break;
+    case 154: syscall_sched_setparam(context); break;
+    case 155: syscall_sched_getparam(context); break;
+    case 156: syscall_sched_setscheduler(context); break;
+    case 157: syscall_sched_getscheduler(context); break;
+    case 158: syscall_sched_yield(context);    break;
+    case 159: syscall_sched_get_priority_max(context); break;
+    case 160: syscall_sched_get_priority_min(context); break;
+    case 161: syscall_sched_rr_get_interval(context); break;
+    case 162: syscall_nanosleep(context);      break;
+    case 163: syscall_mremap(context);         break;
     case 174: syscall_rt_sigaction(context);   break;
     case 175: syscall_rt_sigprocmask(context); break;
     case 183: syscall_getcwd(context);         break;
+    case 190: syscall_vfork(context);          break;
+    case 192: syscall_mmap2(context);          break;
     case 195: syscall_stat64(context);         break;
     case 196: syscall_lstat64(context);        break;
     case 197: syscall_fstat64(context);        break;
     case 217: syscall_getdents64(context);     break;
+    case 220: syscall_madvise(context);        break;
     case 221: syscall_fcntl64(context);        break;
+    case 263: syscall_clock_gettime(context);  break;
+    case 265: syscall_clock_nanosleep(context); break;
     case 358: syscall_dup3(context);           break;
     case 359: syscall_pipe2(context);          break;
 
+    case NR_ARM_SET_TLS:      syscall_set_tls(context); break;
+    case NR_CYANURUS_SPAWN:   syscall_spawn(context);   break;
+    case NR_CYANURUS_MEMINFO: syscall_meminfo(context); break;
+
     case 248: // exit_group
     case 270: // fadvise64_64
       syscall_pass(context, 0);
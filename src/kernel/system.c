@@ -19,6 +19,7 @@ limitations under the License.
 #include "fs.h"
 #include "uart.h"
 #include "mmu.h"
+#include "cache.h"
 #include "syscall.h"
 #include "process.h"
 #include "timer.h"
@@ -28,6 +29,7 @@ limitations under the License.
 #include "config.h"
 #include "tty.h"
 #include "lib/string.h"
+#include "lib/errno.h"
 
 #define SCTLR_V (1 << 13)
 
@@ -37,6 +39,7 @@ limitations under the License.
 #define SYS_CFG_SHUTDOWN (8 << 20)
 
 #define DFSR_FS(dfsr) (dfsr & ((1 << 5) - 1))
+#define DFSR_WNR      (1 << 11)
 
 static void enable_hight_vectors(void) {
   int sctlr;
@@ -90,6 +93,7 @@ void system_init(void) {
   tty_init();
   mmu_init();
   mmu_enable();
+  cache_enable();
   timer_enable();
   pipe_init();
   process_init();
@@ -150,7 +154,13 @@ void system_data_abort_handler(void) {
   switch (DFSR_FS(dfsr)) {
     case 0x05: // Translation fault (First level)
     case 0x07: // Translation fault (Second level)
-      if (process_demand_page((void*)dfar)) {
+      if (process_demand_page((void*)dfar, dfsr & DFSR_WNR)) {
+        goto done;
+      }
+      break;
+    case 0x0d: // Permission fault (First level)
+    case 0x0f: // Permission fault (Second level)
+      if ((dfsr & DFSR_WNR) && process_copy_on_write((void*)dfar)) {
         goto done;
       }
       break;
@@ -196,3 +206,42 @@ int system_uname(struct utsname *uts) {
 
   return 0;
 }
+
+int system_clock_gettime(clockid_t clock_id, struct timespec *tp) {
+  uint64_t usec;
+
+  switch (clock_id) {
+    case CLOCK_REALTIME:  // no RTC, the epoch is the boot time
+    case CLOCK_MONOTONIC:
+      usec = timer_get_usec();
+      break;
+
+    default:
+      return -EINVAL;
+  }
+
+  tp->tv_sec  = (time_t)(usec / 1000000);
+  tp->tv_nsec = (long)(usec % 1000000) * 1000;
+
+  return 0;
+}
+
+/* relative requests count from now, TIMER_ABSTIME ones from boot */
+int system_clock_nanosleep(clockid_t clock_id, int flags, const struct timespec *req) {
+  uint64_t deadline;
+
+  if (clock_id != CLOCK_REALTIME && clock_id != CLOCK_MONOTONIC) {
+    return -EINVAL;
+  }
+
+  if (req->tv_sec < 0 || req->tv_nsec < 0 || req->tv_nsec >= 1000000000) {
+    return -EINVAL;
+  }
+
+  deadline = (uint64_t)req->tv_sec * 1000000 + (uint64_t)(req->tv_nsec + 999) / 1000;
+  if (!(flags & TIMER_ABSTIME)) {
+    deadline += timer_get_usec();
+  }
+
+  return process_sleep_until(deadline);
+}
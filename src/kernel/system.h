@@ -35,6 +35,8 @@ noreturn void system_bug_on(const char *file, unsigned int line, const char *fun
 void system_sleep(void);
 void system_shutdown(void);
 int system_uname(struct utsname *uts);
+int system_clock_gettime(clockid_t clock_id, struct timespec *tp);
+int system_clock_nanosleep(clockid_t clock_id, int flags, const struct timespec *req);
 
 // implemented in asm/lib.S
 void system_dispatch(uint32_t context);
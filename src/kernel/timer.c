@@ -19,6 +19,7 @@ limitations under the License.
 #include "lib/type.h"
 
 #define TIMER0         ((volatile uint32_t*)0x10011000)
+#define TIMER1         (TIMER0 + 0x8)
 #define TIMER_VALUE    0x1
 #define TIMER_CONTROL  0x2
 #define TIMER_INTCLR   0x3
@@ -33,14 +34,54 @@ limitations under the License.
 /* 1MHz timer */
 #define TIMER_FREQUENCY 1000000
 
+static uint32_t clock_last;
+static uint64_t clock_wraps;
+
 void timer_enable(void) {
   gic_enable_irq(IRQ_TIMER01);
 
-  /* interrupt every 10ms */
-  *TIMER0 = (uint32_t)(TIMER_FREQUENCY * 0.01);
+  /* no periodic tick, the scheduler arms timer 0 for each deadline */
+  timer_cancel();
+
+  /* free running clock source, counts down from 0xffffffff */
+  clock_last  = 0;
+  clock_wraps = 0;
+
+  *TIMER1 = 0xffffffff;
+  *(TIMER1 + TIMER_CONTROL) = TIMER_EN | TIMER_32BIT;
+}
+
+/*
+ * Fires a single interrupt after usec microseconds, replacing whatever was
+ * armed before.
+ */
+void timer_set_oneshot(uint32_t usec) {
+  /* a zero load would never count down */
+  if (usec == 0) {
+    usec = 1;
+  }
+
+  *(TIMER0 + TIMER_CONTROL) = 0;
+  *TIMER0 = usec * (TIMER_FREQUENCY / 1000000);
 
   *(TIMER0 + TIMER_CONTROL) =
-    TIMER_EN | TIMER_PERIODIC | TIMER_32BIT | TIMER_INTEN;
+    TIMER_EN | TIMER_ONESHOT | TIMER_32BIT | TIMER_INTEN;
+}
+
+void timer_cancel(void) {
+  *(TIMER0 + TIMER_CONTROL) = 0;
+  timer_clear_interrupt();
+}
+
+uint64_t timer_get_usec(void) {
+  uint32_t now = ~*(TIMER1 + TIMER_VALUE);
+
+  if (now < clock_last) {
+    clock_wraps += 1ULL << 32;
+  }
+  clock_last = now;
+
+  return clock_wraps | now;
 }
 
 int timer_is_masked(void) {
@@ -17,7 +17,18 @@ limitations under the License.
 #ifndef _CYANURUS_TIMER_H_
 #define _CYANURUS_TIMER_H_
 
+#include "lib/type.h"
+
+/*
+ * timer_get_usec only notices one wrap of the 32-bit clock between calls,
+ * so no one-shot may leave the kernel alone for longer than half of it
+ */
+#define TIMER_ONESHOT_MAX_USEC 0x80000000U
+
 void timer_enable(void);
+void timer_set_oneshot(uint32_t usec);
+void timer_cancel(void);
+uint64_t timer_get_usec(void);
 int timer_is_masked(void);
 void timer_clear_interrupt(void);
 
@@ -0,0 +1,232 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "vma.h"
+#include "slab.h"
+#include "lib/errno.h"
+
+static struct slab_cache *vma_cache;
+
+static struct vma *vma_alloc(uint8_t *start, uint8_t *current, uint8_t *end, uint32_t flags) {
+  struct vma *vma = slab_cache_alloc(vma_cache);
+
+  if (!vma) {
+    return NULL;
+  }
+
+  vma->start   = start;
+  vma->current = current;
+  vma->end     = end;
+  vma->flags   = flags;
+  vma->inode   = NULL;
+  vma->offset  = 0;
+
+  return vma;
+}
+
+static void vma_free(struct vma *vma) {
+  list_remove(&vma->next);
+  slab_cache_free(vma_cache, vma);
+}
+
+/* the upper half keeps the area, the lower half is inserted in front of it */
+static struct vma *vma_split(struct vma *vma, uint8_t *address) {
+  struct vma *head;
+  uint8_t *current = vma->current;
+
+  head = vma_alloc(vma->start, current < address ? current : address, address, vma->flags);
+  if (!head) {
+    return NULL;
+  }
+  head->inode  = vma->inode;
+  head->offset = vma->offset;
+  list_add(vma->next.prev, &head->next);
+
+  if (vma->inode) {
+    vma->offset += address - vma->start;
+  }
+
+  vma->start   = address;
+  vma->current = current > address ? current : address;
+
+  return head;
+}
+
+void vma_init(void) {
+  vma_cache = slab_cache_create("vma", sizeof(struct vma));
+}
+
+struct vma *vma_create(struct list *vmas, uint8_t *start, uint8_t *current, uint8_t *end, uint32_t flags) {
+  struct list *prev = vmas;
+  struct vma *vma, *new_vma;
+
+  if (start >= end) {
+    return NULL;
+  }
+
+  list_foreach(vma, vmas, next) {
+    if (vma->start >= end) {
+      break;
+    }
+
+    if (vma->end > start) {
+      return NULL;
+    }
+
+    prev = &vma->next;
+  }
+
+  if (!(new_vma = vma_alloc(start, current, end, flags))) {
+    return NULL;
+  }
+  list_add(prev, &new_vma->next);
+
+  return new_vma;
+}
+
+struct vma *vma_find(const struct list *vmas, const uint8_t *address) {
+  struct vma *vma;
+
+  list_foreach(vma, vmas, next) {
+    if (address < vma->start) {
+      break;
+    }
+
+    if (address < vma->end) {
+      return vma;
+    }
+  }
+
+  return NULL;
+}
+
+bool vma_is_free(const struct list *vmas, const uint8_t *start, const uint8_t *end) {
+  struct vma *vma;
+
+  list_foreach(vma, vmas, next) {
+    if (vma->start >= end) {
+      break;
+    }
+
+    if (vma->end > start) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* returns the highest gap of size bytes within [lower, upper) */
+uint8_t *vma_find_free(const struct list *vmas, size_t size, uint8_t *lower, uint8_t *upper) {
+  struct vma *vma;
+  uint8_t *gap = lower, *top, *found = NULL;
+
+  list_foreach(vma, vmas, next) {
+    top = vma->start < upper ? vma->start : upper;
+
+    if (top > gap && (size_t)(top - gap) >= size) {
+      found = top - size;
+    }
+
+    if (vma->end > gap) {
+      gap = vma->end;
+    }
+  }
+
+  if (upper > gap && (size_t)(upper - gap) >= size) {
+    found = upper - size;
+  }
+
+  return found;
+}
+
+int vma_remove(struct list *vmas, uint8_t *start, uint8_t *end) {
+  struct vma *vma, *temp;
+
+  list_foreach_safe(vma, temp, vmas, next) {
+    if (vma->start >= end) {
+      break;
+    }
+
+    if (vma->end <= start) {
+      continue;
+    }
+
+    if (vma->start < start && !vma_split(vma, start)) {
+      return -ENOMEM;
+    }
+
+    if (vma->end > end) {
+      if (!vma_split(vma, end)) {
+        return -ENOMEM;
+      }
+      vma = container_of(vma->next.prev, struct vma, next);
+    }
+
+    vma_free(vma);
+  }
+
+  return 0;
+}
+
+int vma_protect(struct list *vmas, uint8_t *start, uint8_t *end, uint32_t prot) {
+  struct vma *vma;
+
+  list_foreach(vma, vmas, next) {
+    if (vma->start >= end) {
+      break;
+    }
+
+    if (vma->end <= start) {
+      continue;
+    }
+
+    if (vma->start < start && !vma_split(vma, start)) {
+      return -ENOMEM;
+    }
+
+    if (vma->end > end && !(vma = vma_split(vma, end))) {
+      return -ENOMEM;
+    }
+
+    vma->flags = (vma->flags & ~VMA_FLAGS_PROT) | (prot & VMA_FLAGS_PROT);
+  }
+
+  return 0;
+}
+
+int vma_copy(struct list *vmas, const struct list *from) {
+  struct vma *vma, *new_vma;
+
+  list_foreach(vma, from, next) {
+    if (!(new_vma = vma_alloc(vma->start, vma->current, vma->end, vma->flags))) {
+      return -ENOMEM;
+    }
+    new_vma->inode  = vma->inode;
+    new_vma->offset = vma->offset;
+    list_add(vmas->prev, &new_vma->next);
+  }
+
+  return 0;
+}
+
+void vma_release(struct list *vmas) {
+  struct vma *vma, *temp;
+
+  list_foreach_safe(vma, temp, vmas, next) {
+    vma_free(vma);
+  }
+}
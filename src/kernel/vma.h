@@ -0,0 +1,60 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _CYANURUS_VMA_H_
+#define _CYANURUS_VMA_H_
+
+#include "lib/type.h"
+#include "lib/list.h"
+#include "inode.h"
+
+#define VMA_FLAGS_GROWSUP   (1 << 0)
+#define VMA_FLAGS_GROWSDOWN (1 << 1)
+#define VMA_FLAGS_READ      (1 << 2)
+#define VMA_FLAGS_WRITE     (1 << 3)
+#define VMA_FLAGS_EXEC      (1 << 4)
+#define VMA_FLAGS_HEAP      (1 << 5)
+#define VMA_FLAGS_SHARED    (1 << 6)
+
+#define VMA_FLAGS_PROT (VMA_FLAGS_READ|VMA_FLAGS_WRITE|VMA_FLAGS_EXEC)
+
+/*
+ * [start, end) is reserved. For GROWSUP areas [start, current) was
+ * populated eagerly and the rest is demand-zero, GROWSDOWN areas are
+ * populated in [current, end) and extend downwards on faults.
+ * File-backed areas map inode pages from byte offset at start.
+ */
+struct vma {
+  struct list next;
+  uint8_t *start;
+  uint8_t *current;
+  uint8_t *end;
+  uint32_t flags;
+  struct inode *inode;
+  size_t offset;
+};
+
+void vma_init(void);
+struct vma *vma_create(struct list *vmas, uint8_t *start, uint8_t *current, uint8_t *end, uint32_t flags);
+struct vma *vma_find(const struct list *vmas, const uint8_t *address);
+bool vma_is_free(const struct list *vmas, const uint8_t *start, const uint8_t *end);
+uint8_t *vma_find_free(const struct list *vmas, size_t size, uint8_t *lower, uint8_t *upper);
+int vma_remove(struct list *vmas, uint8_t *start, uint8_t *end);
+int vma_protect(struct list *vmas, uint8_t *start, uint8_t *end, uint32_t prot);
+int vma_copy(struct list *vmas, const struct list *from);
+void vma_release(struct list *vmas);
+
+#endif
@@ -0,0 +1,326 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <buddy.c>
+
+#include "test.h"
+#include "buddy.t"
+
+struct free_counts {
+  size_t count[PAGE_MAX_DEPTH];
+};
+
+static void save_free_counts(struct free_counts *counts) {
+  unsigned int order;
+
+  for (order = 0; order < PAGE_MAX_DEPTH; ++order) {
+    counts->count[order] = buddy_count_free(order);
+  }
+}
+
+static void assert_free_counts(const struct free_counts *counts) {
+  unsigned int order;
+
+  for (order = 0; order < PAGE_MAX_DEPTH; ++order) {
+    TEST_ASSERT(buddy_count_free(order) == counts->count[order]);
+  }
+}
+
+TEST(test_buddy_alloc) {
+  unsigned int order;
+  struct free_counts initial;
+  struct page *page, *block;
+
+  page_num = PAGE_NUM_DEFAULT;
+  buddy_init();
+  save_free_counts(&initial);
+
+  TEST_ASSERT(initial.count[PAGE_MAX_ORDER] == (PAGE_NUM_DEFAULT >> PAGE_MAX_ORDER));
+  for (order = 0; order < PAGE_MAX_ORDER; ++order) {
+    TEST_ASSERT(!initial.count[order]);
+  }
+
+  /* splitting a maximum block leaves one free block on every lower order */
+  page = buddy_alloc(PAGE_SIZE);
+  TEST_ASSERT(page == &pages[0]);
+  TEST_ASSERT(page->order == 0 && page->count == 1);
+  TEST_ASSERT(page->flags & PF_FIRST_PAGE);
+
+  for (order = 0; order < PAGE_MAX_ORDER; ++order) {
+    TEST_ASSERT(buddy_count_free(order) == 1);
+  }
+  TEST_ASSERT(buddy_count_free(PAGE_MAX_ORDER) == initial.count[PAGE_MAX_ORDER] - 1);
+
+  block = buddy_alloc(PAGE_SIZE * 3);
+  TEST_ASSERT(block == &pages[4]);
+  TEST_ASSERT(block->order == 2);
+  TEST_ASSERT(buddy_count_free(2) == 0);
+
+  /* every page of a block leads straight back to its head */
+  TEST_ASSERT(page_find_head(&block[0]) == block);
+  TEST_ASSERT(page_find_head(&block[3]) == block);
+  TEST_ASSERT(page_find_by_address((char*)page_address(block) + PAGE_SIZE * 2) == &block[2]);
+
+  /* pages 0-3 coalesce, then stop at the allocated block */
+  buddy_free(page);
+  TEST_ASSERT(buddy_count_free(0) == 0);
+  TEST_ASSERT(buddy_count_free(1) == 0);
+  TEST_ASSERT(buddy_count_free(2) == 1);
+
+  buddy_free(block);
+  assert_free_counts(&initial);
+  TEST_ASSERT(!(pages[0].flags & PF_FIRST_PAGE));
+  TEST_ASSERT(pages[0].order == PAGE_MAX_ORDER);
+}
+
+TEST(test_buddy_pool_tail) {
+  struct free_counts initial;
+  struct page *page;
+
+  /* a pool that is not a multiple of the largest block */
+  page_num = PAGE_NUM_DEFAULT + 5;
+  buddy_init();
+  save_free_counts(&initial);
+
+  TEST_ASSERT(initial.count[PAGE_MAX_ORDER] == (PAGE_NUM_DEFAULT >> PAGE_MAX_ORDER));
+  TEST_ASSERT(initial.count[2] == 1 && initial.count[0] == 1);
+
+  page = buddy_alloc(PAGE_SIZE);
+  TEST_ASSERT(page == &pages[PAGE_NUM_DEFAULT + 4]);
+
+  /* the tail never merges past the end of the pool */
+  buddy_free(page);
+  assert_free_counts(&initial);
+  TEST_ASSERT(pages[PAGE_NUM_DEFAULT].order == 2);
+}
+
+TEST(test_buddy_fragment) {
+  page_index i;
+  struct free_counts initial;
+
+  page_num = PAGE_NUM_DEFAULT;
+  buddy_init();
+  save_free_counts(&initial);
+
+  for (i = 0; i < page_num; ++i) {
+    TEST_ASSERT(buddy_try_alloc(PAGE_SIZE) == &pages[i]);
+  }
+  TEST_ASSERT(!buddy_try_alloc(PAGE_SIZE));
+
+  /* every other page: nothing can merge and order 0 holds half the pool */
+  for (i = 0; i < page_num; i += 2) {
+    buddy_free(&pages[i]);
+  }
+  TEST_ASSERT(buddy_count_free(0) == page_num / 2);
+  TEST_ASSERT(!buddy_try_alloc(PAGE_SIZE * 2));
+
+  /*
+   * each of these frees finds its buddy on the longest list and coalesces
+   * all the way up, which used to walk the whole order 0 list every time
+   */
+  for (i = 1; i < page_num; i += 2) {
+    buddy_free(&pages[i]);
+    TEST_ASSERT(buddy_count_free(0) == (page_num - i - 1) / 2);
+  }
+  assert_free_counts(&initial);
+
+  /* the coalesced pool can satisfy a maximum order request again */
+  for (i = 0; i < initial.count[PAGE_MAX_ORDER]; ++i) {
+    TEST_ASSERT(buddy_try_alloc(PAGE_SIZE << PAGE_MAX_ORDER) == &pages[i << PAGE_MAX_ORDER]);
+  }
+  TEST_ASSERT(!buddy_try_alloc(PAGE_SIZE));
+
+  for (i = 0; i < initial.count[PAGE_MAX_ORDER]; ++i) {
+    buddy_free(&pages[i << PAGE_MAX_ORDER]);
+  }
+  assert_free_counts(&initial);
+}
+
+#define TEST_PID    1
+#define TEST_ADDR   0x100000
+#define USER_PAGES  64
+
+TEST(test_buddy_compact) {
+  page_index start, i;
+  uint32_t *p;
+  struct list held;
+  struct page *page, *block;
+  struct buddy_stat stat;
+
+  page_init();
+  mmu_init();
+  mmu_enable();
+
+  /* the address space and its L2 table exist before memory runs out */
+  TEST_ASSERT(mmu_alloc(TEST_PID, TEST_ADDR, PAGE_SIZE) == 0);
+
+  list_init(&held);
+  while ((page = buddy_try_alloc(PAGE_SIZE))) {
+    list_add(&held, &page->list);
+  }
+
+  /* user pages land on the odd pages at the top of the pool */
+  start = page_num - (USER_PAGES * 2);
+
+  for (i = start + 1; i < page_num; i += 2) {
+    TEST_ASSERT(pages[i].list.next);
+    list_remove(&pages[i].list);
+    buddy_free(&pages[i]);
+  }
+
+  TEST_ASSERT(mmu_alloc(TEST_PID, TEST_ADDR + PAGE_SIZE, USER_PAGES * PAGE_SIZE) == 0);
+
+  buddy_get_stat(&stat);
+  TEST_ASSERT(stat.free_pages == 0);
+
+  mmu_set_ttb(TEST_PID);
+
+  for (i = 0; i < USER_PAGES; ++i) {
+    p = (uint32_t*)(TEST_ADDR + ((i + 1) * PAGE_SIZE));
+    p[0] = i;
+    p[(PAGE_SIZE / sizeof(uint32_t)) - 1] = ~i;
+  }
+
+  /* the even pages become free, but none of them can merge */
+  for (i = start; i < page_num; i += 2) {
+    TEST_ASSERT(pages[i].list.next);
+    list_remove(&pages[i].list);
+    buddy_free(&pages[i]);
+  }
+
+  TEST_ASSERT(buddy_count_free(0) == USER_PAGES);
+  TEST_ASSERT(buddy_fragmentation(0) == 0);
+  TEST_ASSERT(buddy_fragmentation(1) == 1000);
+  TEST_ASSERT(!buddy_try_alloc(PAGE_SIZE * 2));
+
+  /* one user page moves out of the way */
+  block = buddy_alloc(PAGE_SIZE * 2);
+  TEST_ASSERT(block == &pages[start]);
+  TEST_ASSERT(block->order == 1 && block->count == 1);
+
+  buddy_get_stat(&stat);
+  TEST_ASSERT(stat.compactions == 1);
+  TEST_ASSERT(stat.compact_failures == 0);
+  TEST_ASSERT(stat.migrated_pages == 1);
+  TEST_ASSERT(stat.free_pages == USER_PAGES - 2);
+
+  for (i = 0; i < USER_PAGES; ++i) {
+    p = (uint32_t*)(TEST_ADDR + ((i + 1) * PAGE_SIZE));
+    TEST_ASSERT(p[0] == i);
+    TEST_ASSERT(p[(PAGE_SIZE / sizeof(uint32_t)) - 1] == ~i);
+  }
+
+  /* kernel pages pin every larger block */
+  TEST_ASSERT(!buddy_compact(PAGE_MAX_ORDER));
+
+  buddy_get_stat(&stat);
+  TEST_ASSERT(stat.compact_failures == 1);
+
+  for (i = start; i < page_num; ++i) {
+    TEST_ASSERT(!(pages[i].flags & PF_MOVABLE));
+  }
+}
+
+static bool is_zero_filled(const struct page *page) {
+  size_t i, size = PAGE_SIZE << page->order;
+  const char *data = page_address((struct page*)page);
+
+  for (i = 0; i < size && !data[i]; ++i);
+  return i == size;
+}
+
+TEST(test_buddy_split) {
+  int i;
+  struct free_counts initial;
+  struct page *block;
+
+  page_num = PAGE_NUM_DEFAULT;
+  buddy_init();
+  save_free_counts(&initial);
+
+  block = buddy_alloc(PAGE_SIZE * 4);
+  page_get(block);
+
+  /* every piece keeps the count of the block and heads itself */
+  buddy_split(block);
+
+  for (i = 0; i < 4; ++i) {
+    TEST_ASSERT(block[i].order == 0 && block[i].count == 2);
+    TEST_ASSERT(page_find_head(&block[i]) == &block[i]);
+  }
+
+  /* pieces go back one by one and merge again */
+  for (i = 0; i < 4; ++i) {
+    page_put(&block[i]);
+  }
+  page_put(&block[1]);
+  TEST_ASSERT(buddy_count_free(0) == 1);
+
+  page_put(&block[0]);
+  page_put(&block[2]);
+  page_put(&block[3]);
+  assert_free_counts(&initial);
+}
+
+TEST(test_buddy_zeroed) {
+  size_t i;
+  struct buddy_stat stat;
+  struct free_counts initial;
+  struct page *page, *blocks[PAGE_NUM_DEFAULT >> PAGE_MAX_ORDER];
+
+  page_num = PAGE_NUM_DEFAULT;
+  buddy_init();
+  save_free_counts(&initial);
+
+  /* a recycled page still holds its old contents */
+  page = buddy_alloc(PAGE_SIZE);
+  memset(page_address(page), 0xff, PAGE_SIZE);
+  buddy_free(page);
+
+  for (i = 0; buddy_zero_idle(); ++i);
+  TEST_ASSERT(i == ZEROED_POOL_MAX);
+
+  buddy_get_stat(&stat);
+  TEST_ASSERT(stat.zeroed_pages == ZEROED_POOL_MAX);
+  TEST_ASSERT(stat.free_pages == PAGE_NUM_DEFAULT - ZEROED_POOL_MAX);
+
+  page = buddy_alloc_zeroed(PAGE_SIZE);
+  TEST_ASSERT(is_zero_filled(page));
+  TEST_ASSERT(!(page->flags & PF_ZEROED) && page->count == 1);
+  buddy_free(page);
+
+  /* larger requests are zeroed on the spot */
+  page = buddy_alloc_zeroed(PAGE_SIZE * 2);
+  TEST_ASSERT(page->order == 1 && is_zero_filled(page));
+  buddy_free(page);
+
+  buddy_get_stat(&stat);
+  TEST_ASSERT(stat.zero_hits == 1 && stat.zero_misses == 1);
+  TEST_ASSERT(stat.zeroed_pages == ZEROED_POOL_MAX - 1);
+
+  /* the pool is handed back before an allocation would fail */
+  for (i = 0; i < initial.count[PAGE_MAX_ORDER]; ++i) {
+    TEST_ASSERT((blocks[i] = buddy_alloc(PAGE_SIZE << PAGE_MAX_ORDER)));
+  }
+
+  buddy_get_stat(&stat);
+  TEST_ASSERT(stat.zeroed_pages == 0 && stat.free_pages == 0);
+
+  for (i = 0; i < initial.count[PAGE_MAX_ORDER]; ++i) {
+    buddy_free(blocks[i]);
+  }
+  assert_free_counts(&initial);
+}
@@ -0,0 +1,45 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+$shutdown
+*/
+TEST(test_buddy_alloc);
+
+/*
+$shutdown
+*/
+TEST(test_buddy_pool_tail);
+
+/*
+$shutdown
+*/
+TEST(test_buddy_fragment);
+
+/*
+$shutdown
+*/
+TEST(test_buddy_compact);
+
+/*
+$shutdown
+*/
+TEST(test_buddy_split);
+
+/*
+$shutdown
+*/
+TEST(test_buddy_zeroed);
@@ -43,51 +43,72 @@ static void assert_pattern(int pat, uint8_t *start, uint8_t *end) {
 }
 
 TEST(test_elf) {
+  size_t i, offset, copy;
   struct elf_executable executable;
+  struct elf_segment *segment, *text = NULL, *data = NULL;
 
-  uint8_t *text, *data;
-  uint32_t text_start, text_end;
-  uint32_t data_start, data_end;
-  uint32_t fill_start, fill_end;
+  _page_cleanup_ struct page *page = buddy_alloc(PAGE_SIZE);
+  uint8_t *file = page_address(page);
 
-  setup();
-  elf_load(INIT_PATH, &executable);
+  uint32_t fill_start, fill_end, zero_end;
 
-  text = page_address(executable.text.page);
-  data = page_address(executable.data.page);
+  setup();
+  TEST_ASSERT(elf_load(INIT_PATH, &executable) == 0);
+  TEST_ASSERT(executable.inode);
+  TEST_ASSERT(executable.segment_num >= 2);
+
+  /* a static executable needs no interpreter and can not be relocated */
+  TEST_ASSERT(!executable.dynamic);
+  TEST_ASSERT(!executable.interpreter);
+  TEST_ASSERT(executable.phnum >= executable.segment_num);
+  TEST_ASSERT(elf_relocate(&executable, 0x1000) == -1);
+
+  for (i = 0; i < executable.segment_num; ++i) {
+    segment = &executable.segments[i];
+
+    if (segment->flags & ELF_PH_FLAGS_X) {
+      text = segment;
+    } else if (segment->flags & ELF_PH_FLAGS_W) {
+      data = segment;
+    }
+  }
 
-  text_start = executable.text.addr;
-  text_end   = executable.text.addr + executable.text.memory_size;
-  data_start = executable.data.addr;
-  data_end   = executable.data.addr + executable.data.memory_size;
-  TEST_ASSERT(text_start <= text_end);
-  TEST_ASSERT(text_end <= data_start);
-  TEST_ASSERT(data_start <= data_end);
+  /* text is left to the page cache, only data is copied */
+  TEST_ASSERT(text && text->mapped);
+  TEST_ASSERT(data && !data->mapped);
+  TEST_ASSERT(text->addr + text->memory_size <= data->addr);
+  TEST_ASSERT(text->offset == 0);
+  TEST_ASSERT(!memcmp(page_address(inode_get_page(executable.inode, 0)), ELF_MAGIC, 4));
 
-  fill_start = text_start - 0x1000;
-  fill_end   = data_end   + 0x1000;
-  TEST_ASSERT(fill_start < fill_end);
+  fill_start = text->addr - 0x1000;
+  fill_end   = data->addr + data->memory_size + 0x1000;
 
   mmu_alloc(INIT_PID, fill_start, fill_end - fill_start);
   mmu_set_ttb(INIT_PID);
 
   memset((char*)fill_start, 0xff, fill_end - fill_start);
-  elf_copy(&executable);
+  TEST_ASSERT(elf_copy(&executable) == 0);
 
-  TEST_ASSERT(!memcmp(text, (void*)executable.text.addr, executable.text.memory_size));
-  TEST_ASSERT(!memcmp(data, (void*)executable.data.addr, executable.data.file_size));
+  /* the whole file image, a page at a time as it was streamed */
+  for (offset = 0; offset < data->file_size; offset += PAGE_SIZE) {
+    copy = data->file_size - offset < PAGE_SIZE ? data->file_size - offset : PAGE_SIZE;
 
-  assert_pattern(
-    0x00,
-    (uint8_t*)executable.data.addr + executable.data.file_size,
-    (uint8_t*)executable.data.addr + executable.data.memory_size
-  );
+    TEST_ASSERT(inode_read(executable.inode, copy, data->offset + offset, file) == (ssize_t)copy);
+    TEST_ASSERT(!memcmp(file, (void*)(data->addr + offset), copy));
+  }
+
+  /* only the page holding the end of the file image is zero filled, the rest is demand-zero */
+  zero_end = (data->addr + data->file_size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+  zero_end = zero_end < data->addr + data->memory_size ? zero_end : data->addr + data->memory_size;
+
+  if (zero_end > data->addr + data->file_size) {
+    assert_pattern(0x00, (uint8_t*)data->addr + data->file_size, (uint8_t*)zero_end);
+  }
 
-  assert_pattern(0xff, (uint8_t*)fill_start, (uint8_t*)text_start);
-  assert_pattern(0xff, (uint8_t*)text_end,   (uint8_t*)data_start);
-  assert_pattern(0xff, (uint8_t*)data_end,   (uint8_t*)fill_end);
+  assert_pattern(0xff, (uint8_t*)fill_start, (uint8_t*)data->addr);
+  assert_pattern(0xff, (uint8_t*)zero_end, (uint8_t*)fill_end);
 
   elf_release(&executable);
-  TEST_ASSERT(!executable.text.page);
-  TEST_ASSERT(!executable.data.page);
+  TEST_ASSERT(!executable.page);
+  TEST_ASSERT(!executable.segment_num);
 }
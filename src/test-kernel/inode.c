@@ -118,3 +118,134 @@ TEST(test_inode_destroy_1) {
   read_inode(index, &minix_inode);
   TEST_ASSERT(minix_inode.i_mode == 0);
 }
+
+TEST(test_inode_page_cache) {
+  struct inode *inode;
+  struct page *page;
+  char *data, buf[4];
+
+  _page_cleanup_ struct page *block = buddy_alloc(BLOCK_SIZE);
+  char *disk = page_address(block);
+
+  setup();
+
+  inode = inode_create(S_IFREG | 0755);
+  TEST_ASSERT(inode_write(inode, 3, 0, "abc") == 3);
+
+  page = inode_get_page(inode, 0);
+  data = page_address(page);
+
+  TEST_ASSERT(page == inode_get_page(inode, 0));
+  TEST_ASSERT(memcmp(data, "abc", 3) == 0);
+  TEST_ASSERT(data[3] == 0 && data[PAGE_SIZE - 1] == 0);
+
+  memcpy(data, "xyz", 3);
+  inode_dirty_page(inode, 0);
+
+  TEST_ASSERT(inode_read(inode, 3, 0, buf) == 3);
+  TEST_ASSERT(memcmp(buf, "xyz", 3) == 0);
+
+  TEST_ASSERT(inode_write(inode, 1, 1, "q") == 1);
+  TEST_ASSERT(memcmp(data, "xqz", 3) == 0);
+
+  TEST_ASSERT(inode_sync(inode) == 0);
+  block_read(get_block(inode, 0, disk), disk);
+  TEST_ASSERT(memcmp(disk, "xqz", 3) == 0);
+
+  TEST_ASSERT(inode_truncate(inode, 0) == 0);
+  TEST_ASSERT(list_length(&inode->pages) == 0);
+}
+
+TEST(test_inode_truncate_page) {
+  struct inode *inode;
+  char buf[8];
+
+  setup();
+
+  inode = inode_create(S_IFREG | 0755);
+  TEST_ASSERT(inode_write(inode, 8, 0, "abcdefgh") == 8);
+  TEST_ASSERT(inode_get_page(inode, 0));
+
+  /* the cut falls inside the cached page */
+  TEST_ASSERT(inode_truncate(inode, 3) == 0);
+  TEST_ASSERT(inode_truncate(inode, 8) == 0);
+
+  TEST_ASSERT(inode_read(inode, 8, 0, buf) == 8);
+  TEST_ASSERT(memcmp(buf, "abc\0\0\0\0\0", 8) == 0);
+}
+
+TEST(test_inode_shrink) {
+  struct inode *inode;
+  struct page *held;
+
+  setup();
+
+  inode = inode_create(S_IFREG | 0755);
+  TEST_ASSERT(inode_write(inode, 1, PAGE_SIZE * 2, "a") == 1);
+
+  inode_get_page(inode, 0);
+  held = inode_get_page(inode, 1);
+  inode_get_page(inode, 2);
+  inode_dirty_page(inode, 2);
+
+  TEST_ASSERT(list_length(&inode->pages) == 3);
+
+  /* only the clean page nobody else holds can go */
+  page_get(held);
+  TEST_ASSERT(inode_shrink() == 1);
+  TEST_ASSERT(list_length(&inode->pages) == 2);
+  TEST_ASSERT(held == inode_get_page(inode, 1));
+
+  page_put(held);
+  TEST_ASSERT(inode_shrink() == 1);
+  TEST_ASSERT(list_length(&inode->pages) == 1);
+
+  TEST_ASSERT(inode_sync(inode) == 0);
+  TEST_ASSERT(inode_shrink() == 1);
+  TEST_ASSERT(list_length(&inode->pages) == 0);
+}
+
+TEST(test_inode_out_of_memory) {
+  block_index zone;
+  struct inode *inode;
+  struct list held;
+  struct page *page, *temp;
+  struct minix2_inode minix_inode;
+  static uint8_t disk[BLOCK_SIZE];
+
+  setup();
+
+  inode = inode_create(S_IFREG | 0755);
+  zone = get_block(inode, 0, disk);
+  TEST_ASSERT(zone);
+
+  /* nothing is left for kmalloc or the block cache */
+  block_shrink();
+  list_init(&held);
+  while ((page = buddy_try_alloc(PAGE_SIZE))) {
+    list_add(&held, &page->list);
+  }
+
+  inode->mode = S_IFREG | 0600;
+  inode->nlinks = 3;
+  TEST_ASSERT(inode_set(inode) == 0);
+  TEST_ASSERT(!metadata_reserve_used);
+
+  memset(disk, 'z', BLOCK_SIZE);
+  block_write(zone, disk);
+
+  list_foreach_safe(page, temp, &held, list) {
+    list_remove(&page->list);
+    buddy_free(page);
+  }
+
+  /* both writes reached the device, not just a cache */
+  block_shrink();
+
+  read_inode_with(inode->index, &minix_inode, disk);
+  TEST_ASSERT(minix_inode.i_mode == (S_IFREG | 0600));
+  TEST_ASSERT(minix_inode.i_nlinks == 3);
+
+  block_read(zone, disk);
+  TEST_ASSERT(disk[0] == 'z' && disk[BLOCK_SIZE - 1] == 'z');
+}
@@ -43,3 +43,23 @@ TEST(test_inode_destroy_0);
 $shutdown
 */
 TEST(test_inode_destroy_1);
+
+/*
+$shutdown
+*/
+TEST(test_inode_page_cache);
+
+/*
+$shutdown
+*/
+TEST(test_inode_truncate_page);
+
+/*
+$shutdown
+*/
+TEST(test_inode_shrink);
+
+/*
+$shutdown
+*/
+TEST(test_inode_out_of_memory);
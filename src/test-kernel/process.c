@@ -97,6 +97,34 @@ TEST(test_process_create_1) {
   TEST_ASSERT(process_create("/sbin/command_not_found") == -EACCES);
 }
 
+TEST(test_process_create_text) {
+  struct process *p1, *p2;
+  struct vma *text;
+  struct page *page;
+
+  setup();
+
+  p1 = get_process(process_create(INIT_PATH));
+  p2 = get_process(process_create(INIT_PATH));
+
+  text = container_of(p1->vmas.next, struct vma, next);
+  TEST_ASSERT(text->inode && (text->flags & VMA_FLAGS_EXEC) && !(text->flags & VMA_FLAGS_WRITE));
+
+  page = inode_get_page(text->inode, text->offset / PAGE_SIZE);
+  TEST_ASSERT(page->count == 1);
+
+  /* both processes map the one cached copy */
+  pseudo_switch_to(p1->id);
+  TEST_ASSERT(process_prepare_read(text->start, sizeof(uint32_t)));
+
+  pseudo_switch_to(p2->id);
+  TEST_ASSERT(process_prepare_read(text->start, sizeof(uint32_t)));
+
+  TEST_ASSERT(page->count == 3);
+  TEST_ASSERT(!memcmp(text->start, page_address(page), PAGE_SIZE));
+  TEST_ASSERT(!process_prepare_write(text->start, sizeof(uint32_t)));
+}
+
 TEST(test_process_exec_0) {
   pid_t pid;
   int argc;
@@ -179,8 +207,8 @@ TEST(test_process_exec_2) {
   p = get_process(process_create(INIT_PATH));
   pseudo_switch_to(p->id);
 
-  TEST_ASSERT((unsigned long)p->segments[SEGMENT_TYPE_TEXT].start > 0);
-  ksa.handler = (void (*)(int))p->segments[SEGMENT_TYPE_TEXT].start;
+  TEST_ASSERT((unsigned long)p->heap_start > 0);
+  ksa.handler = (void (*)(int))container_of(p->vmas.next, struct vma, next)->start;
   TEST_ASSERT(process_sigaction(SIGINT, &ksa, NULL) == 0);
 
   TEST_ASSERT(p->signal.actions[SIGINT].handler != SIG_DFL);
@@ -247,6 +275,227 @@ TEST(test_process_fork) {
   }
 }
 
+TEST(test_process_fork_copy_on_write) {
+  pid_t parent_pid, child_pid;
+  uint32_t *data;
+
+  setup();
+
+  parent_pid = process_create(INIT_PATH);
+  pseudo_switch_to(parent_pid);
+
+  data = (uint32_t*)vma_find(&current_process->vmas, STACK_END - 1)->current;
+  *data = 1;
+
+  child_pid = process_fork(&current_process->context);
+
+  process_prepare_write(data, sizeof(uint32_t));
+  *data = 2;
+
+  pseudo_switch_to(child_pid);
+  TEST_ASSERT(*data == 1);
+
+  process_prepare_write(data, sizeof(uint32_t));
+  *data = 3;
+
+  pseudo_switch_to(parent_pid);
+  TEST_ASSERT(*data == 2);
+}
+
+TEST(test_process_spawn) {
+  int i;
+  pid_t pid;
+  struct file *file;
+  struct process *p;
+
+  char *const argv[] = {
+    INIT_PATH,
+    NULL,
+  };
+
+  setup();
+
+  pid = process_create(INIT_PATH);
+  pseudo_switch_to(pid);
+
+  bitset_add(current_process->close_on_exec, 2);
+
+  pid = process_spawn(INIT_PATH, argv, NULL);
+  TEST_ASSERT(pid > 0);
+  TEST_ASSERT(list_length(&all_processes) == 2);
+
+  p = get_process(pid);
+
+  TEST_ASSERT(p->state == STATE_READY);
+  TEST_ASSERT(p->parent == current_process);
+  TEST_ASSERT(p->mm == p->id);
+  TEST_ASSERT(list_length(&current_process->children) == 1);
+
+  for (i = 0; i < 2; ++i) {
+    TEST_ASSERT((file = p->files[i]));
+    TEST_ASSERT(file == current_process->files[i]);
+    TEST_ASSERT(file->count == 5);
+  }
+
+  TEST_ASSERT(p->files[2] == NULL);
+  TEST_ASSERT(process_spawn("/sbin/not_found", argv, NULL) == -EACCES);
+}
+
+TEST(test_process_brk) {
+  pid_t pid;
+  uint8_t *heap;
+  struct mmu_stat stat, base;
+
+  setup();
+
+  pid = process_create(INIT_PATH);
+  pseudo_switch_to(pid);
+
+  heap = current_process->heap_start;
+  TEST_ASSERT(mmu_get_stat(pid, &base) == 0);
+
+  TEST_ASSERT(process_brk((uint32_t)heap + PAGE_SIZE * 3) == (uint32_t)heap + PAGE_SIZE * 3);
+  TEST_ASSERT(mmu_get_stat(pid, &stat) == 0);
+  TEST_ASSERT(stat.small_pages == base.small_pages);
+
+  process_prepare_read(heap, PAGE_SIZE);
+  TEST_ASSERT(*(uint32_t*)heap == 0);
+
+  process_prepare_write(heap + PAGE_SIZE, sizeof(uint32_t));
+  *(uint32_t*)(heap + PAGE_SIZE) = 1;
+
+  TEST_ASSERT(mmu_get_stat(pid, &stat) == 0);
+  TEST_ASSERT(stat.small_pages == base.small_pages + 2);
+
+  TEST_ASSERT(process_brk((uint32_t)heap) == (uint32_t)heap);
+  TEST_ASSERT(mmu_get_stat(pid, &stat) == 0);
+  TEST_ASSERT(stat.small_pages == base.small_pages);
+
+  TEST_ASSERT(process_brk((uint32_t)heap - 1) == (uint32_t)heap);
+  TEST_ASSERT(!process_prepare_read(heap, PAGE_SIZE));
+}
+
+TEST(test_process_mmap) {
+  pid_t pid;
+  uint8_t *addr, *moved;
+  struct mmu_stat stat, base;
+
+  setup();
+
+  pid = process_create(INIT_PATH);
+  pseudo_switch_to(pid);
+
+  TEST_ASSERT(mmu_get_stat(pid, &base) == 0);
+
+  addr = (uint8_t*)process_mmap(NULL, PAGE_SIZE * 3, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  TEST_ASSERT(addr >= MMAP_START && addr + PAGE_SIZE * 3 <= MMAP_END);
+  TEST_ASSERT((int)process_mmap(NULL, PAGE_SIZE, PROT_READ, MAP_PRIVATE, 3, 0) == -ENODEV);
+
+  TEST_ASSERT(process_prepare_write(addr, sizeof(uint32_t)));
+  *(uint32_t*)addr = 1;
+
+  TEST_ASSERT(mmu_get_stat(pid, &stat) == 0);
+  TEST_ASSERT(stat.small_pages == base.small_pages + 1);
+
+  TEST_ASSERT(process_mprotect(addr, PAGE_SIZE, PROT_READ) == 0);
+  TEST_ASSERT(process_prepare_read(addr, PAGE_SIZE));
+  TEST_ASSERT(!process_prepare_write(addr, PAGE_SIZE));
+  TEST_ASSERT(process_prepare_write(addr + PAGE_SIZE, PAGE_SIZE));
+  TEST_ASSERT(process_mprotect(addr, PAGE_SIZE * 4, PROT_READ) == -ENOMEM);
+
+  moved = (uint8_t*)process_mremap(addr, PAGE_SIZE * 3, PAGE_SIZE * 8, MREMAP_MAYMOVE);
+  TEST_ASSERT(moved >= MMAP_START && moved + PAGE_SIZE * 8 <= MMAP_END);
+  TEST_ASSERT(!process_prepare_read(addr, PAGE_SIZE));
+  TEST_ASSERT(process_prepare_read(moved, PAGE_SIZE * 8));
+  TEST_ASSERT(*(uint32_t*)moved == 1);
+
+  TEST_ASSERT(process_munmap(moved, PAGE_SIZE * 8) == 0);
+  TEST_ASSERT(!process_prepare_read(moved, PAGE_SIZE));
+
+  TEST_ASSERT(mmu_get_stat(pid, &stat) == 0);
+  TEST_ASSERT(stat.small_pages == base.small_pages);
+
+  /* the sections the kernel shares with every process are never handed out */
+  TEST_ASSERT((int)process_mmap((void*)0x10000000, PAGE_SIZE, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == -EINVAL);
+
+  addr = (uint8_t*)process_mmap((void*)0x1e000000, PAGE_SIZE, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  TEST_ASSERT(addr >= MMAP_START && addr + PAGE_SIZE <= MMAP_END);
+  TEST_ASSERT(!mmu_find_kernel_section((uint32_t)addr, PAGE_SIZE));
+  TEST_ASSERT(process_munmap(addr, PAGE_SIZE) == 0);
+}
+
+TEST(test_process_mmap_file) {
+  int fd;
+  char buf[4];
+  uint8_t *shared, *private;
+  struct inode *inode;
+
+  setup();
+
+  pseudo_switch_to(process_create(INIT_PATH));
+
+  fd = process_open("/a.txt", O_CREAT | O_RDWR | O_TRUNC, 0644);
+  TEST_ASSERT(process_write(fd, "abc", 3) == 3);
+  inode = current_process->files[fd]->dentry->inode;
+
+  shared  = (uint8_t*)process_mmap(NULL, 3, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  private = (uint8_t*)process_mmap(NULL, 3, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  TEST_ASSERT(shared >= MMAP_START && private >= MMAP_START);
+  TEST_ASSERT((int)process_mmap(NULL, 3, PROT_READ, MAP_SHARED, fd, 1) > 0);
+
+  /* both mappings start on the cached page */
+  TEST_ASSERT(process_prepare_read(shared, 3) && process_prepare_read(private, 3));
+  TEST_ASSERT(memcmp(shared, "abc", 3) == 0);
+
+  TEST_ASSERT(process_prepare_write(private, 1));
+  private[0] = 'p';
+  TEST_ASSERT(process_prepare_write(shared, 1));
+  shared[0] = 's';
+
+  /* the shared write lands in the cache, the private one does not */
+  TEST_ASSERT(private[0] == 'p');
+  TEST_ASSERT(*(char*)page_address(inode_get_page(inode, 0)) == 's');
+  TEST_ASSERT(inode_read(inode, 3, 0, buf) == 3);
+  TEST_ASSERT(memcmp(buf, "sbc", 3) == 0);
+
+  TEST_ASSERT(process_msync(shared, 3, MS_SYNC) == 0);
+  TEST_ASSERT(process_munmap(shared, 3) == 0);
+  TEST_ASSERT(process_munmap(private, 3) == 0);
+  TEST_ASSERT(!process_prepare_read(shared, 3));
+}
+
+TEST(test_process_prepare_out_of_memory) {
+  uint8_t *addr;
+  struct list held;
+  struct page *page, *temp;
+
+  setup();
+
+  pseudo_switch_to(process_create(INIT_PATH));
+
+  addr = (uint8_t*)process_mmap(NULL, PAGE_SIZE * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  TEST_ASSERT(process_prepare_read(addr, PAGE_SIZE));
+
+  /* reclaim has nothing left to give back */
+  list_init(&held);
+  while ((page = buddy_alloc(PAGE_SIZE))) {
+    list_add(&held, &page->list);
+  }
+
+  /* neither the copy of the zero page nor a fresh page can be had */
+  TEST_ASSERT(!process_prepare_write(addr, sizeof(uint32_t)));
+  TEST_ASSERT(!process_prepare_write(addr + PAGE_SIZE, sizeof(uint32_t)));
+  TEST_ASSERT(process_prepare_read(addr, PAGE_SIZE));
+
+  list_foreach_safe(page, temp, &held, list) {
+    list_remove(&page->list);
+    buddy_free(page);
+  }
+
+  TEST_ASSERT(process_prepare_write(addr, PAGE_SIZE * 2));
+  *(uint32_t*)(addr + PAGE_SIZE) = 1;
+}
+
 TEST(test_process_destroy_0) {
   pid_t parent_pid, child_pid;
   struct process *parent;
@@ -342,24 +591,141 @@ TEST(test_process_exit) {
   }
 }
 
+TEST(test_process_oom_kill) {
+  int i;
+  struct process *parent, *child;
+  struct mmu_stat stat;
+  setup();
+
+  parent = get_process(process_create(INIT_PATH));
+  pseudo_switch_to(parent->id);
+
+  /* the toplevel process is never picked */
+  TEST_ASSERT(!process_oom_kill());
+
+  child = get_process(process_fork(&parent->context));
+  TEST_ASSERT(mmu_get_stat(child->id, &stat) == 0);
+
+  TEST_ASSERT(process_oom_kill());
+
+  TEST_ASSERT(child->state == STATE_DEAD);
+  TEST_ASSERT(child->exit_status == WAIT_SIGNAL(SIGKILL));
+  TEST_ASSERT(mmu_get_stat(child->id, &stat) < 0);
+  TEST_ASSERT(list_empty(&child->vmas));
+
+  for (i = 0; i < 3; ++i) {
+    TEST_ASSERT(parent->files[i]->count == 3);
+  }
+
+  TEST_ASSERT(!process_oom_kill());
+}
+
 TEST(test_process_schedule) {
-  struct process *p;
+  struct process *a, *b, *c;
 
   setup();
 
-  p = get_process(process_create(INIT_PATH));
-  p->state = STATE_READY;
-
-  p = get_process(process_create(INIT_PATH));
-  p->state = STATE_BLOCKED;
+  a = get_process(process_create(INIT_PATH));
+  b = get_process(process_create(INIT_PATH));
+  c = get_process(process_create(INIT_PATH));
+
+  TEST_ASSERT(a->array == active_array);
+  TEST_ASSERT(b->array == active_array);
+  TEST_ASSERT(c->array == active_array);
+
+  /* blocked processes are off the queues entirely */
+  dequeue_process(b);
+  b->state = STATE_BLOCKED;
+
+  /* equal priorities take turns */
+  TEST_ASSERT(pick_next_process() == a);
+  requeue_process(a);
+  TEST_ASSERT(pick_next_process() == c);
+  requeue_process(c);
+  TEST_ASSERT(pick_next_process() == a);
+  requeue_process(a);
+
+  TEST_ASSERT(process_setpriority(PRIO_PROCESS, c->id, -5) == 0);
+  TEST_ASSERT(process_getpriority(PRIO_PROCESS, c->id) == 25);
+  TEST_ASSERT(process_setpriority(PRIO_PROCESS, 9999, 0) == -ESRCH);
+  TEST_ASSERT(process_setpriority(PRIO_USER, 0, 0) == -EINVAL);
+
+  /* a higher priority runs until its slice is spent */
+  c->slice = NICE_TO_SLICE(-5);
+  c->dispatched = 0;
+  TEST_ASSERT(pick_next_process() == c);
+  account_process(c, NICE_TO_SLICE(-5) - 1);
+  requeue_process(c);
+  TEST_ASSERT(c->array == active_array);
+  TEST_ASSERT(c->slice == 1);
+
+  TEST_ASSERT(pick_next_process() == c);
+  account_process(c, NICE_TO_SLICE(-5));
+  requeue_process(c);
+  TEST_ASSERT(c->array == expired_array);
+  TEST_ASSERT(c->slice == NICE_TO_SLICE(-5));
+  TEST_ASSERT(pick_next_process() == a);
+
+  /* woken processes are queued again */
+  make_ready(b);
+  TEST_ASSERT(pick_next_process() == b);
+
+  /* the arrays swap once the active one is empty */
+  TEST_ASSERT(pick_next_process() == c);
+  TEST_ASSERT(!pick_next_process());
+}
 
-  TEST_ASSERT(list_length(&all_processes) == 2);
-  TEST_ASSERT(list_length(&run_queue) == 0);
+TEST(test_process_schedule_realtime) {
+  struct process *a, *b, *c;
 
-  process_schedule();
+  setup();
 
-  TEST_ASSERT(list_length(&all_processes) == 2);
-  TEST_ASSERT(list_length(&run_queue) == 1);
+  a = get_process(process_create(INIT_PATH));
+  b = get_process(process_create(INIT_PATH));
+  c = get_process(process_create(INIT_PATH));
+
+  TEST_ASSERT(process_sched_setscheduler(b->id, SCHED_FIFO, 0) == -EINVAL);
+  TEST_ASSERT(process_sched_setscheduler(b->id, SCHED_OTHER, 10) == -EINVAL);
+  TEST_ASSERT(process_sched_setscheduler(b->id, 5, 10) == -EINVAL);
+  TEST_ASSERT(process_sched_get_priority_max(SCHED_RR) == 99);
+  TEST_ASSERT(process_sched_get_priority_min(SCHED_FIFO) == 1);
+
+  TEST_ASSERT(process_sched_setscheduler(b->id, SCHED_FIFO, 10) == 0);
+  TEST_ASSERT(process_sched_getscheduler(b->id) == SCHED_FIFO);
+  TEST_ASSERT(process_sched_getparam(b->id) == 10);
+
+  /* FIFO keeps the CPU across switches */
+  TEST_ASSERT(pick_next_process() == b);
+  requeue_process(b);
+  TEST_ASSERT(pick_next_process() == b);
+
+  /* until it yields to an equal priority */
+  TEST_ASSERT(process_sched_setscheduler(c->id, SCHED_RR, 10) == 0);
+  b->yielded = true;
+  requeue_process(b);
+  TEST_ASSERT(pick_next_process() == c);
+
+  /* RR keeps the CPU while its quantum lasts */
+  requeue_process(c);
+  TEST_ASSERT(c->array->queues[c->prio].next == &c->task);
+  TEST_ASSERT(pick_next_process() == c);
+
+  c->rr_left = 0;
+  requeue_process(c);
+  TEST_ASSERT(c->rr_left == RR_QUANTUM_USEC);
+  TEST_ASSERT(pick_next_process() == b);
+
+  /* a higher real-time priority goes first, normal processes last */
+  TEST_ASSERT(process_sched_setparam(a->id, 1) == -EINVAL);
+  TEST_ASSERT(process_sched_setscheduler(a->id, SCHED_RR, 50) == 0);
+  TEST_ASSERT(pick_next_process() == a);
+
+  TEST_ASSERT(process_sched_setscheduler(a->id, SCHED_OTHER, 0) == 0);
+  TEST_ASSERT(pick_next_process() == c);
+
+  requeue_process(a);
+  TEST_ASSERT(pick_next_process() == a);
+  TEST_ASSERT(!pick_next_process());
 }
 
 TEST(test_process_open_0) {
@@ -26,6 +26,12 @@ $shutdown
 */
 TEST(test_process_create_1);
 
+/*
+$fixture copy_sbin_init
+$shutdown
+*/
+TEST(test_process_create_text);
+
 /*
 $fixture copy_sbin_init
 $shutdown
@@ -74,18 +80,66 @@ $shutdown
 */
 TEST(test_process_exit);
 
+/*
+$fixture copy_sbin_init
+$shutdown
+*/
+TEST(test_process_oom_kill);
+
 /*
 $fixture copy_sbin_init
 $shutdown
 */
 TEST(test_process_fork);
 
+/*
+$fixture copy_sbin_init
+$shutdown
+*/
+TEST(test_process_fork_copy_on_write);
+
+/*
+$fixture copy_sbin_init
+$shutdown
+*/
+TEST(test_process_spawn);
+
+/*
+$fixture copy_sbin_init
+$shutdown
+*/
+TEST(test_process_brk);
+
+/*
+$fixture copy_sbin_init
+$shutdown
+*/
+TEST(test_process_mmap);
+
+/*
+$fixture copy_sbin_init
+$shutdown
+*/
+TEST(test_process_mmap_file);
+
+/*
+$fixture copy_sbin_init
+$shutdown
+*/
+TEST(test_process_prepare_out_of_memory);
+
 /*
 $fixture copy_sbin_init
 $shutdown
 */
 TEST(test_process_schedule);
 
+/*
+$fixture copy_sbin_init
+$shutdown
+*/
+TEST(test_process_schedule_realtime);
+
 /*
 $fixture copy_sbin_init
 $shutdown
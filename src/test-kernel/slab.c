@@ -0,0 +1,242 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <slab.c>
+
+#include "test.h"
+#include "slab.t"
+
+#include "block.h"
+#include "cache.h"
+
+static size_t free_pages(void) {
+  struct buddy_stat stat;
+
+  buddy_get_stat(&stat);
+  return stat.free_pages;
+}
+
+static struct slab_header *slab_of(void *obj) {
+  return page_address(page_find_head(page_find_by_address(obj)));
+}
+
+TEST(test_slab_alloc) {
+  size_t i;
+  struct slab_cache *cache;
+  uint32_t *objs[3];
+
+  page_init();
+
+  cache = slab_cache_create("test", sizeof(uint32_t));
+  TEST_ASSERT(cache);
+  TEST_ASSERT(list_empty(&cache->slabs_partial));
+
+  for (i = 0; i < 3; ++i) {
+    TEST_ASSERT((objs[i] = slab_cache_alloc(cache)));
+    *objs[i] = i;
+  }
+
+  TEST_ASSERT(slab_of(objs[0]) == slab_of(objs[2]));
+  TEST_ASSERT(slab_of(objs[0])->inuse == 3);
+  TEST_ASSERT(list_length(&cache->slabs_partial) == 1);
+
+  /* a freed slot is handed out again first */
+  slab_cache_free(cache, objs[1]);
+  TEST_ASSERT(slab_of(objs[0])->inuse == 2);
+  TEST_ASSERT(slab_cache_alloc(cache) == objs[1]);
+  TEST_ASSERT(*objs[0] == 0 && *objs[2] == 2);
+
+  slab_cache_destroy(cache);
+}
+
+TEST(test_slab_release_empty) {
+  size_t i, num, initial;
+  struct slab_cache *cache;
+  void **objs;
+
+  page_init();
+
+  cache = slab_cache_create("test", 256);
+  TEST_ASSERT(cache);
+
+  initial = free_pages();
+  num = cache->object_num;
+  objs = page_address(buddy_alloc(PAGE_SIZE));
+
+  /* fill three slabs */
+  for (i = 0; i < num * 3; ++i) {
+    TEST_ASSERT((objs[i] = slab_cache_alloc(cache)));
+  }
+  TEST_ASSERT(list_length(&cache->slabs_full) == 3);
+  TEST_ASSERT(list_empty(&cache->slabs_partial));
+
+  /* freeing one object moves its slab from full to partial */
+  slab_cache_free(cache, objs[0]);
+  TEST_ASSERT(list_length(&cache->slabs_full) == 2);
+  TEST_ASSERT(list_length(&cache->slabs_partial) == 1);
+
+  /* only empty_limit empty slabs stay cached, the rest go back to buddy */
+  for (i = 1; i < num * 3; ++i) {
+    slab_cache_free(cache, objs[i]);
+  }
+  TEST_ASSERT(list_empty(&cache->slabs_full));
+  TEST_ASSERT(list_empty(&cache->slabs_partial));
+  TEST_ASSERT(cache->empty_count == SLAB_EMPTY_LIMIT);
+  TEST_ASSERT(list_length(&cache->slabs_empty) == SLAB_EMPTY_LIMIT);
+
+  /* a cached empty slab is reused before a new one is allocated */
+  TEST_ASSERT((objs[0] = slab_cache_alloc(cache)));
+  TEST_ASSERT(!cache->empty_count);
+  slab_cache_free(cache, objs[0]);
+
+  TEST_ASSERT(slab_shrink() == SLAB_EMPTY_LIMIT * (cache->slab_size / PAGE_SIZE));
+  TEST_ASSERT(list_empty(&cache->slabs_empty));
+
+  buddy_free(page_find_by_address(objs));
+  TEST_ASSERT(free_pages() == initial);
+
+  slab_cache_destroy(cache);
+}
+
+TEST(test_kmalloc) {
+  size_t initial;
+  char *small, *large, *block;
+
+  page_init();
+
+  small = kmalloc(33);
+  TEST_ASSERT(small);
+  TEST_ASSERT(slab_of(small)->cache->object_size == 64);
+  TEST_ASSERT(page_find_head(page_find_by_address(small))->flags & PF_SLAB);
+
+  /* a page and beyond comes straight from the page allocator */
+  initial = free_pages();
+  block = kmalloc(BLOCK_SIZE);
+  TEST_ASSERT(block);
+  TEST_ASSERT(!(page_find_by_address(block)->flags & PF_SLAB));
+  TEST_ASSERT(page_find_by_address(block)->order == 0);
+  TEST_ASSERT(free_pages() == initial - 1);
+
+  initial = free_pages();
+  large = kmalloc(PAGE_SIZE * 2);
+  TEST_ASSERT(large);
+  TEST_ASSERT(!(page_find_by_address(large)->flags & PF_SLAB));
+  TEST_ASSERT(free_pages() == initial - 2);
+
+  kfree(large);
+  TEST_ASSERT(free_pages() == initial);
+
+  /* a freed object is reused by the next request of the same class */
+  kfree(small);
+  TEST_ASSERT(kmalloc(64) == small);
+
+  kfree(block);
+  kfree(NULL);
+}
+
+static size_t ctor_calls;
+
+static void count_ctor(void *obj) {
+  *(uint32_t*)obj = 0xdeadbeef;
+  ctor_calls++;
+}
+
+TEST(test_slab_align) {
+  size_t i, first, second;
+  struct slab_cache *cache;
+  uint8_t **objs;
+
+  page_init();
+  ctor_calls = 0;
+
+  TEST_ASSERT(!slab_cache_create_with("test", 40, 24, NULL));
+
+  cache = slab_cache_create_with("test", 40, CACHE_LINE_SIZE, count_ctor);
+  TEST_ASSERT(cache);
+  TEST_ASSERT(cache->object_size == 64);
+  TEST_ASSERT(cache->color_num > 1);
+
+  objs = page_address(buddy_alloc(PAGE_SIZE));
+
+  for (i = 0; i < cache->object_num + 1; ++i) {
+    TEST_ASSERT((objs[i] = slab_cache_alloc(cache)));
+    TEST_ASSERT(!((uint32_t)objs[i] % CACHE_LINE_SIZE));
+    TEST_ASSERT(*(uint32_t*)objs[i] == 0xdeadbeef);
+  }
+
+  /* constructed once per object as each slab is created */
+  TEST_ASSERT(ctor_calls == cache->object_num * 2);
+
+  /* the second slab starts its objects one color further in */
+  first = (uint8_t*)slab_of(objs[0])->object - (uint8_t*)slab_of(objs[0]);
+  second = (uint8_t*)slab_of(objs[cache->object_num])->object - (uint8_t*)slab_of(objs[cache->object_num]);
+  TEST_ASSERT(second == first + CACHE_LINE_SIZE);
+
+  /* objects are handed out again as they were freed, no constructor rerun */
+  slab_cache_free(cache, objs[0]);
+  TEST_ASSERT(slab_cache_alloc(cache) == objs[0]);
+  TEST_ASSERT(ctor_calls == cache->object_num * 2);
+
+  buddy_free(page_find_by_address(objs));
+  slab_cache_destroy(cache);
+}
+
+static struct slab_stat *find_stat(struct slab_stat *stats, size_t n, const char *name) {
+  size_t i;
+
+  for (i = 0; i < n; ++i) {
+    if (!strcmp(stats[i].name, name)) {
+      return &stats[i];
+    }
+  }
+
+  TEST_FAIL();
+  return NULL;
+}
+
+TEST(test_slab_stat) {
+  size_t n;
+  struct slab_cache *cache;
+  struct slab_stat stats[16], *stat;
+  void *a, *b;
+
+  page_init();
+
+  cache = slab_cache_create("test", 256);
+  TEST_ASSERT(cache);
+
+  a = slab_cache_alloc(cache);
+  b = slab_cache_alloc(cache);
+  slab_cache_free(cache, a);
+
+  n = slab_get_stat(stats, 16);
+  stat = find_stat(stats, n, "test");
+  TEST_ASSERT(stat->object_size == 256);
+  TEST_ASSERT(stat->allocs == 2 && stat->frees == 1);
+  TEST_ASSERT(stat->active == 1 && stat->active_max == 2);
+  TEST_ASSERT(stat->slabs == 1 && stat->empty_slabs == 0);
+  TEST_ASSERT(stat->pages == cache->slab_size / PAGE_SIZE);
+
+  /* the last object leaves the slab cached as empty */
+  slab_cache_free(cache, b);
+  n = slab_get_stat(stats, 16);
+  stat = find_stat(stats, n, "test");
+  TEST_ASSERT(stat->active == 0 && stat->empty_slabs == 1);
+
+  find_stat(stats, n, "kmalloc-32");
+
+  slab_cache_destroy(cache);
+}
@@ -0,0 +1,117 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <vma.c>
+
+#include "test.h"
+#include "vma.t"
+
+#include "page.h"
+
+#define ADDR(n) ((uint8_t*)((n) * PAGE_SIZE))
+
+static void setup(struct list *vmas) {
+  page_init();
+  vma_init();
+
+  list_init(vmas);
+}
+
+static struct vma *nth_vma(struct list *vmas, int n) {
+  struct vma *vma;
+
+  list_foreach(vma, vmas, next) {
+    if (!n--) {
+      return vma;
+    }
+  }
+
+  TEST_FAIL();
+  return NULL;
+}
+
+TEST(test_vma_create) {
+  struct list vmas;
+
+  setup(&vmas);
+
+  TEST_ASSERT(vma_create(&vmas, ADDR(4), ADDR(4), ADDR(8), VMA_FLAGS_GROWSUP));
+  TEST_ASSERT(vma_create(&vmas, ADDR(1), ADDR(1), ADDR(2), VMA_FLAGS_GROWSUP));
+  TEST_ASSERT(vma_create(&vmas, ADDR(8), ADDR(8), ADDR(9), VMA_FLAGS_GROWSUP));
+
+  TEST_ASSERT(!vma_create(&vmas, ADDR(3), ADDR(3), ADDR(5), VMA_FLAGS_GROWSUP));
+  TEST_ASSERT(!vma_create(&vmas, ADDR(5), ADDR(5), ADDR(5), VMA_FLAGS_GROWSUP));
+
+  TEST_ASSERT(list_length(&vmas) == 3);
+  TEST_ASSERT(nth_vma(&vmas, 0)->start == ADDR(1));
+  TEST_ASSERT(nth_vma(&vmas, 1)->start == ADDR(4));
+  TEST_ASSERT(nth_vma(&vmas, 2)->start == ADDR(8));
+
+  TEST_ASSERT(vma_find(&vmas, ADDR(4)) == nth_vma(&vmas, 1));
+  TEST_ASSERT(vma_find(&vmas, ADDR(8) - 1) == nth_vma(&vmas, 1));
+  TEST_ASSERT(vma_find(&vmas, ADDR(3)) == NULL);
+
+  TEST_ASSERT(vma_is_free(&vmas, ADDR(2), ADDR(4)));
+  TEST_ASSERT(!vma_is_free(&vmas, ADDR(2), ADDR(5)));
+}
+
+TEST(test_vma_find_free) {
+  struct list vmas;
+
+  setup(&vmas);
+
+  vma_create(&vmas, ADDR(2), ADDR(2), ADDR(4), VMA_FLAGS_GROWSUP);
+  vma_create(&vmas, ADDR(6), ADDR(6), ADDR(7), VMA_FLAGS_GROWSUP);
+
+  TEST_ASSERT(vma_find_free(&vmas, PAGE_SIZE * 2, ADDR(1), ADDR(10)) == ADDR(8));
+  TEST_ASSERT(vma_find_free(&vmas, PAGE_SIZE * 2, ADDR(1), ADDR(7)) == ADDR(4));
+  TEST_ASSERT(vma_find_free(&vmas, PAGE_SIZE * 3, ADDR(1), ADDR(7)) == NULL);
+}
+
+TEST(test_vma_remove) {
+  struct list vmas;
+
+  setup(&vmas);
+
+  vma_create(&vmas, ADDR(0), ADDR(2), ADDR(8), VMA_FLAGS_GROWSUP);
+  vma_remove(&vmas, ADDR(1), ADDR(3));
+
+  TEST_ASSERT(list_length(&vmas) == 2);
+  TEST_ASSERT(nth_vma(&vmas, 0)->start == ADDR(0));
+  TEST_ASSERT(nth_vma(&vmas, 0)->current == ADDR(1));
+  TEST_ASSERT(nth_vma(&vmas, 0)->end == ADDR(1));
+  TEST_ASSERT(nth_vma(&vmas, 1)->start == ADDR(3));
+  TEST_ASSERT(nth_vma(&vmas, 1)->current == ADDR(3));
+  TEST_ASSERT(nth_vma(&vmas, 1)->end == ADDR(8));
+
+  vma_remove(&vmas, ADDR(0), ADDR(8));
+  TEST_ASSERT(list_empty(&vmas));
+}
+
+TEST(test_vma_protect) {
+  struct list vmas;
+
+  setup(&vmas);
+
+  vma_create(&vmas, ADDR(0), ADDR(0), ADDR(8), VMA_FLAGS_GROWSUP | VMA_FLAGS_READ | VMA_FLAGS_WRITE);
+  vma_protect(&vmas, ADDR(2), ADDR(4), VMA_FLAGS_READ);
+
+  TEST_ASSERT(list_length(&vmas) == 3);
+  TEST_ASSERT(nth_vma(&vmas, 1)->start == ADDR(2));
+  TEST_ASSERT(nth_vma(&vmas, 1)->end == ADDR(4));
+  TEST_ASSERT(nth_vma(&vmas, 1)->flags == (VMA_FLAGS_GROWSUP | VMA_FLAGS_READ));
+  TEST_ASSERT(nth_vma(&vmas, 2)->flags == (VMA_FLAGS_GROWSUP | VMA_FLAGS_READ | VMA_FLAGS_WRITE));
+}
@@ -0,0 +1,76 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <test.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/auxv.h>
+
+/* copy_test_target installs the binary under its test name */
+#define SELF_PATH "/sbin/auxv_getauxval"
+
+#define MAX_PHNUM 16
+
+int main(void) {
+  int fd;
+  size_t i;
+  Elf32_Ehdr ehdr;
+  Elf32_Phdr phdrs[MAX_PHNUM];
+  const Elf32_Phdr *phdr, *load = NULL;
+  unsigned long bias;
+  TEST_START();
+
+  TEST_ASSERT(getauxval(AT_PAGESZ) == 4096);
+  TEST_ASSERT(sysconf(_SC_PAGESIZE) == 4096);
+
+  /* the running image is checked against the file it was loaded from */
+  TEST_ASSERT((fd = open(SELF_PATH, O_RDONLY)) >= 0);
+  TEST_ASSERT(read(fd, &ehdr, sizeof(ehdr)) == sizeof(ehdr));
+  TEST_ASSERT(!memcmp(ehdr.e_ident, ELFMAG, SELFMAG));
+  TEST_ASSERT(ehdr.e_phentsize == sizeof(Elf32_Phdr) && ehdr.e_phnum <= MAX_PHNUM);
+
+  TEST_ASSERT(lseek(fd, ehdr.e_phoff, SEEK_SET) == (off_t)ehdr.e_phoff);
+  TEST_ASSERT(read(fd, phdrs, ehdr.e_phnum * sizeof(Elf32_Phdr)) == (ssize_t)(ehdr.e_phnum * sizeof(Elf32_Phdr)));
+  close(fd);
+
+  TEST_ASSERT(getauxval(AT_PHENT) == sizeof(Elf32_Phdr));
+  TEST_ASSERT(getauxval(AT_PHNUM) == ehdr.e_phnum);
+
+  /* AT_PHDR points at the program headers as mapped in memory */
+  phdr = (const Elf32_Phdr*)getauxval(AT_PHDR);
+  TEST_ASSERT(phdr);
+  TEST_ASSERT(!memcmp(phdr, phdrs, ehdr.e_phnum * sizeof(Elf32_Phdr)));
+
+  for (i = 0; i < ehdr.e_phnum; ++i) {
+    if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_offset <= ehdr.e_phoff &&
+        ehdr.e_phoff < phdrs[i].p_offset + phdrs[i].p_filesz) {
+      load = &phdrs[i];
+      break;
+    }
+  }
+  TEST_ASSERT(load);
+
+  /* ET_DYN images are moved as a whole, ET_EXEC ones stay where they are linked */
+  bias = (unsigned long)phdr - (load->p_vaddr + (ehdr.e_phoff - load->p_offset));
+  TEST_ASSERT(ehdr.e_type == ET_DYN || bias == 0);
+
+  TEST_ASSERT(getauxval(AT_ENTRY) == ehdr.e_entry + bias);
+
+  TEST_SUCCEED();
+  return 0;
+}
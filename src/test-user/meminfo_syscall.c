@@ -0,0 +1,55 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define _GNU_SOURCE
+
+#include <test.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+/* private meminfo syscall, see src/kernel/syscall.c */
+#define SYS_cyanurus_meminfo 0x0f0101
+
+int main(void) {
+  long length;
+  char buf[4096], small[16];
+  TEST_START();
+
+  length = syscall(SYS_cyanurus_meminfo, buf, sizeof(buf));
+  TEST_ASSERT(length > 0 && length < (long)sizeof(buf));
+  TEST_ASSERT(strlen(buf) == (size_t)length);
+
+  TEST_ASSERT(!strncmp(buf, "free_pages ", 11));
+  TEST_ASSERT(strstr(buf, "\norder free failures\n"));
+  TEST_ASSERT(strstr(buf, "\nsmall_pages "));
+  TEST_ASSERT(strstr(buf, " process "));
+  TEST_ASSERT(strstr(buf, " kmalloc-2048 "));
+
+  /* truncated like snprintf, the full length is still reported */
+  TEST_ASSERT(syscall(SYS_cyanurus_meminfo, small, sizeof(small)) > (long)sizeof(small));
+  TEST_ASSERT(strlen(small) == sizeof(small) - 1);
+  TEST_ASSERT(!strncmp(small, buf, sizeof(small) - 1));
+
+  TEST_ASSERT(syscall(SYS_cyanurus_meminfo, (void*)0xf0000000, sizeof(buf)) == -1);
+  TEST_ASSERT(errno == EFAULT);
+
+  fputs(buf, stdout);
+
+  TEST_SUCCEED();
+  return 0;
+}
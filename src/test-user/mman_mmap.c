@@ -0,0 +1,80 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <test.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include "alice_text.h"
+
+static void check_mmap_anonymous(void) {
+  char *p;
+
+  p = mmap(NULL, 8192, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  TEST_ASSERT(p != MAP_FAILED);
+  TEST_ASSERT(p[0] == 0 && p[8191] == 0);
+
+  p[4096] = 1;
+  TEST_ASSERT(!mprotect(p, 8192, PROT_READ));
+  TEST_ASSERT(p[4096] == 1);
+
+  TEST_ASSERT(!munmap(p, 8192));
+}
+
+static void check_mmap_file(void) {
+  int fd;
+  char *shared, *private, buf[8];
+  size_t size = strlen(ALICE_TEXT);
+
+  fd = open("/usr/share/alice.txt", O_RDWR);
+  TEST_ASSERT(fd >= 0);
+
+  private = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  TEST_ASSERT(private != MAP_FAILED);
+  TEST_ASSERT(!memcmp(private, ALICE_TEXT, size));
+
+  private[0] = 'a';
+  TEST_ASSERT(read(fd, buf, 5) == 5);
+  TEST_ASSERT(!memcmp(buf, "Alice", 5));
+
+  shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  TEST_ASSERT(shared != MAP_FAILED);
+
+  shared[0] = 'B';
+  TEST_ASSERT(!msync(shared, size, MS_SYNC));
+  TEST_ASSERT(lseek(fd, 0, SEEK_SET) == 0);
+  TEST_ASSERT(read(fd, buf, 5) == 5);
+  TEST_ASSERT(!memcmp(buf, "Blice", 5));
+  TEST_ASSERT(private[0] == 'a');
+
+  shared[0] = 'A';
+  TEST_ASSERT(!munmap(shared, size));
+  TEST_ASSERT(!munmap(private, size));
+  TEST_ASSERT(!close(fd));
+}
+
+int main(void) {
+  TEST_START();
+
+  check_mmap_anonymous();
+  check_mmap_file();
+
+  TEST_SUCCEED();
+  return 0;
+}
@@ -0,0 +1,60 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <test.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+int main(void) {
+  int st;
+  pid_t pid;
+  TEST_START();
+
+  TEST_ASSERT(getpriority(PRIO_PROCESS, 0) == 0);
+
+  TEST_ASSERT(setpriority(PRIO_PROCESS, 0, 5) == 0);
+  TEST_ASSERT(getpriority(PRIO_PROCESS, 0) == 5);
+
+  /* libcs differ in what nice returns, so read the value back */
+  TEST_ASSERT(nice(-2) != -1);
+  TEST_ASSERT(getpriority(PRIO_PROCESS, getpid()) == 3);
+
+  /* out of range values are clamped */
+  TEST_ASSERT(setpriority(PRIO_PROCESS, 0, 100) == 0);
+  TEST_ASSERT(getpriority(PRIO_PROCESS, 0) == 19);
+
+  TEST_ASSERT(setpriority(PRIO_PROCESS, 0, -100) == 0);
+  TEST_ASSERT(getpriority(PRIO_PROCESS, 0) == -20);
+
+  TEST_ASSERT(setpriority(PRIO_PROCESS, 9999, 0) == -1);
+  TEST_ASSERT(errno == ESRCH);
+
+  /* children inherit the nice value */
+  pid = fork();
+  TEST_ASSERT(pid >= 0);
+
+  if (!pid) {
+    _exit(getpriority(PRIO_PROCESS, 0) == -20 ? 0 : 1);
+  }
+
+  TEST_ASSERT(wait(&st) == pid);
+  TEST_ASSERT(WIFEXITED(st) && WEXITSTATUS(st) == 0);
+
+  TEST_SUCCEED();
+  return 0;
+}
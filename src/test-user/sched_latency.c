@@ -0,0 +1,166 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define _GNU_SOURCE
+
+#include <test.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define BACKGROUND 3
+#define ITERATIONS 16
+
+struct latency {
+  long total;
+  long max;
+};
+
+static long now_usec(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* musl leaves sched_setscheduler unimplemented, so go through syscall */
+static int set_scheduler(int policy) {
+  struct sched_param param;
+
+  param.sched_priority = (policy == SCHED_OTHER) ? 0 : sched_get_priority_max(policy);
+  return syscall(SYS_sched_setscheduler, 0, policy, &param);
+}
+
+static pid_t start_background(void) {
+  volatile unsigned long n = 0;
+  pid_t pid = fork();
+
+  if (!pid) {
+    for (;;) {
+      n++;
+    }
+  }
+
+  return pid;
+}
+
+/*
+ * The child sleeps on a pipe; each wakeup carries the time it was sent
+ * at and the child answers with how long it took until it ran.
+ */
+static void measure(int policy, struct latency *latency) {
+  int i, status, ping[2], pong[2];
+  long sent, delay;
+  pid_t pid;
+
+  TEST_ASSERT(pipe(ping) == 0);
+  TEST_ASSERT(pipe(pong) == 0);
+
+  pid = fork();
+  TEST_ASSERT(pid >= 0);
+
+  if (!pid) {
+    close(ping[1]);
+    close(pong[0]);
+
+    if (set_scheduler(policy) < 0) {
+      _exit(1);
+    }
+
+    while (read(ping[0], &sent, sizeof(sent)) == sizeof(sent)) {
+      delay = now_usec() - sent;
+      write(pong[1], &delay, sizeof(delay));
+    }
+
+    _exit(0);
+  }
+
+  latency->total = latency->max = 0;
+
+  /* the first round trip also covers the child starting up */
+  for (i = 0; i <= ITERATIONS; ++i) {
+    sent = now_usec();
+    TEST_ASSERT(write(ping[1], &sent, sizeof(sent)) == sizeof(sent));
+    TEST_ASSERT(read(pong[0], &delay, sizeof(delay)) == sizeof(delay));
+
+    if (i) {
+      latency->total += delay;
+      latency->max = (delay > latency->max) ? delay : latency->max;
+    }
+  }
+
+  close(ping[1]);
+  close(pong[0]);
+
+  TEST_ASSERT(wait(&status) == pid);
+  TEST_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  close(ping[0]);
+  close(pong[1]);
+}
+
+static void report(const char *name, const struct latency *latency) {
+  printf("%-12s %8ld usec avg %8ld usec max\n", name, latency->total / ITERATIONS, latency->max);
+}
+
+int main(void) {
+  int i, status;
+  pid_t background[BACKGROUND];
+  struct latency other, fifo, rr;
+  struct timespec quantum;
+
+  TEST_START();
+
+  TEST_ASSERT(sched_get_priority_max(SCHED_FIFO) == 99);
+  TEST_ASSERT(sched_get_priority_min(SCHED_RR) == 1);
+  TEST_ASSERT(syscall(SYS_sched_getscheduler, 0) == SCHED_OTHER);
+
+  for (i = 0; i < BACKGROUND; ++i) {
+    TEST_ASSERT((background[i] = start_background()) > 0);
+  }
+
+  measure(SCHED_OTHER, &other);
+  measure(SCHED_FIFO, &fifo);
+  measure(SCHED_RR, &rr);
+
+  for (i = 0; i < BACKGROUND; ++i) {
+    TEST_ASSERT(kill(background[i], SIGKILL) == 0);
+    TEST_ASSERT(wait(&status) > 0);
+  }
+
+  report("SCHED_OTHER", &other);
+  report("SCHED_FIFO", &fifo);
+  report("SCHED_RR", &rr);
+
+  /*
+   * Real-time readers run as soon as they are woken, ahead of the load,
+   * so they never wait longer than a reader queued behind it. The numbers
+   * themselves are only reported, they depend on the host.
+   */
+  TEST_ASSERT(fifo.max <= other.max);
+  TEST_ASSERT(rr.max <= other.max);
+
+  TEST_ASSERT(set_scheduler(SCHED_RR) == 0);
+  TEST_ASSERT(sched_rr_get_interval(0, &quantum) == 0);
+  TEST_ASSERT(quantum.tv_sec || quantum.tv_nsec);
+
+  TEST_SUCCEED();
+  return 0;
+}
@@ -0,0 +1,115 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define _GNU_SOURCE
+
+#include <test.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/* private spawn syscall, see src/kernel/syscall.c */
+#define SYS_cyanurus_spawn 0x0f0100
+
+#define ITERATIONS 32
+#define CHILD_PATH "/sbin/spawn_benchmark"
+
+extern char **environ;
+
+static char *const child_argv[] = {
+  CHILD_PATH,
+  "child",
+  NULL,
+};
+
+static pid_t fork_exec(void) {
+  pid_t pid = fork();
+
+  if (!pid) {
+    execve(CHILD_PATH, child_argv, environ);
+    _exit(127);
+  }
+
+  return pid;
+}
+
+static pid_t vfork_exec(void) {
+  pid_t pid = vfork();
+
+  if (!pid) {
+    execve(CHILD_PATH, child_argv, environ);
+    _exit(127);
+  }
+
+  return pid;
+}
+
+static pid_t libc_posix_spawn(void) {
+  pid_t pid;
+
+  if (posix_spawn(&pid, CHILD_PATH, NULL, NULL, child_argv, environ)) {
+    return -1;
+  }
+
+  return pid;
+}
+
+static pid_t kernel_spawn(void) {
+  return syscall(SYS_cyanurus_spawn, CHILD_PATH, child_argv, environ);
+}
+
+static void benchmark(const char *name, pid_t (*launch)(void)) {
+  int i, status;
+  pid_t pid;
+  long usec;
+  struct timespec start, end;
+
+  TEST_ASSERT(clock_gettime(CLOCK_MONOTONIC, &start) == 0);
+
+  for (i = 0; i < ITERATIONS; ++i) {
+    pid = launch();
+    TEST_ASSERT(pid > 0);
+
+    TEST_ASSERT(wait(&status) == pid);
+    TEST_ASSERT(WIFEXITED(status));
+    TEST_ASSERT(WEXITSTATUS(status) == 0);
+  }
+
+  TEST_ASSERT(clock_gettime(CLOCK_MONOTONIC, &end) == 0);
+
+  usec = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+  printf("%-12s %8ld usec/launch\n", name, usec / ITERATIONS);
+}
+
+int main(int argc, char *argv[]) {
+  (void)argv;
+
+  if (argc > 1) {
+    return 0;
+  }
+
+  TEST_START();
+
+  benchmark("fork+exec", fork_exec);
+  benchmark("vfork+exec", vfork_exec);
+  benchmark("posix_spawn", libc_posix_spawn);
+  benchmark("spawn", kernel_spawn);
+
+  TEST_SUCCEED();
+  return 0;
+}
@@ -0,0 +1,63 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <test.h>
+#include <errno.h>
+#include <time.h>
+
+static long now_usec(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int main(void) {
+  long start, elapsed;
+  struct timespec req;
+  TEST_START();
+
+  /* a sleep shorter than a tick still lasts as long as asked, how much longer depends on the host */
+  req.tv_sec = 0;
+  req.tv_nsec = 500000;
+
+  start = now_usec();
+  TEST_ASSERT(nanosleep(&req, NULL) == 0);
+  elapsed = now_usec() - start;
+
+  TEST_ASSERT(elapsed >= 500);
+
+  /* absolute deadlines on the monotonic clock */
+  clock_gettime(CLOCK_MONOTONIC, &req);
+  req.tv_nsec += 2000000;
+  if (req.tv_nsec >= 1000000000) {
+    req.tv_sec += 1;
+    req.tv_nsec -= 1000000000;
+  }
+
+  TEST_ASSERT(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &req, NULL) == 0);
+  TEST_ASSERT(now_usec() >= req.tv_sec * 1000000 + req.tv_nsec / 1000);
+
+  /* a deadline in the past returns at once */
+  TEST_ASSERT(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &req, NULL) == 0);
+
+  req.tv_nsec = 1000000000;
+  TEST_ASSERT(nanosleep(&req, NULL) == -1);
+  TEST_ASSERT(errno == EINVAL);
+
+  TEST_SUCCEED();
+  return 0;
+}
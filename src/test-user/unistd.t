@@ -36,6 +36,11 @@ $fixture copy_test_target
 */
 TEST(unistd_wait);
 
+/*
+$fixture copy_test_target
+*/
+TEST(unistd_vfork);
+
 /*
 $fixture copy_test_target
 */
@@ -0,0 +1,48 @@
+/*
+Copyright 2026 Akira Midorikawa
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define _GNU_SOURCE
+
+#include <test.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static int shared;
+
+int main(void) {
+  int status;
+  pid_t pid;
+
+  TEST_START();
+
+  pid = vfork();
+  TEST_ASSERT(pid >= 0);
+
+  if (!pid) {
+    shared = 1;
+    _exit(2);
+  }
+
+  /* the child ran on our address space and has already exited */
+  TEST_ASSERT(shared == 1);
+
+  TEST_ASSERT(wait(&status) == pid);
+  TEST_ASSERT(WIFEXITED(status));
+  TEST_ASSERT(WEXITSTATUS(status) == 2);
+
+  TEST_SUCCEED();
+  return 0;
+}